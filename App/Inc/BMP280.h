@@ -8,64 +8,395 @@
 
 #pragma once
 
-#include "stm32f1xx_hal.h"
+#include "BMP280_Compensation.h"
 #include <stdbool.h>
+#include <stdint.h>
 
-typedef struct BMP280_Result {
-  float Temperature, Pressure;
-} BMP280_Result;
+/**
+ * @brief Result of a transport operation, values follow HAL_StatusTypeDef
+ */
+typedef enum BMP280_Status {
+  BMP280_OK = 0,  /**< Transfer done */
+  BMP280_ERROR,   /**< Bus error, NACK or unexpected sensor state */
+  BMP280_BUSY,    /**< Bus owned by a DMA readout, or data not ready yet */
+  BMP280_TIMEOUT  /**< Transfer not finished by its deadline */
+} BMP280_Status;
+
+/**
+ * @brief State of asynchronous (interrupt or DMA) transfer
+ */
+typedef enum BMP280_AsyncState {
+  BMP280_ASYNC_IDLE = 0, /**< No readout started */
+  BMP280_ASYNC_BUSY,     /**< Data burst transfer in progress */
+  BMP280_ASYNC_DONE,     /**< Raw data received, ready for compensation */
+  BMP280_ASYNC_ERROR     /**< Data burst transfer failed */
+} BMP280_AsyncState;
+
+/**
+ * @brief Bus traffic and read scheduling counters of one sensor
+ */
+typedef struct BMP280_Stats {
+  uint32_t transactions;     /**< Bus transactions started */
+  uint32_t statusReads;      /**< STATUS register reads */
+  uint32_t samples;          /**< Raw data bursts read */
+  uint32_t configMismatches; /**< Bursts with unexpected configuration */
+  uint32_t retries;          /**< Transfers repeated after an error */
+  uint32_t timeouts;         /**< Transfers not finished by the deadline */
+  uint32_t busRecoveries;    /**< Bus recovery sequences run */
+  uint32_t probes;           /**< Normal mode early reads finding last sample */
+  uint32_t duplicates;       /**< Scheduled reads repeating last sample */
+  uint32_t missed;           /**< Normal mode samples never read */
+  uint32_t resyncs;          /**< Normal mode phase measurements */
+  int32_t phaseDrift_us;     /**< Last measured error of predicted phase */
+} BMP280_Stats;
+
+/**
+ * @brief Normal mode read schedule, see BMP280_NormalUpdate()
+ *
+ * Times are transport ticks in microseconds, modulo 2^32.
+ */
+typedef struct BMP280_NormalSchedule {
+  uint32_t period_us;         /**< Estimated output data period */
+  uint32_t ready_us;          /**< Estimated ready time of last sample */
+  uint32_t readyWidth_us;     /**< Uncertainty of ready_us */
+  uint32_t periodWidth_us;    /**< Uncertainty of period_us */
+  uint32_t reference_us;      /**< Measured ready time of reference sample */
+  uint32_t referenceWidth_us; /**< Uncertainty of reference_us */
+  uint32_t sinceReference;    /**< Samples produced since reference */
+  uint32_t sinceResync;       /**< Samples read since last phase measurement */
+  uint32_t lead_us;           /**< Probe read time before predicted ready */
+  uint32_t step_us;           /**< Delay of next read after a duplicate */
+  uint32_t lastNew_us;        /**< Time of last read of a new sample */
+  uint32_t lastDuplicate_us;  /**< Time of last duplicate read */
+  uint32_t next_us;           /**< Scheduled read time */
+  uint32_t lastSamples;       /**< stats.samples at last update */
+  int32_t lastRawTemperature; /**< Raw temperature of last new sample */
+  int32_t lastRawPressure;    /**< Raw pressure of last new sample */
+  bool referenced;            /**< reference_us is valid */
+  bool locked;                /**< Phase known, reads go after ready time */
+  bool duplicateSeen;         /**< Last sample read again since new one */
+  bool probe;                 /**< Scheduled read may find the last sample */
+} BMP280_NormalSchedule;
+
+struct BMP280_Device;
 
 /**
- * @brief Initialize sensor with chosen settings
+ * @brief Register access and time source of one sensor connection
+ *
+ * The driver core reaches the sensor only through these operations, so it
+ * builds without MCU HAL. STM32 HAL I2C and SPI transports are in
+ * BMP280_STM32.h, an in-memory sensor for host builds in BMP280_Mock.h.
+ * Operations get the sensor context, their bus handle is dev->bus.
+ */
+typedef struct BMP280_Transport {
+  /** Read size registers starting at reg, the sensor auto-increments */
+  BMP280_Status (*read)(struct BMP280_Device *dev,
+                        uint8_t reg,
+                        uint8_t *data,
+                        uint16_t size);
+  /** Write data[0] to reg, following bytes are address/data pairs */
+  BMP280_Status (*write)(struct BMP280_Device *dev,
+                         uint8_t reg,
+                         const uint8_t *data,
+                         uint16_t size);
+  /** Sleep for ms ticks, the first one may be partial */
+  void (*delay_ms)(struct BMP280_Device *dev, uint32_t ms);
+  /** Free running millisecond tick, wraps modulo 2^32 */
+  uint32_t (*tick_ms)(const struct BMP280_Device *dev);
+} BMP280_Transport;
+
+/**
+ * @brief Per-sensor driver context
+ *
+ * One instance has to be kept for every physical sensor. It is filled by
+ * BMP280_Init_I2C(), BMP280_Init_SPI() or BMP280_Init() and then passed to
+ * every other BMP280_* call, so several sensors can be sampled back-to-back
+ * without re-reading calibration.
+ */
+typedef struct BMP280_Device {
+  const struct BMP280_Transport *transport; /**< Sensor connection */
+  void *bus;                       /**< Transport handle, e.g. I2C handle */
+  uint8_t device_address;          /**< I2C device address */
+  void *csPort;                    /**< SPI chip select GPIO port */
+  uint16_t csPin;                  /**< SPI chip select GPIO pin */
+  bool threeWire;                  /**< SPI 3-wire mode, kept in CONFIG */
+  uint8_t osrs_t;                  /**< Temperature oversampling setting */
+  uint8_t osrs_p;                  /**< Pressure oversampling setting */
+  uint8_t acq_mode;                /**< Acquisition mode setting */
+  uint8_t t_sb;                    /**< Standby time setting */
+  uint8_t filter_tc;               /**< IIR filter time constant setting */
+  uint8_t ctrlMeas;                /**< CTRL_MEAS as last written */
+  uint8_t config;                  /**< CONFIG as last written */
+  struct BMP280_Calibration calib; /**< Calibration constants */
+  /** Calibration terms derived from calib */
+  struct BMP280_CalibrationDerived derived;
+  int32_t t_fine;                  /**< Fine temperature */
+  int32_t rawTemperature;          /**< Last raw temperature sample */
+  int32_t rawPressure;             /**< Last raw pressure sample */
+  /** DMA destination for data burst, SPI clocks in one byte before data */
+  uint8_t rxBuffer[11];
+  bool conversionPending;          /**< Forced conversion not read yet */
+  uint32_t conversionStart;        /**< Tick of forced mode trigger */
+  uint32_t samplePeriod_ms;        /**< Forced mode period, 0 = on demand */
+  uint32_t nextSampleTick;         /**< Tick of next periodic trigger */
+  uint32_t healthPeriod_ms;        /**< Health check period, 0 = never */
+  uint32_t nextHealthTick;         /**< Tick of next health check */
+  struct BMP280_NormalSchedule normal; /**< Normal mode read schedule */
+  struct BMP280_Stats stats;       /**< Bus traffic counters */
+  uint32_t transferDeadline;       /**< Tick ending DMA readout */
+  void *waitingTask;               /**< TaskHandle_t waiting for IT xfer */
+  /** Interrupt/DMA transfer state, updated from bus interrupt context */
+  volatile BMP280_AsyncState asyncState;
+} BMP280_Device;
+
+/**
+ * @brief Initialize sensor with chosen settings over its transport
+ *
+ * The sensor is soft reset and polled until it finished copying NVM, then
+ * configured with one write and verified with one read. Takes about 3 ms
+ * at 400 kHz. BMP280_Init_I2C() and BMP280_Init_SPI() set the transport up
+ * and call this, on other platforms fill transport, bus and the addressing
+ * fields of dev first (see BMP280_MockAttach()).
+ * @param dev Sensor context with transport set, to be filled
  * @param osrs_t Temperature oversampling setting
  * @param osrs_p Pressure oversampling setting
  * @param acq_mode Acquisition mode setting
  * @param t_sb Standby time setting
  * @param filter_tc Sensor IIR Filter time constant setting
- * @param i2c_handle Desired MCU I2C peripheral for communication with sensor
- * @param device_address I2C device address
  * @return Configuration status\n
  * false == unsuccessful\n
  * true == successful
  */
-bool BMP280_Init_I2C(uint8_t osrs_t,
-                     uint8_t osrs_p,
-                     uint8_t acq_mode,
-                     uint8_t t_sb,
-                     uint8_t filter_tc,
-                     I2C_HandleTypeDef i2c_handle,
-                     uint8_t device_address);
+bool BMP280_Init(struct BMP280_Device *dev,
+                 uint8_t osrs_t,
+                 uint8_t osrs_p,
+                 uint8_t acq_mode,
+                 uint8_t t_sb,
+                 uint8_t filter_tc);
+
+/**
+ * @brief Take over a sensor configured before, with known calibration
+ *
+ * Nothing is written: the sensor has to report its ID and the configuration
+ * the settings give (MCU reset without sensor power loss), checked with two
+ * short reads. Used by BMP280_InitWarm_I2C().
+ * @param dev Sensor context with transport set, to be filled
+ * @param osrs_t Temperature oversampling setting
+ * @param osrs_p Pressure oversampling setting
+ * @param acq_mode Acquisition mode setting
+ * @param t_sb Standby time setting
+ * @param filter_tc Sensor IIR Filter time constant setting
+ * @param calib Calibration constants read from this sensor before
+ * @return Resume status\n
+ * false == sensor not responding or not configured, run BMP280_Init()\n
+ * true == sensor ready
+ */
+bool BMP280_Resume(struct BMP280_Device *dev,
+                   uint8_t osrs_t,
+                   uint8_t osrs_p,
+                   uint8_t acq_mode,
+                   uint8_t t_sb,
+                   uint8_t filter_tc,
+                   const struct BMP280_Calibration *calib);
 
 /**
  * @brief Read sensor calibration parameters over I2C
- * @param i2c_handle Desired MCU I2C peripheral for communication with sensor
- * @param device_address I2C device address
+ *
+ * Derived calibration terms used by compensation are computed here as well.
+ * @param dev Sensor context, calibration is stored in it
+ * @return Bus status of the read, calibration in dev is kept unless
+ * BMP280_OK
  */
-void BMP280_CalibrationConstantsRead_I2C(I2C_HandleTypeDef i2c_handle,
-                                         uint8_t device_address);
+BMP280_Status BMP280_CalibrationConstantsRead_I2C(struct BMP280_Device *dev);
 
 /**
  * @brief Wake sensor over I2C - used when measuring in forced mode
- * @param i2c_handle Desired MCU I2C peripheral for communication with sensor\n
- * @param device_address I2C device address\n
- * BMP280_DEVICE_ADDRESS_GND = 0x76\n
- * BMP280_DEVICE_ADDRESS_VDDIO = 0x77
+ *
+ * CTRL_MEAS is written from the driver's copy in a single transaction, the
+ * sensor is not read back. When a health check is due (see
+ * BMP280_HealthPeriodSet()) it runs first. In normal mode nothing is
+ * written, the sensor keeps converting on its own.
+ * @param dev Initialized sensor context
  * @return Wake status\n
  * false == unsuccessful\n
  * true == successful
  */
-bool BMP280_Wake_I2C(I2C_HandleTypeDef i2c_handle, uint8_t device_address);
+bool BMP280_Wake_I2C(struct BMP280_Device *dev);
+
+/**
+ * @brief Check sensor ID and configuration over I2C
+ *
+ * CTRL_MEAS and CONFIG are compared with the values last written; a sensor
+ * which lost them (e.g. after brown-out reset) is configured again. Mode
+ * bits are compared in normal mode only, a forced conversion returns to
+ * sleep by itself.
+ * @param dev Initialized sensor context
+ * @return Check status\n
+ * false == no response, wrong ID or configuration could not be restored\n
+ * true == sensor configured as expected
+ */
+bool BMP280_HealthCheck_I2C(struct BMP280_Device *dev);
+
+/**
+ * @brief Set period of health checks run by BMP280_Wake_I2C()
+ *
+ * With BMP280_BURST_READ every readout already verifies the configuration,
+ * the periodic check adds the ID and covers sensors read only rarely.
+ * @param dev Initialized sensor context
+ * @param period_ms Check period in ms, 0 disables checks
+ */
+void BMP280_HealthPeriodSet(struct BMP280_Device *dev, uint32_t period_ms);
+
+/**
+ * @brief Typical measurement time for configured oversampling
+ *
+ * Computed with datasheet formula (section 3.8.1):\n
+ * 1 + 2 * T_os + 2 * P_os + 0.5 [ms], last term only with pressure enabled
+ * @param dev Initialized sensor context
+ * @return Measurement time in microseconds
+ */
+uint32_t BMP280_MeasurementTimeTypical_us(const struct BMP280_Device *dev);
+
+/**
+ * @brief Maximum measurement time for configured oversampling
+ *
+ * Computed with datasheet formula (section 3.8.1):\n
+ * 1.25 + 2.3 * T_os + 2.3 * P_os + 0.575 [ms], last term only with pressure
+ * enabled
+ * @param dev Initialized sensor context
+ * @return Measurement time in microseconds
+ */
+uint32_t BMP280_MeasurementTimeMax_us(const struct BMP280_Device *dev);
+
+/**
+ * @brief Predicted normal mode output data period
+ *
+ * Typical measurement time plus standby time t_sb (datasheet section 3.6.3)
+ * @param dev Initialized sensor context
+ * @return Period in microseconds
+ */
+uint32_t BMP280_NormalPeriod_us(const struct BMP280_Device *dev);
+
+/**
+ * @brief Restart normal mode read schedule from the predicted period
+ *
+ * Called by BMP280_Init_I2C(), call it again after changing t_sb or
+ * oversampling of a running sensor.
+ * @param dev Initialized sensor context
+ */
+void BMP280_NormalScheduleStart(struct BMP280_Device *dev);
+
+/**
+ * @brief Sleep until the next normal mode sample should be ready
+ *
+ * Every read has to be followed by BMP280_NormalUpdate().
+ * @param dev Sensor context running in BMP280_VAL_CTRL_MEAS_MODE_NORMAL
+ */
+void BMP280_NormalWait(struct BMP280_Device *dev);
+
+/**
+ * @brief Account a read made after BMP280_NormalWait() and schedule the next
+ *
+ * Reads of a locked schedule go just after the latest ready time the phase
+ * and period uncertainties allow; these grow with every predicted sample.
+ * About every BMP280_NORMAL_PROBE_SAMPLES samples, while the phase is
+ * unknown or once the uncertainty exceeds 1/8 period, a probe read goes
+ * ahead of the predicted time to find the previous sample again, counted
+ * in probes. Such a read is repeated with growing delay; the first new
+ * sample then gives a phase measurement, which corrects the period
+ * estimate. A locked read finding the previous sample
+ * means the prediction was wrong: it is counted as duplicate and the
+ * schedule falls back to probing, so a working schedule counts none. Lost
+ * samples are counted in whole periods since the last ready time.
+ * @param dev Sensor context
+ * @return Read status\n
+ * true == new sample, to be consumed\n
+ * false == duplicate or failed read, read again after BMP280_NormalWait()
+ */
+bool BMP280_NormalUpdate(struct BMP280_Device *dev);
+
+/**
+ * @brief Read every normal mode sample exactly once over I2C
+ *
+ * Sleeps until the next sample is ready and reads it, duplicates are read
+ * again until the new sample appears.
+ * @param dev Sensor context running in BMP280_VAL_CTRL_MEAS_MODE_NORMAL
+ * @return Measurement values and status flags, see BMP280_MeasureInt_I2C()
+ */
+struct BMP280_ResultInt BMP280_MeasureNormalInt_I2C(struct BMP280_Device *dev);
 
 /**
  * @brief Measure temperature and pressure over I2C
- * @param i2c_handle Desired MCU I2C peripheral for communication with sensor
- * @param device_address I2C device address\n
- * BMP280_DEVICE_ADDRESS_GND = 0x76\n
- * BMP280_DEVICE_ADDRESS_VDDIO = 0x77
+ *
+ * After BMP280_Wake_I2C() the calling task sleeps for the remaining maximum
+ * conversion time and the STATUS register is checked once. In normal mode
+ * the data registers are shadowed, so they are read without waiting.
+ *
+ * Every register access has a deadline of its bus time plus
+ * BMP280_I2C_TIMEOUT_MARGIN_MS and is tried at most BMP280_I2C_RETRIES + 1
+ * times, with bus recovery after a timeout or bus error. At 400 kHz one
+ * access takes at most about 15 ms with a faulty bus, so a normal mode
+ * call returns within that; forced mode adds the conversion time and the
+ * STATUS access.
+ * @param dev Initialized sensor context
  * @return Measurement values
  */
-struct BMP280_Result BMP280_Measure_I2C(I2C_HandleTypeDef i2c_handle,
-                                        uint8_t device_address);
+struct BMP280_Result BMP280_Measure_I2C(struct BMP280_Device *dev);
+
+/**
+ * @brief Measure temperature and pressure over I2C without floating point
+ *
+ * Same timing and retry policy as BMP280_Measure_I2C()
+ * @param dev Initialized sensor context
+ * @return Measurement values and status flags\n
+ * BMP280_RESULT_VALID - fresh sample\n
+ * BMP280_RESULT_STALE - forced conversion not finished, previous sample\n
+ * BMP280_RESULT_BUS_ERROR - I2C error or unexpected sensor state
+ */
+struct BMP280_ResultInt BMP280_MeasureInt_I2C(struct BMP280_Device *dev);
+
+/**
+ * @brief Set sample period of forced mode acquisition
+ *
+ * The first periodic sample is triggered immediately, the following ones on
+ * multiples of the period from it, independent of readout duration.
+ * @param dev Sensor context initialized with BMP280_VAL_CTRL_MEAS_MODE_FORCED
+ * or BMP280_VAL_CTRL_MEAS_MODE_SLEEP
+ * @param period_ms Sample period in ms, 0 triggers on every call
+ */
+void BMP280_ForcedPeriodSet(struct BMP280_Device *dev, uint32_t period_ms);
+
+/**
+ * @brief Acquire one forced mode sample over I2C
+ *
+ * Waits for the next period set by BMP280_ForcedPeriodSet(), triggers one
+ * conversion, sleeps the calling task for the maximum conversion time and
+ * reads the result. The sensor returns to sleep mode by itself after the
+ * conversion, so it draws standby current between samples.
+ * @param dev Sensor context initialized with BMP280_VAL_CTRL_MEAS_MODE_FORCED
+ * or BMP280_VAL_CTRL_MEAS_MODE_SLEEP
+ * @return Measurement values and status flags, see BMP280_MeasureInt_I2C()
+ */
+struct BMP280_ResultInt BMP280_MeasureForcedInt_I2C(struct BMP280_Device *dev);
+
+/**
+ * @brief Acquire one forced mode sample over I2C in degC and Pa
+ * @param dev Initialized sensor context, see BMP280_MeasureForcedInt_I2C()
+ * @return Measurement values
+ */
+struct BMP280_Result BMP280_MeasureForced_I2C(struct BMP280_Device *dev);
+
+/**
+ * @brief Validate and compensate a readout burst transferred by the caller
+ *
+ * For transfers outside the transport operations, e.g. DMA: data holds
+ * BMP280_READOUT_LEN bytes read from BMP280_READOUT_REG.
+ * @param dev Initialized sensor context
+ * @param data Readout burst
+ * @return Measurement values and status flags, see BMP280_MeasureInt_I2C()
+ */
+struct BMP280_ResultInt BMP280_ReadoutCompensate(struct BMP280_Device *dev,
+                                                 const uint8_t *data);
 
 /**
  * \name Sensor I2C addresses
@@ -163,8 +494,8 @@ struct BMP280_Result BMP280_Measure_I2C(I2C_HandleTypeDef i2c_handle,
 /**
  * \name Valid STATUS register flags masks
  */
-#define BMP280_VAL_STATUS_MEASURING 1U << 3 /**< Measuring busy flag */
-#define BMP280_VAL_STATUS_IM_UPDATE 1U << 0 /**< NVM copying status flag */
+#define BMP280_VAL_STATUS_MEASURING (1U << 3) /**< Measuring busy flag */
+#define BMP280_VAL_STATUS_IM_UPDATE (1U << 0) /**< NVM copying status flag */
 
 /**
  * \name Valid CTRL_MEAS register acquisition option values
@@ -205,11 +536,43 @@ struct BMP280_Result BMP280_Measure_I2C(I2C_HandleTypeDef i2c_handle,
 #define BMP280_VAL_CTRL_SPI3W_EN 0b00000001 /**< Enable SPI 3-wire */
 
 /**
- * \name MCU specific setting - affects pressure processing formula
+ * \name Sensor start-up
  */
 //@{
-#define RETURN_64BIT true /**< for MCU with 64-bit operations support */
-#define RETURN_32BIT false  /**< for MCU without 64-bit operations support */
-                           //@}
+/** Soft reset to NVM copy finished limit, datasheet start-up time is 2 ms */
+#define BMP280_RESET_TIMEOUT_MS 10
+//@}
+
+/**
+ * \name Normal mode read scheduling
+ */
+//@{
+/** Samples between phase measurements when period estimate is exact */
+#define BMP280_NORMAL_PROBE_SAMPLES 16
+/** Read time resolution, one transport tick */
+#define BMP280_NORMAL_MARGIN_US 1000
+/** Span of period measurement, kept well below 2^31 us wrap of times */
+#define BMP280_NORMAL_REFERENCE_MAX_US (1UL << 30)
+//@}
+
+/**
+ * \name Readout setting
+ *
+ * When enabled, every sample is read as one 10-byte burst of registers
+ * 0xF3..0xFC: STATUS, CTRL_MEAS and CONFIG are checked and the data are
+ * parsed from the same buffer. Otherwise only the 6 data registers are read.
+ */
+//@{
+#define BMP280_BURST_READ true /**< Single STATUS..TEMP_XLSB transaction */
+#if BMP280_BURST_READ
+#define BMP280_READOUT_REG BMP280_REG_STATUS /**< STATUS..TEMP_XLSB burst */
+#define BMP280_READOUT_LEN 10                /**< Burst length */
+#define BMP280_READOUT_DATA 4 /**< Offset of PRESS_MSB in burst */
+#else
+#define BMP280_READOUT_REG BMP280_REG_PRESS_MSB /**< PRESS..TEMP burst */
+#define BMP280_READOUT_LEN 6                    /**< Burst length */
+#define BMP280_READOUT_DATA 0 /**< Offset of PRESS_MSB in burst */
+#endif
+//@}
 
 /* INC_BMP280_H_ */
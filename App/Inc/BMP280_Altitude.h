@@ -0,0 +1,79 @@
+/**
+ * @file BMP280_Altitude.h
+ * @brief Barometric altitude from compensated pressure in fixed point
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * \name Barometric formula of the standard atmosphere
+ *
+ * h = T0 / L * (1 - (p / p0)^(R * L / (g * M)))
+ */
+//@{
+#define BMP280_ALTITUDE_SCALE_CM 4433077 /**< T0 / L = 288.15 K / 6.5 K/km */
+#define BMP280_ALTITUDE_EXPONENT 0.1902632 /**< R * L / (g * M) */
+/** Sea level pressure of the standard atmosphere, Q24.8 Pa */
+#define BMP280_ALTITUDE_STANDARD_REFERENCE (101325U << 8)
+//@}
+
+/**
+ * \name Fixed-point altitude accuracy
+ *
+ * Largest difference to the exact formula, rounding to whole centimeters
+ * included, for pressure and reference in 300..1100 hPa (certified by
+ * Tools/BMP280Altitude over every Q24.8 pressure of the range).
+ */
+//@{
+#define BMP280_ALTITUDE_MAX_ERROR_CM 1 /**< Max error of BMP280_AltitudeInt() */
+#define BMP280_ALTITUDE_INVALID INT32_MIN /**< Result for zero pressure */
+//@}
+
+/**
+ * @brief Reference of altitude computation, see BMP280_AltitudeReferenceSet()
+ */
+typedef struct BMP280_Altitude {
+  uint32_t reference; /**< Pressure at zero altitude, Q24.8 Pa */
+  int64_t lnReference; /**< Natural logarithm of reference, Q32 */
+} BMP280_Altitude;
+
+/**
+ * @brief Set pressure of zero altitude
+ * @param alt Reference to be filled
+ * @param reference Pressure at zero altitude in Pa, Q24.8 format, e.g.
+ * BMP280_ALTITUDE_STANDARD_REFERENCE or local QNH
+ */
+void BMP280_AltitudeReferenceSet(struct BMP280_Altitude *alt,
+                                 uint32_t reference);
+
+/**
+ * @brief Altitude above the reference in integer arithmetic
+ *
+ * The logarithm of pressure comes from a 32-entry table and a short
+ * series, the power from an exp(x) - 1 polynomial; about a dozen 32x32->64
+ * multiplications and no runtime division, the constant divisors of the
+ * series become multiplies. Estimated Cortex-M3 cycles from its
+ * Thumb-2 code: about 230, 3.2 us at 72 MHz without flash wait states.
+ * BMP280_AltitudeFloat() needs some 40 soft float operations and a
+ * division, estimated at 2000 to 2500 cycles. Host timings do not carry
+ * over, a host FPU makes powf() the faster one. PROFILER_ALTITUDE_FIXED
+ * and PROFILER_ALTITUDE_FLOAT measure both on the target.
+ * @param alt Reference set by BMP280_AltitudeReferenceSet()
+ * @param pressure Pressure in Pa, Q24.8 format, as BMP280_ResultInt
+ * @return Altitude in cm, BMP280_ALTITUDE_INVALID for zero pressure
+ */
+int32_t BMP280_AltitudeInt(const struct BMP280_Altitude *alt,
+                           uint32_t pressure);
+
+/**
+ * @brief Altitude with powf(), reference for BMP280_AltitudeInt()
+ *
+ * Costs about ten times BMP280_AltitudeInt() in soft float on Cortex-M3,
+ * kept for accuracy and timing comparison.
+ * @param pressure Pressure in Pa, Q24.8 format
+ * @param reference Pressure at zero altitude in Pa, Q24.8 format
+ * @return Altitude in cm
+ */
+float BMP280_AltitudeFloat(uint32_t pressure, uint32_t reference);
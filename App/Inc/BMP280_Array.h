@@ -0,0 +1,78 @@
+/**
+ * @file BMP280_Array.h
+ * @brief Normal mode sensors spread over several buses, read concurrently
+ */
+
+#pragma once
+
+#include "BMP280_STM32.h"
+
+/**
+ * \name Sensor array limits
+ */
+//@{
+#define BMP280_ARRAY_MAX_SENSORS 8 /**< Sensors in one array */
+/** Samples held for time ordering, sensors with short periods fill it
+    while a slow one is waited for; a full queue passes its oldest out */
+#define BMP280_ARRAY_QUEUE_LEN (2 * BMP280_ARRAY_MAX_SENSORS)
+//@}
+
+/**
+ * @brief One sample of the merged stream of BMP280_ArrayNext()
+ */
+typedef struct BMP280_ArraySample {
+  struct BMP280_ResultInt result; /**< Measurement values and flags */
+  uint32_t ready_us;              /**< Estimated ready time, tick * 1000 */
+  uint8_t sensor;                 /**< Index of the sensor in the array */
+} BMP280_ArraySample;
+
+/**
+ * @brief Sensors sampled together, see BMP280_ArrayNext()
+ */
+typedef struct BMP280_Array {
+  struct BMP280_Device *sensor[BMP280_ARRAY_MAX_SENSORS]; /**< Sensors */
+  uint8_t count;                /**< Sensors in use */
+  uint8_t buses;                /**< Distinct buses of the sensors */
+  bool running[BMP280_ARRAY_MAX_SENSORS]; /**< DMA readout in flight */
+  /** Samples held back until no earlier one can come, by ready time */
+  struct BMP280_ArraySample queue[BMP280_ARRAY_QUEUE_LEN];
+  uint8_t queued;               /**< Samples in queue */
+  uint32_t samples;             /**< Samples passed out */
+  uint32_t errors;              /**< Failed readouts */
+  uint32_t rounds;              /**< Wake-ups reading due sensors */
+  uint32_t overlapped;          /**< Readouts started with another running */
+  uint32_t startTick;           /**< Tick of BMP280_ArrayStart() */
+} BMP280_Array;
+
+/**
+ * @brief Set sensors up for BMP280_ArrayNext()
+ *
+ * Sensors have to be initialized in BMP280_VAL_CTRL_MEAS_MODE_NORMAL, on
+ * at most BMP280_ASYNC_MAX_TRANSFERS buses (e.g. two on I2C1 and two on
+ * I2C2, at 0x76 and 0x77 each).
+ * @param array Array context to be filled
+ * @param sensors Initialized sensor contexts
+ * @param count Number of sensors, at most BMP280_ARRAY_MAX_SENSORS
+ * @return Setup status\n
+ * false == too many sensors or buses, or a sensor not in normal mode\n
+ * true == array ready
+ */
+bool BMP280_ArrayStart(struct BMP280_Array *array,
+                       struct BMP280_Device *const *sensors,
+                       uint8_t count);
+
+/**
+ * @brief Next sample of all sensors, in order of ready time
+ *
+ * Sleeps until the earliest sensor is due, then starts DMA readouts of all
+ * due sensors: one per bus at a time, so the buses transfer concurrently
+ * and a bus starts its next readout as soon as the previous one finished.
+ * Every new sample goes to a queue sorted by estimated ready time and is
+ * passed out once no sensor can produce an earlier one, so samples can be
+ * held back for up to the longest sensor period. Duplicates and failed
+ * reads never reach the stream, failures count in errors: bus errors,
+ * timeouts and readouts finding the sensor out of its configuration.
+ * @param array Array context
+ * @return Sample and the index of its sensor
+ */
+struct BMP280_ArraySample BMP280_ArrayNext(struct BMP280_Array *array);
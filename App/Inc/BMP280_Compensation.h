@@ -0,0 +1,183 @@
+/**
+ * @file BMP280_Compensation.h
+ * @brief BMP280 compensation formulas, independent of MCU HAL
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Factory calibration constants read from sensor's NVM
+ */
+typedef struct BMP280_Calibration {
+  uint16_t dig_T1; /**< Temperature compensation word 1 */
+  int16_t dig_T2;  /**< Temperature compensation word 2 */
+  int16_t dig_T3;  /**< Temperature compensation word 3 */
+  uint16_t dig_P1; /**< Pressure compensation word 1 */
+  int16_t dig_P2;  /**< Pressure compensation word 2 */
+  int16_t dig_P3;  /**< Pressure compensation word 3 */
+  int16_t dig_P4;  /**< Pressure compensation word 4 */
+  int16_t dig_P5;  /**< Pressure compensation word 5 */
+  int16_t dig_P6;  /**< Pressure compensation word 6 */
+  int16_t dig_P7;  /**< Pressure compensation word 7 */
+  int16_t dig_P8;  /**< Pressure compensation word 8 */
+  int16_t dig_P9;  /**< Pressure compensation word 9 */
+} BMP280_Calibration;
+
+/**
+ * @brief Calibration terms precomputed once for compensation formulas
+ *
+ * Products are used instead of left shifts of signed words, so the values
+ * are identical to datasheet expressions without relying on shifts of
+ * negative numbers.
+ */
+typedef struct BMP280_CalibrationDerived {
+  int32_t T1_s1;  /**< dig_T1 << 1 */
+  int64_t P2_s12; /**< dig_P2 << 12 */
+  int64_t P4_s35; /**< dig_P4 << 35 */
+  int64_t P5_s17; /**< dig_P5 << 17 */
+  int64_t P7_s4;  /**< dig_P7 << 4 */
+  int32_t P4_s16; /**< dig_P4 << 16, 32-bit formula */
+  int32_t P5_s1;  /**< dig_P5 << 1, 32-bit formula */
+  int32_t P4_s14; /**< dig_P4 << 14, approximate formula */
+  int32_t P1_inv; /**< 3125 * 2^(9 + P1_inv_shift) / dig_P1, approximate
+                       formula, 0 if dig_P1 is out of its range */
+  uint8_t P1_inv_shift; /**< Fractional bits of P1_inv */
+} BMP280_CalibrationDerived;
+
+/**
+ * @brief Precompute calibration terms which do not depend on measured data
+ * @param calib Calibration constants read from sensor
+ * @param derived Terms used by compensation formulas
+ */
+void BMP280_CalibrationDerive(const struct BMP280_Calibration *calib,
+                              struct BMP280_CalibrationDerived *derived);
+
+/**
+ * @brief Compensate raw temperature, datasheet integer formula
+ * @param calib Calibration constants
+ * @param derived Terms from BMP280_CalibrationDerive()
+ * @param adc_T Raw temperature ADC value
+ * @param t_fine Fine temperature output, used by pressure formulas
+ * @return Temperature in 0.01 degC
+ */
+int32_t BMP280_calculate_T_int32(
+    const struct BMP280_Calibration *calib,
+    const struct BMP280_CalibrationDerived *derived,
+    int32_t adc_T,
+    int32_t *t_fine);
+
+/**
+ * @brief Compensate raw pressure, datasheet 64-bit integer formula
+ * @param calib Calibration constants
+ * @param derived Terms from BMP280_CalibrationDerive()
+ * @param t_fine Fine temperature from BMP280_calculate_T_int32()
+ * @param adc_P Raw pressure ADC value
+ * @return Pressure in Pa, Q24.8 format
+ */
+uint32_t BMP280_calculate_P_int64(
+    const struct BMP280_Calibration *calib,
+    const struct BMP280_CalibrationDerived *derived,
+    int32_t t_fine,
+    int32_t adc_P);
+
+/**
+ * @brief Compensate raw pressure, datasheet 32-bit integer formula
+ * @param calib Calibration constants
+ * @param derived Terms from BMP280_CalibrationDerive()
+ * @param t_fine Fine temperature from BMP280_calculate_T_int32()
+ * @param adc_P Raw pressure ADC value
+ * @return Pressure in Pa
+ */
+uint32_t BMP280_calculate_P_int32(
+    const struct BMP280_Calibration *calib,
+    const struct BMP280_CalibrationDerived *derived,
+    int32_t t_fine,
+    int32_t adc_P);
+
+/**
+ * @brief Compensate raw pressure, 32-bit approximation of 64-bit formula
+ *
+ * The 64-bit division is replaced by 1 / dig_P1 precomputed in
+ * BMP280_CalibrationDerive() and a temperature dependent reciprocal
+ * seeded by 32-bit hardware division and refined with one Newton step.
+ * Only 32x32->64 multiplies are used (single UMULL/SMULL on Cortex-M3).
+ *
+ * For t_fine of BMP280_P_APPROX_T_FINE_MIN..MAX (-40..85 degC) and the
+ * whole adc_P range the result differs from BMP280_calculate_P_int64() by
+ * at most BMP280_P_APPROX_ERROR LSB, certified per calibration set by
+ * Tools/BMP280Approx. Calibration sets with dig_P1 < 16384 and t_fine
+ * outside that range fall back to BMP280_calculate_P_int64().
+ *
+ * Estimated from the Thumb-2 code of both formulas at Cortex-M3 cycle
+ * timings: about 180 cycles, against about 330..360 for the 64-bit formula
+ * with its libgcc division, 2.5 us less per sample at 72 MHz.
+ * @param calib Calibration constants
+ * @param derived Terms from BMP280_CalibrationDerive()
+ * @param t_fine Fine temperature from BMP280_calculate_T_int32()
+ * @param adc_P Raw pressure ADC value
+ * @return Pressure in Pa, Q24.8 format
+ */
+uint32_t BMP280_calculate_P_approx(
+    const struct BMP280_Calibration *calib,
+    const struct BMP280_CalibrationDerived *derived,
+    int32_t t_fine,
+    int32_t adc_P);
+
+typedef struct BMP280_Result {
+  float Temperature, Pressure;
+} BMP280_Result;
+
+/**
+ * @brief Integer measurement result, see BMP280_RESULT_* flags
+ */
+typedef struct BMP280_ResultInt {
+  int32_t Temperature;    /**< Temperature in 0.01 degC */
+  uint32_t Pressure;      /**< Pressure in Pa, Q24.8 format */
+  int32_t rawTemperature; /**< Raw temperature ADC value */
+  int32_t rawPressure;    /**< Raw pressure ADC value */
+  uint8_t flags;          /**< Result status flags */
+} BMP280_ResultInt;
+
+/**
+ * \name Integer result status flags
+ */
+//@{
+#define BMP280_RESULT_VALID (1U << 0)      /**< Values are from new sample */
+#define BMP280_RESULT_T_DISABLED (1U << 1) /**< Temperature skipped */
+#define BMP280_RESULT_P_DISABLED (1U << 2) /**< Pressure skipped */
+#define BMP280_RESULT_BUS_ERROR (1U << 3)  /**< No data from sensor */
+#define BMP280_RESULT_STALE (1U << 4)      /**< Values repeat last sample */
+#define BMP280_RESULT_MEDIAN (1U << 5) /**< Outlier replaced, BMP280_Median */
+//@}
+
+/**
+ * @brief Convert integer result to degC and Pa
+ * @param result Result returned by BMP280_MeasureInt_I2C()
+ * @return Measurement values, zeros for invalid result or disabled channel
+ */
+struct BMP280_Result
+BMP280_ResultToFloat(const struct BMP280_ResultInt *result);
+
+/**
+ * \name MCU specific setting - affects pressure processing formula
+ */
+//@{
+#define RETURN_64BIT true /**< for MCU with 64-bit operations support */
+#define RETURN_32BIT false  /**< for MCU without 64-bit operations support */
+#define RETURN_APPROX false /**< 32-bit approximation of 64-bit formula */
+                           //@}
+
+#if RETURN_64BIT + RETURN_32BIT + RETURN_APPROX != 1
+#error "Select exactly one pressure formula"
+#endif
+
+/** Certified error of BMP280_calculate_P_approx(), LSB of Q24.8 */
+#define BMP280_P_APPROX_ERROR 4
+/** t_fine range of BMP280_calculate_P_approx(), -40..85 degC */
+#define BMP280_P_APPROX_T_FINE_MIN (-204800)
+#define BMP280_P_APPROX_T_FINE_MAX 435200
+
+/* INC_BMP280_COMPENSATION_H_ */
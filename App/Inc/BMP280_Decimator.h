@@ -0,0 +1,80 @@
+/**
+ * @file BMP280_Decimator.h
+ * @brief Integer CIC decimation of measurement results
+ */
+
+#pragma once
+
+#include "BMP280_Compensation.h"
+
+/**
+ * \name Decimator limits
+ *
+ * Register growth is order * shift bits, at most 24 bits over the 32-bit
+ * inputs, so 64-bit wrapping registers never lose the result.
+ */
+//@{
+#define BMP280_DECIMATOR_MAX_ORDER 3 /**< Cascaded boxcar stages */
+#define BMP280_DECIMATOR_MAX_SHIFT 8 /**< log2 of the largest ratio, 256 */
+/** Filtered fields: Temperature, Pressure, rawTemperature, rawPressure */
+#define BMP280_DECIMATOR_CHANNELS 4
+//@}
+
+/**
+ * @brief Decimation stage of one result stream, see BMP280_DecimatorPush()
+ */
+typedef struct BMP280_Decimator {
+  /** Integrator stages of each channel, wrapping */
+  uint64_t integrator[BMP280_DECIMATOR_CHANNELS][BMP280_DECIMATOR_MAX_ORDER];
+  /** Comb stage inputs of the previous output, wrapping */
+  uint64_t comb[BMP280_DECIMATOR_CHANNELS][BMP280_DECIMATOR_MAX_ORDER];
+  uint8_t order;    /**< Cascaded boxcar stages, 1 == plain average */
+  uint8_t shift;    /**< log2 of decimation ratio */
+  uint16_t phase;   /**< Inputs since the last output */
+  uint8_t settle;   /**< Outputs still to be dropped after start */
+  uint8_t flags;    /**< Disabled flags of inputs since the last output */
+  uint32_t inputs;  /**< Valid results pushed */
+  uint32_t skipped; /**< Pushed results not flagged BMP280_RESULT_VALID */
+  uint32_t outputs; /**< Results passed out */
+} BMP280_Decimator;
+
+/**
+ * @brief Set a decimator up and clear its history
+ *
+ * Order 1 averages blocks of 2^shift samples, cutting white noise by
+ * sqrt(2^shift). Higher orders suppress aliases more strongly and, as they
+ * span order * 2^shift inputs, cut white noise to about 0.82 (order 2) and
+ * 0.74 (order 3) of that; the delay is order * (2^shift - 1) / 2 inputs. E.g.
+ * shift 4 turns x1 oversampling in normal mode with 0.5 ms standby, about
+ * 150 Hz, into about 9 Hz with a quarter of the noise.
+ * @param dec Decimator to be filled
+ * @param order Cascaded stages, 1 .. BMP280_DECIMATOR_MAX_ORDER
+ * @param shift log2 of ratio, 0 .. BMP280_DECIMATOR_MAX_SHIFT, 0 passes
+ * every result through
+ * @return Setup status\n
+ * false == order or shift out of range\n
+ * true == decimator ready
+ */
+bool BMP280_DecimatorInit(struct BMP280_Decimator *dec, uint8_t order,
+                          uint8_t shift);
+
+/**
+ * @brief Feed one result, get every 2^shift-th one filtered
+ *
+ * Temperature, pressure and both raw values are filtered independently,
+ * consumers pick compensated or raw fields. Filtering raw values and
+ * compensating afterwards is not exactly the same, the compensation is
+ * not linear. Results without BMP280_RESULT_VALID (stale, bus errors) are
+ * skipped, the output then spans more time. The first order - 1 outputs
+ * are dropped while the stages fill. Fixed cost, no allocation.
+ * @param dec Decimator set up by BMP280_DecimatorInit()
+ * @param in Result of the sensor
+ * @param out Filtered result, written when true is returned; flagged
+ * BMP280_RESULT_VALID and the disabled flags of its inputs
+ * @return Output status\n
+ * false == input consumed, no output yet\n
+ * true == out holds a new result
+ */
+bool BMP280_DecimatorPush(struct BMP280_Decimator *dec,
+                          const struct BMP280_ResultInt *in,
+                          struct BMP280_ResultInt *out);
@@ -0,0 +1,81 @@
+/**
+ * @file BMP280_Median.h
+ * @brief Streaming median outlier rejection of measurement results
+ */
+
+#pragma once
+
+#include "BMP280_Compensation.h"
+
+/**
+ * \name Median stage limits
+ */
+//@{
+#define BMP280_MEDIAN_MAX_WINDOW 7 /**< Largest window, 3, 5 or 7 */
+/** Filtered fields: Temperature, Pressure, rawTemperature, rawPressure */
+#define BMP280_MEDIAN_CHANNELS 4
+//@}
+
+/**
+ * @brief Median stage of one result stream, see BMP280_MedianPush()
+ */
+typedef struct BMP280_Median {
+  /** Last window values of each channel, ring */
+  int32_t value[BMP280_MEDIAN_CHANNELS][BMP280_MEDIAN_MAX_WINDOW];
+  uint8_t flags[BMP280_MEDIAN_MAX_WINDOW]; /**< Flags of ring samples */
+  uint8_t window;       /**< Samples per median, odd */
+  uint8_t next;         /**< Ring slot of the next sample, the oldest */
+  uint8_t filled;       /**< Samples in ring before the first output */
+  uint32_t thresholdT;  /**< Largest kept temperature deviation, 0.01 degC */
+  uint32_t thresholdP;  /**< Largest kept pressure deviation, Q24.8 Pa */
+  uint32_t skipped;     /**< Pushed results not flagged BMP280_RESULT_VALID */
+  uint32_t outputs;     /**< Results passed out */
+  uint32_t replaced;    /**< Outputs flagged BMP280_RESULT_MEDIAN */
+} BMP280_Median;
+
+/**
+ * @brief Set a median stage up and clear its history
+ * @param med Median stage to be filled
+ * @param window Samples per median: 3, 5 or 7 remove spikes of up to 1, 2
+ * or 3 consecutive samples, 1 passes every result through
+ * @param thresholdT Temperature deviation from the median in 0.01 degC
+ * up to which a sample is kept
+ * @param thresholdP Pressure deviation from the median in Pa, Q24.8
+ * format, up to which a sample is kept; 0 and 0 turn the stage into a
+ * plain median filter
+ * @return Setup status\n
+ * false == window even or out of range\n
+ * true == median stage ready
+ */
+bool BMP280_MedianInit(struct BMP280_Median *med, uint8_t window,
+                       uint32_t thresholdT, uint32_t thresholdP);
+
+/**
+ * @brief Feed one result, get the one window / 2 samples older with
+ * spikes replaced
+ *
+ * The center sample of the window passes unchanged unless its temperature
+ * or pressure deviates from the median of the window by more than the
+ * threshold, so noise is not smoothed and only outliers are touched. A
+ * replaced sample gets the median of each field, flagged
+ * BMP280_RESULT_MEDIAN; the fields may come from different samples, raw
+ * values then do not exactly compensate to temperature and pressure.
+ * Results without BMP280_RESULT_VALID are skipped, the first window - 1
+ * valid results only fill the window.
+ *
+ * Selection networks of 3, 7 and 13 compare-exchanges without branches
+ * make the cost fixed. Estimated Cortex-M3 cycles per network from its
+ * Thumb-2 code: about 20 (window 3), 42 (5) and 76 (7); with four channels
+ * and the ring about 170, 260 and 390 per result, 2 to 6 us at 72 MHz.
+ * PROFILER_STATUS_MEDIAN measures it on the target.
+ * @param med Median stage set up by BMP280_MedianInit()
+ * @param in Result of the sensor
+ * @param out Filtered result, written when true is returned; flags of the
+ * center sample, BMP280_RESULT_MEDIAN added when replaced
+ * @return Output status\n
+ * false == input consumed, no output yet\n
+ * true == out holds a new result
+ */
+bool BMP280_MedianPush(struct BMP280_Median *med,
+                       const struct BMP280_ResultInt *in,
+                       struct BMP280_ResultInt *out);
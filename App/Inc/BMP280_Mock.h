@@ -0,0 +1,53 @@
+/**
+ * @file BMP280_Mock.h
+ * @brief In-memory BMP280 transport for host builds of the driver
+ */
+
+#pragma once
+
+#include "BMP280.h"
+
+/**
+ * @brief Register file of one simulated sensor and its clock
+ *
+ * Conversions finish at once: STATUS never reports measuring or NVM copy,
+ * the data registers hold what BMP280_MockSample() put there. Time moves
+ * only through the delay operation, so runs are repeatable.
+ */
+typedef struct BMP280_Mock {
+  uint8_t regs[256];     /**< Register file, indexed by address */
+  uint32_t tick_ms;      /**< Simulated tick */
+  uint32_t reads;        /**< Read transactions */
+  uint32_t writes;       /**< Write transactions */
+  BMP280_Status failure; /**< Returned by every transfer unless BMP280_OK */
+} BMP280_Mock;
+
+/**
+ * @brief Transport operations on a BMP280_Mock, dev->bus is the mock
+ */
+extern const struct BMP280_Transport BMP280_TransportMock;
+
+/**
+ * @brief Power the simulated sensor up with given calibration
+ * @param mock Sensor to reset, counters and tick are cleared as well
+ * @param calib Calibration constants stored in its NVM
+ */
+void BMP280_MockReset(struct BMP280_Mock *mock,
+                      const struct BMP280_Calibration *calib);
+
+/**
+ * @brief Put a finished conversion in the data registers
+ * @param mock Simulated sensor
+ * @param adc_T Raw temperature, 20 bits
+ * @param adc_P Raw pressure, 20 bits
+ */
+void BMP280_MockSample(struct BMP280_Mock *mock, int32_t adc_T, int32_t adc_P);
+
+/**
+ * @brief Connect a driver context to the simulated sensor
+ *
+ * Call BMP280_Init() afterwards, as with a real transport.
+ * @param dev Sensor context
+ * @param mock Simulated sensor
+ */
+void BMP280_MockAttach(struct BMP280_Device *dev, struct BMP280_Mock *mock);
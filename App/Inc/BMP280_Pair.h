@@ -0,0 +1,83 @@
+/**
+ * @file BMP280_Pair.h
+ * @brief Pipelined forced mode sampling of two sensors on one bus
+ */
+
+#pragma once
+
+#include "BMP280.h"
+
+/**
+ * @brief Results of both sensors from one BMP280_PairMeasure() call
+ *
+ * A conversion runs from its trigger tick for at most
+ * BMP280_MeasurementTimeMax_us() of its sensor, the ticks of one pair
+ * differ by the readout of one sensor.
+ */
+typedef struct BMP280_PairSample {
+  struct BMP280_ResultInt result[2]; /**< Result of each sensor */
+  uint32_t tick_ms[2];               /**< Conversion trigger tick of each */
+} BMP280_PairSample;
+
+/**
+ * @brief Throughput of a pair since BMP280_PairStart()
+ *
+ * Rates count samples of both sensors, in samples per 1000 s.
+ */
+typedef struct BMP280_PairReport {
+  uint32_t pairs;          /**< Pairs measured */
+  uint32_t errors;         /**< Results flagged BMP280_RESULT_BUS_ERROR */
+  uint32_t elapsed_ms;     /**< Time from the first trigger */
+  uint32_t rate_mHz;       /**< Measured sample rate */
+  uint32_t pipelined_mHz;  /**< Limit with both conversions overlapped */
+  uint32_t sequential_mHz; /**< Limit of one sensor after the other */
+  uint32_t maxSkew_ms;     /**< Largest trigger tick difference in a pair */
+} BMP280_PairReport;
+
+/**
+ * @brief Two sensors sampled in turns, see BMP280_PairMeasure()
+ */
+typedef struct BMP280_Pair {
+  struct BMP280_Device *sensor[2]; /**< Sensors, e.g. at GND and VDDIO */
+  bool triggered[2];    /**< Conversion of the sensor started */
+  bool running;         /**< First conversions triggered */
+  uint32_t startTick;   /**< Tick of the first trigger */
+  uint32_t pairs;       /**< Pairs measured */
+  uint32_t errors;      /**< Results flagged BMP280_RESULT_BUS_ERROR */
+  uint32_t maxSkew_ms;  /**< Largest trigger tick difference in a pair */
+} BMP280_Pair;
+
+/**
+ * @brief Set a pair of sensors up for BMP280_PairMeasure()
+ *
+ * Both sensors have to be initialized in forced mode (or sleep mode) with
+ * on-demand sampling, and share the time base of one transport.
+ * @param pair Pair context to be filled
+ * @param first Sensor measured first in every pair
+ * @param second Sensor measured second
+ */
+void BMP280_PairStart(struct BMP280_Pair *pair,
+                      struct BMP280_Device *first,
+                      struct BMP280_Device *second);
+
+/**
+ * @brief Measure both sensors with overlapped conversions
+ *
+ * Each sensor is read as soon as its conversion is done and triggered
+ * again at once, so it converts while the other one is waited for, read
+ * and compensated. A pair then takes the longer of the two conversion times
+ * plus two readouts instead of the sum of both. The first call triggers
+ * both sensors and waits a full conversion.
+ * @param pair Pair context
+ * @return Results and trigger ticks, a sensor that could not be triggered
+ * reports BMP280_RESULT_BUS_ERROR
+ */
+struct BMP280_PairSample BMP280_PairMeasure(struct BMP280_Pair *pair);
+
+/**
+ * @brief Throughput of the pair against the conversion time limits
+ * @param pair Pair context
+ * @param report Filled with counters and rates
+ */
+void BMP280_PairReportGet(const struct BMP280_Pair *pair,
+                          struct BMP280_PairReport *report);
@@ -0,0 +1,244 @@
+/**
+ * @file BMP280_STM32.h
+ * @brief BMP280 driver transports over STM32 HAL I2C and SPI
+ */
+
+#pragma once
+
+#include "BMP280.h"
+#include "stm32f1xx_hal.h"
+
+/**
+ * @brief HAL I2C transport, dev->bus is the I2C_HandleTypeDef
+ *
+ * Transfers run with deadlines, retries and bus recovery, see "Bus fault
+ * handling". Delays and ticks come from FreeRTOS once the scheduler runs,
+ * from HAL_Delay()/HAL_GetTick() before.
+ */
+extern const struct BMP280_Transport BMP280_TransportI2C;
+
+#ifdef HAL_SPI_MODULE_ENABLED
+/**
+ * @brief HAL SPI transport in polling mode, dev->bus is the
+ * SPI_HandleTypeDef, chip select is dev->csPort/csPin
+ */
+extern const struct BMP280_Transport BMP280_TransportSPI;
+#endif
+
+/**
+ * @brief Initialize sensor connected over I2C with chosen settings
+ *
+ * Sets up BMP280_TransportI2C and runs BMP280_Init(). Takes about 3 ms at
+ * 400 kHz.
+ * @param dev Sensor context to be filled
+ * @param osrs_t Temperature oversampling setting
+ * @param osrs_p Pressure oversampling setting
+ * @param acq_mode Acquisition mode setting
+ * @param t_sb Standby time setting
+ * @param filter_tc Sensor IIR Filter time constant setting
+ * @param i2c_handle Desired MCU I2C peripheral for communication with sensor
+ * @param device_address I2C device address
+ * @return Configuration status\n
+ * false == unsuccessful\n
+ * true == successful
+ */
+bool BMP280_Init_I2C(struct BMP280_Device *dev,
+                     uint8_t osrs_t,
+                     uint8_t osrs_p,
+                     uint8_t acq_mode,
+                     uint8_t t_sb,
+                     uint8_t filter_tc,
+                     I2C_HandleTypeDef *i2c_handle,
+                     uint8_t device_address);
+
+#ifdef HAL_SPI_MODULE_ENABLED
+/**
+ * @brief Initialize sensor connected over SPI with chosen settings
+ *
+ * Same sequence as BMP280_Init_I2C(). The SPI peripheral has to be set up
+ * as master, 8-bit, MSB first, mode 0 or 3, at most 10 MHz, with software
+ * chip select driven through cs_port/cs_pin (configured as output, high).
+ * A peripheral set to SPI_DIRECTION_1LINE runs the sensor in 3-wire mode
+ * (BMP280_VAL_CTRL_SPI3W_EN), otherwise 4-wire. Register functions of the
+ * driver, including the ones with _I2C suffix, then run over SPI in polling
+ * mode, a 10-byte burst takes about 10 us. BMP280_MeasureStart_DMA() needs
+ * 4-wire mode.
+ * @param dev Sensor context to be filled
+ * @param osrs_t Temperature oversampling setting
+ * @param osrs_p Pressure oversampling setting
+ * @param acq_mode Acquisition mode setting
+ * @param t_sb Standby time setting
+ * @param filter_tc Sensor IIR Filter time constant setting
+ * @param spi_handle MCU SPI peripheral for communication with sensor
+ * @param cs_port Chip select GPIO port
+ * @param cs_pin Chip select GPIO pin
+ * @return Configuration status\n
+ * false == unsuccessful\n
+ * true == successful
+ */
+bool BMP280_Init_SPI(struct BMP280_Device *dev,
+                     uint8_t osrs_t,
+                     uint8_t osrs_p,
+                     uint8_t acq_mode,
+                     uint8_t t_sb,
+                     uint8_t filter_tc,
+                     SPI_HandleTypeDef *spi_handle,
+                     GPIO_TypeDef *cs_port,
+                     uint16_t cs_pin);
+#endif
+
+/**
+ * @brief Initialize sensor, reusing calibration stored in flash
+ *
+ * When the snapshot in slot was taken with the same device address and
+ * settings and the sensor still holds its ID and configuration (MCU reset
+ * or wake without sensor power loss), calibration comes from flash after
+ * two short reads. Otherwise BMP280_Init_I2C() runs and a new snapshot is
+ * stored, see BMP280_Snapshot.h.
+ * @param dev Sensor context to be filled
+ * @param osrs_t Temperature oversampling setting
+ * @param osrs_p Pressure oversampling setting
+ * @param acq_mode Acquisition mode setting
+ * @param t_sb Standby time setting
+ * @param filter_tc Sensor IIR Filter time constant setting
+ * @param i2c_handle Desired MCU I2C peripheral for communication with sensor
+ * @param device_address I2C device address
+ * @param slot Snapshot slot of this sensor, below BMP280_SNAPSHOT_SLOTS
+ * @return Configuration status\n
+ * false == unsuccessful\n
+ * true == successful
+ */
+bool BMP280_InitWarm_I2C(struct BMP280_Device *dev,
+                         uint8_t osrs_t,
+                         uint8_t osrs_p,
+                         uint8_t acq_mode,
+                         uint8_t t_sb,
+                         uint8_t filter_tc,
+                         I2C_HandleTypeDef *i2c_handle,
+                         uint8_t device_address,
+                         uint8_t slot);
+
+/**
+ * @brief Start non-blocking readout of measurement data with DMA
+ *
+ * A single register burst is transferred (see BMP280_BURST_READ), the
+ * STATUS register is not polled. In normal mode the data registers are
+ * shadowed, so the burst is always consistent; in forced mode start the
+ * readout after the conversion has finished.
+ * @param dev Initialized sensor context
+ * @return Start status\n
+ * false == bus busy or transfer not started\n
+ * true == transfer running
+ */
+bool BMP280_MeasureStart_DMA(struct BMP280_Device *dev);
+
+/**
+ * @brief Check progress of readout started with BMP280_MeasureStart_DMA()
+ *
+ * A readout still running after its deadline is aborted with bus recovery
+ * and reported as BMP280_ASYNC_ERROR.
+ * @param dev Sensor context
+ * @return Current readout state
+ */
+BMP280_AsyncState BMP280_MeasurePoll_DMA(struct BMP280_Device *dev);
+
+/**
+ * @brief Compensate data received by finished DMA readout in fixed point
+ * @param dev Sensor context with readout in BMP280_ASYNC_DONE state
+ * @return Measurement values and status flags, see BMP280_MeasureInt_I2C();
+ * BMP280_RESULT_BUS_ERROR if readout failed or is not finished
+ */
+struct BMP280_ResultInt
+BMP280_MeasureCompleteInt_DMA(struct BMP280_Device *dev);
+
+/**
+ * @brief Compensate data received by finished DMA readout
+ * @param dev Sensor context with readout in BMP280_ASYNC_DONE state
+ * @return Measurement values, zeros if readout failed or is not finished
+ */
+struct BMP280_Result BMP280_MeasureComplete_DMA(struct BMP280_Device *dev);
+
+/**
+ * @brief Driver hook for HAL_I2C_MemRxCpltCallback(), call it from there
+ * @param hi2c I2C handle passed by HAL
+ */
+void BMP280_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c);
+
+/**
+ * @brief Driver hook for HAL_I2C_MemTxCpltCallback(), call it from there
+ * @param hi2c I2C handle passed by HAL
+ */
+void BMP280_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c);
+
+/**
+ * @brief Driver hook for HAL_I2C_ErrorCallback(), call it from there
+ * @param hi2c I2C handle passed by HAL
+ */
+void BMP280_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c);
+
+#ifdef HAL_SPI_MODULE_ENABLED
+/**
+ * @brief Driver hook for HAL_SPI_TxRxCpltCallback(), call it from there
+ * @param hspi SPI handle passed by HAL
+ */
+void BMP280_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi);
+
+/**
+ * @brief Driver hook for HAL_SPI_ErrorCallback(), call it from there
+ * @param hspi SPI handle passed by HAL
+ */
+void BMP280_SPI_ErrorCallback(SPI_HandleTypeDef *hspi);
+#endif
+
+/**
+ * \name Maximum number of DMA readouts in flight, one per I2C peripheral
+ */
+#define BMP280_ASYNC_MAX_TRANSFERS 2
+
+/**
+ * \name RTOS integration settings
+ *
+ * With BMP280_RTOS enabled, waits for conversion put the calling FreeRTOS
+ * task to sleep instead of spinning in HAL_Delay(). BMP280_I2C_IT
+ * additionally makes blocking driver calls start interrupt transfers and
+ * sleep on the task notification value until the I2C event/error interrupt
+ * wakes the task; it requires BMP280_RTOS. Before the scheduler starts the
+ * driver falls back to polling. A blocking call on a bus which has a DMA
+ * readout or interrupt transfer of another device in flight is not queued,
+ * it fails at once with BMP280_BUSY.
+ *
+ * A 10-byte readout at 400 kHz keeps the bus for 297.5 us (Tools/BMP280SpiSim).
+ * Polling spins the CPU for all of it; estimated for interrupt mode: about
+ * 15 event interrupts of 150 to 250 cycles each, 30 to 50 us of CPU at
+ * 72 MHz, and the task runs again some 5 us after the last byte.
+ */
+//@{
+#define BMP280_RTOS true   /**< Sleep through FreeRTOS when possible */
+#define BMP280_I2C_IT true /**< Interrupt transfers with task notification */
+//@}
+
+/**
+ * \name SPI transport, built when the HAL SPI module is enabled
+ */
+//@{
+#define BMP280_SPI_READ 0x80       /**< Register address bit selecting read */
+#define BMP280_SPI_TIMEOUT_MS 2    /**< Polling transfer limit */
+#define BMP280_SPI_WRITE_MAX 7     /**< Longest register write burst */
+//@}
+
+/**
+ * \name Bus fault handling
+ *
+ * A transfer not finished within its deadline, a bus or arbitration error,
+ * or a BUSY flag stuck while the bus is idle (STM32F1 I2C analog filter
+ * erratum) triggers recovery: the peripheral is released, SCL is clocked
+ * until the slave lets SDA go, a STOP condition is generated and the
+ * peripheral is reset and initialized again.
+ */
+//@{
+#define BMP280_I2C_RETRIES 2 /**< Attempts after the first failed one */
+/** Deadline reserve above bus time, covers tick granularity */
+#define BMP280_I2C_TIMEOUT_MARGIN_MS 2
+/** SCL pulses to free a slave stuck in the middle of a byte */
+#define BMP280_I2C_RECOVERY_PULSES 9
+//@}
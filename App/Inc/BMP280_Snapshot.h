@@ -0,0 +1,62 @@
+/**
+ * @file BMP280_Snapshot.h
+ * @brief Sensor calibration and configuration kept in flash for warm boot
+ */
+
+#pragma once
+
+#include "BMP280_Compensation.h"
+#include "stm32f1xx_hal.h"
+#include <stdbool.h>
+
+/**
+ * \name Snapshot storage
+ *
+ * Last 1 KB page of 64 KB flash, excluded from the FLASH region in
+ * STM32F103C8TX_FLASH.ld. Storing a record erases the whole page, all slots
+ * are written again.
+ */
+//@{
+#define BMP280_SNAPSHOT_ADDRESS 0x0800FC00U /**< Reserved flash page */
+#define BMP280_SNAPSHOT_PAGE_SIZE 1024U     /**< Flash page size */
+#define BMP280_SNAPSHOT_SLOTS 4             /**< Records, one per sensor */
+/** Valid record marker, change together with record layout */
+#define BMP280_SNAPSHOT_MAGIC 0x42503201U
+//@}
+
+/**
+ * @brief Flash record of one initialized sensor
+ */
+typedef struct BMP280_Snapshot {
+  uint32_t magic;                  /**< BMP280_SNAPSHOT_MAGIC */
+  uint8_t chipId;                  /**< ID register value */
+  uint8_t deviceAddress;           /**< I2C device address */
+  uint8_t ctrlMeas;                /**< CTRL_MEAS as configured */
+  uint8_t config;                  /**< CONFIG as configured */
+  struct BMP280_Calibration calib; /**< Calibration constants */
+  uint32_t crc;                    /**< CRC-32 of preceding fields */
+} BMP280_Snapshot;
+
+/**
+ * @brief Read snapshot record from flash
+ * @param slot Record index, below BMP280_SNAPSHOT_SLOTS
+ * @param snapshot Record copy
+ * @return Record status\n
+ * false == slot never written, erased or corrupted\n
+ * true == magic and CRC valid
+ */
+bool BMP280_SnapshotLoad(uint8_t slot, struct BMP280_Snapshot *snapshot);
+
+/**
+ * @brief Write snapshot record to flash
+ *
+ * magic and crc are filled in. Nothing is written when the slot already
+ * holds the same record, otherwise the page is erased and programmed again,
+ * which stalls flash access for about 20-40 ms.
+ * @param slot Record index, below BMP280_SNAPSHOT_SLOTS
+ * @param snapshot Record to store
+ * @return Write status\n
+ * false == invalid slot, erase or programming failed\n
+ * true == record stored
+ */
+bool BMP280_SnapshotStore(uint8_t slot, struct BMP280_Snapshot *snapshot);
@@ -0,0 +1,91 @@
+/**
+ * @file Profiler.h
+ * @brief DWT cycle counter probes with per-probe statistics
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * \name Profiling
+ */
+//@{
+#define PROFILER_ENABLED false /**< DWT probes, compiled out when false */
+                               //@}
+
+/**
+ * @brief Probe identifiers, index to statistics table
+ */
+typedef enum Profiler_Probe {
+  PROFILER_BMP280_READOUT = 0, /**< BMP280_RawDataRead_I2C() */
+  PROFILER_BMP280_TEMPERATURE, /**< Temperature compensation */
+  PROFILER_BMP280_PRESSURE,    /**< Pressure compensation */
+  PROFILER_STATUS_MEASURE,     /**< Whole measurement in vStatusTask */
+  PROFILER_STATUS_PRINTF,      /**< Result printf in vStatusTask */
+  PROFILER_USART2_MUTEX,       /**< USART2TxMutex held by vStatusTask */
+  PROFILER_STATUS_INIT,        /**< Sensor initialization in vStatusTask */
+  PROFILER_ALTITUDE_FIXED,     /**< BMP280_AltitudeInt() in vStatusTask */
+  PROFILER_ALTITUDE_FLOAT,     /**< BMP280_AltitudeFloat() in vStatusTask */
+  PROFILER_STATUS_MEDIAN,      /**< BMP280_MedianPush() in vStatusTask */
+  PROFILER_PROBE_COUNT
+} Profiler_Probe;
+
+/**
+ * @brief Statistics of one probe, in CPU cycles
+ */
+typedef struct Profiler_Stats {
+  uint32_t count; /**< Number of recorded runs */
+  uint32_t min;   /**< Shortest run */
+  uint32_t max;   /**< Longest run */
+  uint64_t total; /**< Sum of all runs, mean = total / count */
+} Profiler_Stats;
+
+#if PROFILER_ENABLED
+
+/**
+ * DWT->CYCCNT, at the same address on every Cortex-M3. Probes go into
+ * HAL-free code such as the driver core, so the header does not include
+ * the device header; Profiler.c does.
+ */
+#define PROFILER_CYCCNT (*(volatile const uint32_t *)0xE0001004UL)
+
+/**
+ * @brief Start DWT cycle counter and clear statistics
+ */
+void Profiler_Init(void);
+
+/**
+ * @brief Clear statistics of all probes
+ */
+void Profiler_Reset(void);
+
+/**
+ * @brief Add one run to probe statistics
+ * @param probe Probe identifier
+ * @param cycles Cycles between PROFILER_BEGIN and PROFILER_END
+ */
+void Profiler_Record(Profiler_Probe probe, uint32_t cycles);
+
+/**
+ * @brief Print statistics table with printf (USART2), caller has to own
+ * USART2TxMutex
+ */
+void Profiler_Dump(void);
+
+/** Open probe, has to be closed by PROFILER_END in the same block */
+#define PROFILER_BEGIN(probe) uint32_t profilerStart_##probe = PROFILER_CYCCNT
+/** Close probe and record its run */
+#define PROFILER_END(probe)                                                    \
+  Profiler_Record(probe, PROFILER_CYCCNT - profilerStart_##probe)
+
+#else
+
+#define Profiler_Init() ((void)0)
+#define Profiler_Reset() ((void)0)
+#define Profiler_Dump() ((void)0)
+#define PROFILER_BEGIN(probe)
+#define PROFILER_END(probe)
+
+#endif
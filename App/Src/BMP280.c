@@ -7,59 +7,108 @@
  */
 
 #include "BMP280.h"
+#include "Profiler.h"
 
-static int32_t rawTemperature, rawPressure;
+#include <stdlib.h>
 
-static struct BMP280_Result result;
+/** Standby time of CONFIG t_sb settings in microseconds */
+static const uint32_t standbyTime_us[8] = {500,    62500,   125000,  250000,
+                                           500000, 1000000, 2000000, 4000000};
 
-static const struct BMP280_Result noResult = {0.0, 0.0};
+static inline BMP280_Status BMP280_RawDataRead_I2C(struct BMP280_Device *dev);
 
-static uint16_t dig_T1, dig_P1;
-static int16_t dig_T2, dig_T3, dig_P2, dig_P3, dig_P4, dig_P5, dig_P6, dig_P7,
-    dig_P8, dig_P9;
+static inline BMP280_Status BMP280_RawDataParse(struct BMP280_Device *dev,
+                                                const uint8_t *RawData);
 
-static inline HAL_StatusTypeDef
-BMP280_RawDataRead_I2C(I2C_HandleTypeDef i2c_handle, uint8_t device_address);
+static struct BMP280_ResultInt BMP280_Compensate(struct BMP280_Device *dev);
 
-static inline int32_t BMP280_calculate_T_int32(int32_t adc_T);
+static struct BMP280_ResultInt
+BMP280_ResultFromStatus(struct BMP280_Device *dev, BMP280_Status status);
 
-#if RETURN_64BIT
-static inline uint32_t BMP280_calculate_P_int64(int32_t adc_P);
-#elif RETURN_32BIT
-static inline uint32_t BMP280_calculate_P_int32(int32_t adc_P);
+static BMP280_Status BMP280_MemRead(struct BMP280_Device *dev,
+                                    uint8_t reg,
+                                    uint8_t *data,
+                                    uint16_t size);
+
+static BMP280_Status BMP280_MemWrite(struct BMP280_Device *dev,
+                                     uint8_t reg,
+                                     const uint8_t *data,
+                                     uint16_t size);
+
+static inline uint32_t BMP280_OversamplingCount(uint8_t osrs);
+
+static void BMP280_Sleep_ms(struct BMP280_Device *dev, uint32_t ms);
+
+static void BMP280_SleepUntil(struct BMP280_Device *dev, uint32_t tick);
+
+static inline uint32_t BMP280_Tick(const struct BMP280_Device *dev);
+
+static inline uint32_t BMP280_Now_us(const struct BMP280_Device *dev);
+
+static bool BMP280_NormalPhase(struct BMP280_Device *dev, uint32_t produced);
+
+static BMP280_Status BMP280_ConversionWait(struct BMP280_Device *dev);
+
+#if BMP280_BURST_READ
+static inline BMP280_Status BMP280_BurstCheck(struct BMP280_Device *dev,
+                                              const uint8_t *RawData);
 #endif
 
+static BMP280_Status BMP280_ConfigWrite(struct BMP280_Device *dev,
+                                        uint8_t ctrlMeas,
+                                        uint8_t config);
+
+static bool BMP280_ConfigMatches(uint8_t ctrlMeas,
+                                 uint8_t config,
+                                 const uint8_t *registers);
+
+static void BMP280_DeviceSetup(struct BMP280_Device *dev,
+                               uint8_t osrs_t,
+                               uint8_t osrs_p,
+                               uint8_t acq_mode,
+                               uint8_t t_sb,
+                               uint8_t filter_tc);
+
+static bool BMP280_Configure(struct BMP280_Device *dev);
+
 /**
  * Read constants used for temperature and pressure calculations from
  * sensor's memory
  */
 //@{
-void BMP280_CalibrationConstantsRead_I2C(I2C_HandleTypeDef i2c_handle,
-                                         uint8_t device_address) {
+BMP280_Status BMP280_CalibrationConstantsRead_I2C(struct BMP280_Device *dev) {
+  struct BMP280_Calibration *calib = &dev->calib;
   uint8_t calibrationConstantsRaw[26];
+  BMP280_Status status;
 
-  HAL_I2C_Mem_Read(&i2c_handle,
-                   device_address,
-                   BMP280_REG_CALIB00,
-                   1,
-                   calibrationConstantsRaw,
-                   26,
-                   HAL_MAX_DELAY);
-
-  dig_T1 = calibrationConstantsRaw[0] | calibrationConstantsRaw[1] << 8;
-  dig_T2 = calibrationConstantsRaw[2] | calibrationConstantsRaw[3] << 8;
-  dig_T3 = calibrationConstantsRaw[4] | calibrationConstantsRaw[5] << 8;
-
-  dig_P1 = calibrationConstantsRaw[6] | calibrationConstantsRaw[7] << 8;
-  dig_P2 = calibrationConstantsRaw[8] | calibrationConstantsRaw[9] << 8;
-  dig_P3 = calibrationConstantsRaw[10] | calibrationConstantsRaw[11] << 8;
-  dig_P4 = calibrationConstantsRaw[12] | calibrationConstantsRaw[13] << 8;
-  dig_P5 = calibrationConstantsRaw[14] | calibrationConstantsRaw[15] << 8;
-  dig_P6 = calibrationConstantsRaw[16] | calibrationConstantsRaw[17] << 8;
-  dig_P7 = calibrationConstantsRaw[18] | calibrationConstantsRaw[19] << 8;
-  dig_P8 = calibrationConstantsRaw[20] | calibrationConstantsRaw[21] << 8;
-  dig_P9 = calibrationConstantsRaw[22] | calibrationConstantsRaw[23] << 8;
+  status = BMP280_MemRead(dev, BMP280_REG_CALIB00, calibrationConstantsRaw, 26);
+  if (status != BMP280_OK) {
+    return status; // keep calibration held before
+  }
 
+  calib->dig_T1 = calibrationConstantsRaw[0] | calibrationConstantsRaw[1] << 8;
+  calib->dig_T2 = calibrationConstantsRaw[2] | calibrationConstantsRaw[3] << 8;
+  calib->dig_T3 = calibrationConstantsRaw[4] | calibrationConstantsRaw[5] << 8;
+
+  calib->dig_P1 = calibrationConstantsRaw[6] | calibrationConstantsRaw[7] << 8;
+  calib->dig_P2 = calibrationConstantsRaw[8] | calibrationConstantsRaw[9] << 8;
+  calib->dig_P3 =
+      calibrationConstantsRaw[10] | calibrationConstantsRaw[11] << 8;
+  calib->dig_P4 =
+      calibrationConstantsRaw[12] | calibrationConstantsRaw[13] << 8;
+  calib->dig_P5 =
+      calibrationConstantsRaw[14] | calibrationConstantsRaw[15] << 8;
+  calib->dig_P6 =
+      calibrationConstantsRaw[16] | calibrationConstantsRaw[17] << 8;
+  calib->dig_P7 =
+      calibrationConstantsRaw[18] | calibrationConstantsRaw[19] << 8;
+  calib->dig_P8 =
+      calibrationConstantsRaw[20] | calibrationConstantsRaw[21] << 8;
+  calib->dig_P9 =
+      calibrationConstantsRaw[22] | calibrationConstantsRaw[23] << 8;
+
+  BMP280_CalibrationDerive(calib, &dev->derived);
+  return BMP280_OK;
 } //@}
 
 /**
@@ -67,267 +116,754 @@ void BMP280_CalibrationConstantsRead_I2C(I2C_HandleTypeDef i2c_handle,
  * write oversampling, acquisition mode, readout timing and filter data to the
  * sensor
  */
-//@{
-bool BMP280_Init_I2C(uint8_t osrs_t,
-                     uint8_t osrs_p,
-                     uint8_t acq_mode,
-                     uint8_t t_sb,
-                     uint8_t filter_tc,
-                     I2C_HandleTypeDef i2c_handle,
-                     uint8_t device_address) {
+bool BMP280_Init(struct BMP280_Device *dev,
+                 uint8_t osrs_t,
+                 uint8_t osrs_p,
+                 uint8_t acq_mode,
+                 uint8_t t_sb,
+                 uint8_t filter_tc) {
+  BMP280_DeviceSetup(dev, osrs_t, osrs_p, acq_mode, t_sb, filter_tc);
+
+  return BMP280_Configure(dev);
+}
+
+/**
+ * Sensor part of initialization, transport of dev is set up
+ */
+static bool BMP280_Configure(struct BMP280_Device *dev) {
   uint8_t writeBuffer, readBuffer; // Variables used for applying changes to
                                    // selected bits in device registers */
-  HAL_StatusTypeDef status;
+  uint8_t registers[2];            // CTRL_MEAS, CONFIG
+  uint8_t config = (dev->t_sb << 5) | (dev->filter_tc << 2);
+  uint32_t resetTick;
+  bool ready = false;
+  BMP280_Status status;
 
   // Reset the device
-  writeBuffer = 0xB6;
-  status = HAL_I2C_Mem_Write(&i2c_handle,
-                             device_address,
-                             BMP280_REG_RESET,
-                             1,
-                             &writeBuffer,
-                             1,
-                             HAL_MAX_DELAY);
-  if (status != HAL_OK) {
+  writeBuffer = BMP280_VAL_RESET;
+  status = BMP280_MemWrite(dev, BMP280_REG_RESET, &writeBuffer, 1);
+  if (status != BMP280_OK) {
     return false;
   }
-  HAL_Delay(100);
-
-  // Read device ID
-  status = HAL_I2C_Mem_Read(&i2c_handle,
-                            device_address,
-                            BMP280_REG_ID,
-                            1,
-                            &readBuffer,
-                            1,
-                            HAL_MAX_DELAY);
-  if (status != HAL_OK || readBuffer != BMP280_VAL_DEVID) {
-    return false;
+
+  if (dev->threeWire) {
+    config |= BMP280_VAL_CTRL_SPI3W_EN;
+  }
+
+  // Wait until NVM is copied and device ID is valid, sensor may not respond
+  // until it restarts. Reset returns SPI to 4-wire mode, in 3-wire mode
+  // nothing can be read before the mode is written again. Polled once per
+  // tick: every NACKed poll goes through the retry and bus recovery path.
+  resetTick = BMP280_Tick(dev);
+  while (true) {
+    if (config & BMP280_VAL_CTRL_SPI3W_EN) {
+      writeBuffer = BMP280_VAL_CTRL_SPI3W_EN;
+      (void)BMP280_MemWrite(dev, BMP280_REG_CONFIG, &writeBuffer, 1);
+    }
+    status = BMP280_MemRead(dev, BMP280_REG_STATUS, &readBuffer, 1);
+    if (status == BMP280_OK && !(readBuffer & BMP280_VAL_STATUS_IM_UPDATE)) {
+      status = BMP280_MemRead(dev, BMP280_REG_ID, &readBuffer, 1);
+      ready = status == BMP280_OK && readBuffer == BMP280_VAL_DEVID;
+    }
+    if (ready) {
+      break;
+    }
+    if (BMP280_Tick(dev) - resetTick > BMP280_RESET_TIMEOUT_MS) {
+      return false;
+    }
+    dev->transport->delay_ms(dev, 1);
   }
 
-  // Read calibration constants
-  BMP280_CalibrationConstantsRead_I2C(i2c_handle, device_address);
-
-  // Write timing and IIR data to config register
-  writeBuffer = (t_sb << 5) | (filter_tc << 2);
-  status = HAL_I2C_Mem_Write(&i2c_handle,
-                             device_address,
-                             BMP280_REG_CONFIG,
-                             1,
-                             &writeBuffer,
-                             1,
-                             HAL_MAX_DELAY);
-  status = HAL_I2C_Mem_Read(&i2c_handle,
-                            device_address,
-                            BMP280_REG_CONFIG,
-                            1,
-                            &readBuffer,
-                            1,
-                            HAL_MAX_DELAY);
-  if (readBuffer != writeBuffer || status != HAL_OK) {
+  // Read calibration constants, without them no result can be compensated
+  if (BMP280_CalibrationConstantsRead_I2C(dev) != BMP280_OK) {
     return false;
   }
 
-  // Write oversampling and mode data to ctrl_meas register
-  writeBuffer = (osrs_t << 5) | (osrs_p << 2) | (acq_mode << 0);
-  status = HAL_I2C_Mem_Write(&i2c_handle,
-                             device_address,
-                             BMP280_REG_CTRL_MEAS,
-                             1,
-                             &writeBuffer,
-                             1,
-                             HAL_MAX_DELAY);
-  status = HAL_I2C_Mem_Read(&i2c_handle,
-                            device_address,
-                            BMP280_REG_CTRL_MEAS,
-                            1,
-                            &readBuffer,
-                            1,
-                            HAL_MAX_DELAY);
-  if (readBuffer != writeBuffer || status != HAL_OK) {
+  // Write timing and IIR data to config register and oversampling and mode
+  // data to ctrl_meas register, then read both back
+  status = BMP280_ConfigWrite(
+      dev, (dev->osrs_t << 5) | (dev->osrs_p << 2) | (dev->acq_mode << 0),
+      config);
+  if (status != BMP280_OK) {
+    return false;
+  }
+  // a forced conversion may already be over and the sensor back to sleep
+  status = BMP280_MemRead(dev, BMP280_REG_CTRL_MEAS, registers, 2);
+  if (status != BMP280_OK ||
+      !BMP280_ConfigMatches(dev->ctrlMeas, dev->config, registers)) {
     return false;
   }
 
+  BMP280_NormalScheduleStart(dev);
   return true;
-} //@}
+}
 
 /**
- * Wake sensor by writing MEASURE_MODE_FORCED bit to CTRL_MEAS register
+ * Nothing is written, a sensor which lost its configuration is left to
+ * BMP280_Init()
  */
-bool BMP280_Wake_I2C(I2C_HandleTypeDef i2c_handle, uint8_t device_address) {
-  uint8_t buffer; // Helper variable, used to prevent overwriting other data in
-                  // CTRL_MEAS register
-  HAL_StatusTypeDef status;
-
-  // Read device ID
-  status = HAL_I2C_Mem_Read(
-      &i2c_handle, device_address, BMP280_REG_ID, 1, &buffer, 1, HAL_MAX_DELAY);
-  if (status != HAL_OK || buffer != 0x58) {
+bool BMP280_Resume(struct BMP280_Device *dev,
+                   uint8_t osrs_t,
+                   uint8_t osrs_p,
+                   uint8_t acq_mode,
+                   uint8_t t_sb,
+                   uint8_t filter_tc,
+                   const struct BMP280_Calibration *calib) {
+  uint8_t ctrlMeas = (osrs_t << 5) | (osrs_p << 2) | (acq_mode << 0);
+  uint8_t config = (t_sb << 5) | (filter_tc << 2);
+  uint8_t id;
+  uint8_t registers[2]; // CTRL_MEAS, CONFIG
+
+  BMP280_DeviceSetup(dev, osrs_t, osrs_p, acq_mode, t_sb, filter_tc);
+  if (dev->threeWire) {
+    config |= BMP280_VAL_CTRL_SPI3W_EN;
+  }
+  if (BMP280_MemRead(dev, BMP280_REG_ID, &id, 1) != BMP280_OK ||
+      id != BMP280_VAL_DEVID ||
+      BMP280_MemRead(dev, BMP280_REG_CTRL_MEAS, registers, 2) != BMP280_OK ||
+      !BMP280_ConfigMatches(ctrlMeas, config, registers)) {
     return false;
   }
 
-  status = HAL_I2C_Mem_Read(&i2c_handle,
-                            device_address,
-                            BMP280_REG_CTRL_MEAS,
-                            1,
-                            &buffer,
-                            1,
-                            HAL_MAX_DELAY);
-  if (status != HAL_OK) {
-    return false;
+  dev->calib = *calib;
+  BMP280_CalibrationDerive(&dev->calib, &dev->derived);
+  dev->ctrlMeas = ctrlMeas;
+  dev->config = config;
+  BMP280_NormalScheduleStart(dev);
+  return true;
+}
+
+/**
+ * Fill driver context, transport fields are kept, sensor is not accessed
+ */
+static void BMP280_DeviceSetup(struct BMP280_Device *dev,
+                               uint8_t osrs_t,
+                               uint8_t osrs_p,
+                               uint8_t acq_mode,
+                               uint8_t t_sb,
+                               uint8_t filter_tc) {
+  dev->osrs_t = osrs_t;
+  dev->osrs_p = osrs_p;
+  dev->acq_mode = acq_mode;
+  dev->t_sb = t_sb;
+  dev->filter_tc = filter_tc;
+  dev->t_fine = 0;
+  dev->waitingTask = NULL;
+  dev->asyncState = BMP280_ASYNC_IDLE;
+  dev->conversionPending = false;
+  dev->samplePeriod_ms = 0;
+  dev->nextSampleTick = 0;
+  dev->healthPeriod_ms = 0;
+  dev->nextHealthTick = 0;
+  dev->stats = (struct BMP280_Stats){0};
+}
+
+/**
+ * Compare CTRL_MEAS and CONFIG read from the sensor with configured values.
+ * Mode bits are compared in normal mode only, a forced conversion returns to
+ * sleep by itself. Reserved CONFIG bit 1 is ignored.
+ */
+static bool BMP280_ConfigMatches(uint8_t ctrlMeas,
+                                 uint8_t config,
+                                 const uint8_t *registers) {
+  uint8_t modeMask = BMP280_VAL_CTRL_MEAS_MODE_NORMAL;
+
+  if ((ctrlMeas & modeMask) == BMP280_VAL_CTRL_MEAS_MODE_NORMAL) {
+    modeMask = 0;
+  }
+  return (registers[0] & ~modeMask) == (ctrlMeas & ~modeMask) &&
+         (registers[1] & 0xFD) == config;
+}
+
+/**
+ * Wake sensor by writing MEASURE_MODE_FORCED bits to CTRL_MEAS register,
+ * other bits come from the copy of the register. The copy keeps the
+ * configured mode, the trigger is not stored. A sensor configured for
+ * normal mode converts on its own and is left running.
+ */
+bool BMP280_Wake_I2C(struct BMP280_Device *dev) {
+  uint8_t ctrlMeas = (dev->ctrlMeas & ~BMP280_VAL_CTRL_MEAS_MODE_NORMAL) |
+                     BMP280_VAL_CTRL_MEAS_MODE_FORCED;
+
+  if (dev->healthPeriod_ms != 0 &&
+      (int32_t)(BMP280_Tick(dev) - dev->nextHealthTick) >= 0) {
+    dev->nextHealthTick = BMP280_Tick(dev) + dev->healthPeriod_ms;
+    if (!BMP280_HealthCheck_I2C(dev)) {
+      return false;
+    }
   }
 
-  buffer |= BMP280_VAL_CTRL_MEAS_MODE_FORCED;
+  if ((dev->ctrlMeas & BMP280_VAL_CTRL_MEAS_MODE_NORMAL) ==
+      BMP280_VAL_CTRL_MEAS_MODE_NORMAL) {
+    return true;
+  }
 
-  status = HAL_I2C_Mem_Write(&i2c_handle,
-                             device_address,
-                             BMP280_REG_CTRL_MEAS,
-                             1,
-                             &buffer,
-                             1,
-                             HAL_MAX_DELAY);
-  if (status != HAL_OK) {
+  if (BMP280_MemWrite(dev, BMP280_REG_CTRL_MEAS, &ctrlMeas, 1) != BMP280_OK) {
     return false;
   }
 
+  dev->conversionStart = BMP280_Tick(dev);
+  dev->conversionPending = true;
+
   return true;
 }
 
-struct BMP280_Result BMP280_Measure_I2C(I2C_HandleTypeDef i2c_handle,
-                                        uint8_t device_address) {
+bool BMP280_HealthCheck_I2C(struct BMP280_Device *dev) {
+  uint8_t id;
+  uint8_t registers[2]; // CTRL_MEAS, CONFIG
+  uint8_t ctrlMeas = dev->ctrlMeas;
 
-  if (BMP280_RawDataRead_I2C(i2c_handle, device_address) == HAL_OK) {
-    if (rawTemperature == 0x80000) {
-      result.Temperature = 0; // value in case temp measurement was disabled
+  if (BMP280_MemRead(dev, BMP280_REG_ID, &id, 1) != BMP280_OK ||
+      id != BMP280_VAL_DEVID) {
+    return false;
+  }
+
+  if (BMP280_MemRead(dev, BMP280_REG_CTRL_MEAS, registers, 2) != BMP280_OK) {
+    return false;
+  }
+
+  if (BMP280_ConfigMatches(dev->ctrlMeas, dev->config, registers)) {
+    return true;
+  }
+
+  // Outside normal mode the sensor is left asleep, the next wake starts a
+  // conversion
+  ++dev->stats.configMismatches;
+  if ((ctrlMeas & BMP280_VAL_CTRL_MEAS_MODE_NORMAL) !=
+      BMP280_VAL_CTRL_MEAS_MODE_NORMAL) {
+    ctrlMeas &= ~BMP280_VAL_CTRL_MEAS_MODE_NORMAL;
+  }
+  return BMP280_ConfigWrite(dev, ctrlMeas, dev->config) == BMP280_OK;
+}
+
+void BMP280_HealthPeriodSet(struct BMP280_Device *dev, uint32_t period_ms) {
+  dev->healthPeriod_ms = period_ms;
+  dev->nextHealthTick = BMP280_Tick(dev);
+}
+
+uint32_t BMP280_MeasurementTimeTypical_us(const struct BMP280_Device *dev) {
+  uint32_t osT = BMP280_OversamplingCount(dev->osrs_t);
+  uint32_t osP = BMP280_OversamplingCount(dev->osrs_p);
+
+  return 1000 + 2000 * osT + (osP ? 2000 * osP + 500 : 0);
+}
+
+uint32_t BMP280_MeasurementTimeMax_us(const struct BMP280_Device *dev) {
+  uint32_t osT = BMP280_OversamplingCount(dev->osrs_t);
+  uint32_t osP = BMP280_OversamplingCount(dev->osrs_p);
+
+  return 1250 + 2300 * osT + (osP ? 2300 * osP + 575 : 0);
+}
+
+uint32_t BMP280_NormalPeriod_us(const struct BMP280_Device *dev) {
+  return BMP280_MeasurementTimeTypical_us(dev) + standbyTime_us[dev->t_sb & 7];
+}
+
+/**
+ * Before the first read the phase is unknown: the first read goes out at
+ * once, the second half a period later, so that no sample can be skipped
+ * whatever the period error.
+ */
+void BMP280_NormalScheduleStart(struct BMP280_Device *dev) {
+  struct BMP280_NormalSchedule *normal = &dev->normal;
+  uint32_t now_us = BMP280_Now_us(dev);
+
+  normal->period_us = BMP280_NormalPeriod_us(dev);
+  normal->ready_us = now_us - normal->period_us;
+  normal->readyWidth_us = normal->period_us;
+  normal->periodWidth_us = normal->period_us;
+  normal->lead_us = normal->period_us / 2;
+  normal->step_us = BMP280_NORMAL_MARGIN_US;
+  normal->sinceResync = 0;
+  normal->lastNew_us = now_us;
+  normal->next_us = now_us;
+  normal->lastSamples = dev->stats.samples;
+  normal->lastRawTemperature = -1; // raw values are 20-bit, never match
+  normal->lastRawPressure = -1;
+  normal->referenced = false;
+  normal->locked = false;
+  normal->duplicateSeen = false;
+  normal->probe = true;
+}
+
+void BMP280_NormalWait(struct BMP280_Device *dev) {
+  int32_t remaining_us = (int32_t)(dev->normal.next_us - BMP280_Now_us(dev));
+
+  if (remaining_us > 0) {
+    BMP280_SleepUntil(dev, BMP280_Tick(dev) + (remaining_us + 999) / 1000);
+  }
+}
+
+bool BMP280_NormalUpdate(struct BMP280_Device *dev) {
+  struct BMP280_NormalSchedule *normal = &dev->normal;
+  uint32_t now_us = BMP280_Now_us(dev);
+  uint32_t period_us = normal->period_us;
+  uint32_t produced = 1;
+  uint32_t predicted_us, width_us;
+
+  // failed read - try again one period later, losses show up as missed
+  if (dev->stats.samples == normal->lastSamples) {
+    normal->next_us = now_us + period_us;
+    return false;
+  }
+  normal->lastSamples = dev->stats.samples;
+
+  // same raw values - sample not ready yet, read again with growing steps.
+  // Identical values long after the last new sample are taken as new one.
+  // Only a locked read is expected to find the new sample at once.
+  if (dev->rawTemperature == normal->lastRawTemperature &&
+      dev->rawPressure == normal->lastRawPressure &&
+      now_us - normal->lastNew_us < period_us + period_us / 2) {
+    if (normal->probe) {
+      ++dev->stats.probes;
     } else {
-      result.Temperature = (BMP280_calculate_T_int32(rawTemperature)) /
-                           100.0; // as per datasheet, the temp is x100
+      ++dev->stats.duplicates;
+      normal->locked = false;
     }
+    normal->duplicateSeen = true;
+    normal->probe = true;
+    normal->lastDuplicate_us = now_us;
+    normal->next_us = now_us + normal->step_us;
+    if (normal->step_us < period_us / 4) {
+      normal->step_us *= 2;
+    }
+    return false;
+  }
+  normal->lastRawTemperature = dev->rawTemperature;
+  normal->lastRawPressure = dev->rawPressure;
+
+  // samples produced since the previous new one, whole periods since its
+  // ready time. Exact while the phase is known, also after long stalls.
+  if ((int32_t)(now_us - normal->ready_us) > (int32_t)period_us) {
+    produced = (now_us - normal->ready_us) / period_us;
+    dev->stats.missed += produced - 1;
+  }
+  normal->lastNew_us = now_us;
+  predicted_us = normal->ready_us + produced * period_us;
+
+  if (normal->duplicateSeen) {
+    // ready between last duplicate and this read, within one period. Read
+    // times are truncated to the tick, this one may be a tick later.
+    width_us = now_us - normal->lastDuplicate_us + BMP280_NORMAL_MARGIN_US;
+    if (width_us > period_us) {
+      width_us = period_us;
+    }
+    normal->ready_us = now_us + BMP280_NORMAL_MARGIN_US - width_us / 2;
+    normal->readyWidth_us = width_us;
+    normal->locked = BMP280_NormalPhase(dev, produced);
+    normal->lead_us = width_us > 2 * BMP280_NORMAL_MARGIN_US
+                          ? width_us / 2
+                          : BMP280_NORMAL_MARGIN_US;
+    normal->sinceResync = 0;
+  } else {
+    // ready by now, earlier than predicted if the read was a probe
+    if ((int32_t)(predicted_us - now_us) > 0) {
+      predicted_us = now_us;
+      if (normal->lead_us < period_us / 2) {
+        normal->lead_us *= 2;
+      }
+      normal->locked = false;
+    }
+    normal->ready_us = predicted_us;
+    normal->readyWidth_us += produced * normal->periodWidth_us;
+    normal->sinceReference += produced;
+    ++normal->sinceResync;
+  }
+  normal->duplicateSeen = false;
+  normal->step_us = BMP280_NORMAL_MARGIN_US;
+
+  // locked: read just after the latest ready time the phase and period
+  // uncertainties allow, otherwise probe ahead of the predicted ready time
+  // to catch a duplicate and measure the phase
+  period_us = normal->period_us;
+  width_us = normal->readyWidth_us + normal->periodWidth_us;
+  normal->probe = !normal->locked || width_us > period_us / 8 ||
+                  normal->sinceResync >= BMP280_NORMAL_PROBE_SAMPLES;
+  if (normal->probe) {
+    normal->next_us = normal->ready_us + period_us - normal->lead_us;
+  } else {
+    normal->next_us = normal->ready_us + period_us + width_us / 2;
+  }
+  return true;
+}
 
-    if (rawPressure == 0x80000)
-      result.Pressure = 0; // value in case temp measurement was disabled
-    else {
-#if RETURN_64BIT
-      result.Pressure = (BMP280_calculate_P_int64(rawPressure)) /
-                        256.0; // as per datasheet, the pressure is x256
+/**
+ * Ready time measured between a duplicate and a new sample: correct the
+ * period estimate with the phase error accumulated since the reference
+ * measurement, when the error exceeds the uncertainty of both. The
+ * reference is kept as long as possible, so the estimate gets more precise
+ * with every sample.
+ * @return true if the phase matched the prediction from kept reference
+ */
+static bool BMP280_NormalPhase(struct BMP280_Device *dev, uint32_t produced) {
+  struct BMP280_NormalSchedule *normal = &dev->normal;
+  uint32_t since = normal->sinceReference + produced;
+  uint32_t width_us;
+  bool match;
+
+  ++dev->stats.resyncs;
+  if (normal->referenced) {
+    int32_t drift_us = (int32_t)(normal->ready_us - normal->reference_us -
+                                 since * normal->period_us);
+
+    dev->stats.phaseDrift_us = drift_us;
+    match = (uint32_t)abs(drift_us) <=
+            (normal->readyWidth_us + normal->referenceWidth_us) / 2;
+    // a matching phase leaves the period alone, within drift of the truth
+    width_us = normal->readyWidth_us + normal->referenceWidth_us;
+    if (match) {
+      width_us += 2 * (uint32_t)abs(drift_us);
+    } else {
+      normal->period_us += drift_us / (int32_t)since;
+    }
+    normal->periodWidth_us = (width_us + since - 1) / since;
+    // keep the reference while it is not worse and far from wrapping
+    if (normal->readyWidth_us >= normal->referenceWidth_us &&
+        since * normal->period_us < BMP280_NORMAL_REFERENCE_MAX_US) {
+      normal->sinceReference = since;
+      return match;
+    }
+  }
+  normal->reference_us = normal->ready_us;
+  normal->referenceWidth_us = normal->readyWidth_us;
+  normal->sinceReference = 0;
+  normal->referenced = true;
+  return false;
+}
 
-#elif RETURN_32BIT
-      result.Pressure = (BMP280_calculate_P_int32(
-          rawPressure)); // as per datasheet, the pressure is Pa
+struct BMP280_ResultInt BMP280_MeasureNormalInt_I2C(struct BMP280_Device *dev) {
+  struct BMP280_ResultInt result;
 
-#endif
-    }
+  do {
+    BMP280_NormalWait(dev);
+    result = BMP280_MeasureInt_I2C(dev);
+  } while (!BMP280_NormalUpdate(dev) &&
+           !(result.flags & BMP280_RESULT_BUS_ERROR));
+
+  return result;
+}
+
+struct BMP280_Result BMP280_Measure_I2C(struct BMP280_Device *dev) {
+  struct BMP280_ResultInt result = BMP280_MeasureInt_I2C(dev);
+
+  return BMP280_ResultToFloat(&result);
+}
+
+struct BMP280_ResultInt BMP280_MeasureInt_I2C(struct BMP280_Device *dev) {
+  PROFILER_BEGIN(PROFILER_BMP280_READOUT);
+  BMP280_Status status = BMP280_RawDataRead_I2C(dev);
+  PROFILER_END(PROFILER_BMP280_READOUT);
+
+  return BMP280_ResultFromStatus(dev, status);
+}
+
+struct BMP280_ResultInt BMP280_ReadoutCompensate(struct BMP280_Device *dev,
+                                                 const uint8_t *data) {
+  return BMP280_ResultFromStatus(dev, BMP280_RawDataParse(dev, data));
+}
+
+/**
+ * Result of a readout with given status, compensated from the samples in
+ * device context
+ */
+static struct BMP280_ResultInt
+BMP280_ResultFromStatus(struct BMP280_Device *dev, BMP280_Status status) {
+  struct BMP280_ResultInt result;
+
+  if (status == BMP280_OK) {
+    return BMP280_Compensate(dev);
+  }
+
+  // forced conversion not finished yet - repeat previous sample
+  if (status == BMP280_BUSY && dev->stats.samples != 0) {
+    result = BMP280_Compensate(dev);
+    result.flags &= ~BMP280_RESULT_VALID;
+    result.flags |= BMP280_RESULT_STALE;
     return result;
   }
 
   // if the device is detached
-  else {
-    return noResult;
+  result = (struct BMP280_ResultInt){0};
+  result.flags = BMP280_RESULT_BUS_ERROR;
+  return result;
+}
+
+void BMP280_ForcedPeriodSet(struct BMP280_Device *dev, uint32_t period_ms) {
+  dev->samplePeriod_ms = period_ms;
+  dev->nextSampleTick = BMP280_Tick(dev);
+}
+
+/**
+ * Trigger times are advanced by whole periods, so readout time and sleep
+ * rounding do not accumulate. After an overrun (e.g. bus recovery longer
+ * than the period) the schedule restarts from the current tick instead of
+ * triggering the missed samples back-to-back.
+ */
+struct BMP280_ResultInt BMP280_MeasureForcedInt_I2C(struct BMP280_Device *dev) {
+  struct BMP280_ResultInt result;
+
+  if (dev->samplePeriod_ms != 0) {
+    BMP280_SleepUntil(dev, dev->nextSampleTick);
+    dev->nextSampleTick += dev->samplePeriod_ms;
+    if ((int32_t)(BMP280_Tick(dev) - dev->nextSampleTick) >= 0) {
+      dev->nextSampleTick = BMP280_Tick(dev) + dev->samplePeriod_ms;
+    }
+  }
+
+  if (!BMP280_Wake_I2C(dev)) {
+    result = (struct BMP280_ResultInt){0};
+    result.flags = BMP280_RESULT_BUS_ERROR;
+    return result;
   }
+
+  return BMP280_MeasureInt_I2C(dev);
 }
 
-static inline HAL_StatusTypeDef
-BMP280_RawDataRead_I2C(I2C_HandleTypeDef i2c_handle, uint8_t device_address) {
-  HAL_StatusTypeDef status;
-  uint8_t MeasurementStatus = {0}, RawData[6] = {0};
+struct BMP280_Result BMP280_MeasureForced_I2C(struct BMP280_Device *dev) {
+  struct BMP280_ResultInt result = BMP280_MeasureForcedInt_I2C(dev);
 
-  do {
-    status = HAL_I2C_Mem_Read(&i2c_handle,
-                              device_address,
-                              BMP280_REG_STATUS,
-                              1,
-                              &MeasurementStatus,
-                              1,
-                              HAL_MAX_DELAY);
-  } while (MeasurementStatus & 0b00001000); // Wait for measurement to finish
-
-  status = HAL_I2C_Mem_Read(&i2c_handle,
-                            device_address,
-                            BMP280_REG_PRESS_MSB,
-                            1,
-                            RawData,
-                            6,
-                            HAL_MAX_DELAY);
-
-  rawPressure = RawData[0] << 12 | RawData[1] << 4 | RawData[2] >> 4;
-  rawTemperature = RawData[3] << 12 | RawData[4] << 4 | RawData[5] >> 4;
-
-  return status;
-}
-
-/************* COMPENSATION CALCULATION AS PER DATASHEET (page 25)
- * **************************/
-
-/* Returns temperature in DegC, resolution is 0.01 DegC. Output value of “5123”
-   equals 51.23 DegC. t_fine carries fine temperature as global value
-*/
-int32_t t_fine;
-static inline int32_t BMP280_calculate_T_int32(int32_t adc_T) {
-  int32_t var1, var2, T;
-  // compensate
-  var1 = ((((adc_T >> 3) - ((int32_t)dig_T1 << 1))) * ((int32_t)dig_T2)) >> 11;
-  var2 = (((((adc_T >> 4) - ((int32_t)dig_T1)) *
-            ((adc_T >> 4) - ((int32_t)dig_T1))) >>
-           12) *
-          ((int32_t)dig_T3)) >>
-         14;
-  t_fine = var1 + var2;
-  T = (t_fine * 5 + 128) >> 8;
-  // calculate
-  return T;
+  return BMP280_ResultToFloat(&result);
 }
 
-#if RETURN_64BIT
-/* Returns pressure in Pa as unsigned 32 bit integer in Q24.8 format (24 integer
-   bits and 8 fractional bits). Output value of “24674867” represents
-   24674867/256 = 96386.2 Pa = 963.862 hPa
-*/
-static inline uint32_t BMP280_calculate_P_int64(int32_t adc_P) {
-  int64_t var1, var2, p;
-  var1 = ((int64_t)t_fine) - 128000;
-  var2 = var1 * var1 * (int64_t)dig_P6;
-  var2 = var2 + ((var1 * (int64_t)dig_P5) << 17);
-  var2 = var2 + (((int64_t)dig_P4) << 35);
-  var1 =
-      ((var1 * var1 * (int64_t)dig_P3) >> 8) + ((var1 * (int64_t)dig_P2) << 12);
-  var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)dig_P1) >> 33;
-  if (var1 == 0) {
-    return 0; // avoid exception caused by division by zero
-  }
-  p = 1048576 - adc_P;
-  p = (((p << 31) - var2) * 3125) / var1;
-  var1 = (((int64_t)dig_P9) * (p >> 13) * (p >> 13)) >> 25;
-  var2 = (((int64_t)dig_P8) * p) >> 19;
-  p = ((p + var1 + var2) >> 8) + (((int64_t)dig_P7) << 4);
-  return (uint32_t)p;
+/**
+ * Read sensor registers through the transport
+ */
+static BMP280_Status BMP280_MemRead(struct BMP280_Device *dev,
+                                    uint8_t reg,
+                                    uint8_t *data,
+                                    uint16_t size) {
+  if (reg == BMP280_REG_STATUS) {
+    ++dev->stats.statusReads;
+  }
+
+  return dev->transport->read(dev, reg, data, size);
 }
 
+/**
+ * Write sensor registers through the transport
+ */
+static BMP280_Status BMP280_MemWrite(struct BMP280_Device *dev,
+                                     uint8_t reg,
+                                     const uint8_t *data,
+                                     uint16_t size) {
+  return dev->transport->write(dev, reg, data, size);
+}
+
+/**
+ * Write CONFIG and CTRL_MEAS in one transaction and keep their copies in the
+ * device context. The sensor does not auto-increment on writes, the second
+ * register is sent as address/data pair. CONFIG goes first, writes to it may
+ * be ignored in normal mode.
+ */
+static BMP280_Status BMP280_ConfigWrite(struct BMP280_Device *dev,
+                                        uint8_t ctrlMeas,
+                                        uint8_t config) {
+  uint8_t buffer[3] = {config, BMP280_REG_CTRL_MEAS, ctrlMeas};
+  BMP280_Status status =
+      BMP280_MemWrite(dev, BMP280_REG_CONFIG, buffer, sizeof(buffer));
+
+  if (status != BMP280_OK) {
+    return status;
+  }
+  dev->ctrlMeas = ctrlMeas;
+  dev->config = config;
+  return BMP280_OK;
+}
+
+/**
+ * Convert raw samples stored in device context to integer temperature and
+ * pressure values, channels with disabled measurement are flagged
+ */
+static struct BMP280_ResultInt BMP280_Compensate(struct BMP280_Device *dev) {
+  struct BMP280_ResultInt result = {0};
+
+  result.rawTemperature = dev->rawTemperature;
+  result.rawPressure = dev->rawPressure;
+  result.flags = BMP280_RESULT_VALID;
+
+  if (dev->rawTemperature == 0x80000) {
+    result.flags |= BMP280_RESULT_T_DISABLED;
+  } else {
+    PROFILER_BEGIN(PROFILER_BMP280_TEMPERATURE);
+    result.Temperature = BMP280_calculate_T_int32(
+        &dev->calib, &dev->derived, dev->rawTemperature, &dev->t_fine);
+    PROFILER_END(PROFILER_BMP280_TEMPERATURE);
+  }
+
+  if (dev->rawPressure == 0x80000) {
+    result.flags |= BMP280_RESULT_P_DISABLED;
+  } else {
+    PROFILER_BEGIN(PROFILER_BMP280_PRESSURE);
+#if RETURN_64BIT
+    result.Pressure = BMP280_calculate_P_int64(
+        &dev->calib, &dev->derived, dev->t_fine, dev->rawPressure);
 #elif RETURN_32BIT
-// Returns pressure in Pa as unsigned 32 bit integer. Output value of “96386”
-// equals 96386 Pa = 963.86 hPa
-static inline uint32_t BMP280_calculate_P_int32(int32_t adc_P) {
-  int32_t var1, var2;
-  uint32_t p;
-  var1 = (((int32_t)t_fine) >> 1) - (int32_t)64000;
-  var2 = (((var1 >> 2) * (var1 >> 2)) >> 11) * ((int32_t)dig_P6);
-  var2 = var2 + ((var1 * ((int32_t)dig_P5)) << 1);
-  var2 = (var2 >> 2) + (((int32_t)dig_P4) << 16);
-  var1 = (((dig_P3 * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) +
-          ((((int32_t)dig_P2) * var1) >> 1)) >>
-         18;
-  var1 = ((((32768 + var1)) * ((int32_t)dig_P1)) >> 15);
-  if (var1 == 0) {
-    return 0; // avoid exception caused by division by zero
-  }
-  p = (((uint32_t)(((int32_t)1048576) - adc_P) - (var2 >> 12))) * 3125;
-  if (p < 0x80000000) {
-    p = (p << 1) / ((uint32_t)var1);
+    uint32_t pressurePa = BMP280_calculate_P_int32(
+        &dev->calib, &dev->derived, dev->t_fine, dev->rawPressure);
+    result.Pressure = pressurePa << 8; // formula returns whole Pa
+#elif RETURN_APPROX
+    result.Pressure = BMP280_calculate_P_approx(
+        &dev->calib, &dev->derived, dev->t_fine, dev->rawPressure);
+#endif
+    PROFILER_END(PROFILER_BMP280_PRESSURE);
+  }
+
+  return result;
+}
+
+static inline BMP280_Status BMP280_RawDataRead_I2C(struct BMP280_Device *dev) {
+  BMP280_Status status;
+  uint8_t RawData[BMP280_READOUT_LEN] = {0};
+
+  if (dev->conversionPending) {
+    status = BMP280_ConversionWait(dev);
+    if (status != BMP280_OK) {
+      return status;
+    }
+  }
+
+  status =
+      BMP280_MemRead(dev, BMP280_READOUT_REG, RawData, BMP280_READOUT_LEN);
+  if (status != BMP280_OK) {
+    return status;
+  }
+
+  return BMP280_RawDataParse(dev, RawData);
+}
+
+/**
+ * Sleep for the rest of maximum conversion time of forced measurement and
+ * confirm with a single STATUS read that the result is ready. With burst
+ * readout the STATUS register comes with the data, so it is checked there.
+ */
+static BMP280_Status BMP280_ConversionWait(struct BMP280_Device *dev) {
+  uint32_t elapsed_us = (BMP280_Tick(dev) - dev->conversionStart) * 1000;
+  uint32_t conversion_us = BMP280_MeasurementTimeMax_us(dev);
+
+  if (elapsed_us < conversion_us) {
+    BMP280_Sleep_ms(dev, (conversion_us - elapsed_us + 999) / 1000);
+  }
+
+#if BMP280_BURST_READ
+  return BMP280_OK;
+#else
+  BMP280_Status status;
+  uint8_t MeasurementStatus;
+
+  status = BMP280_MemRead(dev, BMP280_REG_STATUS, &MeasurementStatus, 1);
+  if (status != BMP280_OK) {
+    return status;
+  }
+  if (MeasurementStatus & BMP280_VAL_STATUS_MEASURING) {
+    return BMP280_BUSY;
+  }
+
+  dev->conversionPending = false;
+  return BMP280_OK;
+#endif
+}
+
+/**
+ * Number of samples averaged for given OSRS_T/OSRS_P setting
+ */
+static inline uint32_t BMP280_OversamplingCount(uint8_t osrs) {
+  if (osrs == BMP280_VAL_CTRL_MEAS_OSRS_T_0) {
+    return 0;
+  }
+  if (osrs > BMP280_VAL_CTRL_MEAS_OSRS_T_16) {
+    return 16;
+  }
+  return 1U << (osrs - 1);
+}
+
+/**
+ * Sleep for at least ms, the first tick of the delay is partial
+ */
+static void BMP280_Sleep_ms(struct BMP280_Device *dev, uint32_t ms) {
+  dev->transport->delay_ms(dev, ms + 1);
+}
+
+/**
+ * Transport tick in milliseconds
+ */
+static inline uint32_t BMP280_Tick(const struct BMP280_Device *dev) {
+  return dev->transport->tick_ms(dev);
+}
+
+/**
+ * Transport tick in microseconds, wraps every 71 minutes
+ */
+static inline uint32_t BMP280_Now_us(const struct BMP280_Device *dev) {
+  return BMP280_Tick(dev) * 1000U;
+}
+
+/**
+ * Sleep until given tick, return at once when it has already passed
+ */
+static void BMP280_SleepUntil(struct BMP280_Device *dev, uint32_t tick) {
+  int32_t remaining = (int32_t)(tick - BMP280_Tick(dev));
+
+  if (remaining > 0) {
+    dev->transport->delay_ms(dev, (uint32_t)remaining);
+  }
+}
+
+/**
+ * Store raw samples from readout buffer in device context, burst readout is
+ * validated first
+ */
+static inline BMP280_Status BMP280_RawDataParse(struct BMP280_Device *dev,
+                                                const uint8_t *RawData) {
+#if BMP280_BURST_READ
+  BMP280_Status status = BMP280_BurstCheck(dev, RawData);
+
+  if (status != BMP280_OK) {
+    return status;
+  }
+#endif
+
+  RawData += BMP280_READOUT_DATA;
+  dev->rawPressure = RawData[0] << 12 | RawData[1] << 4 | RawData[2] >> 4;
+  dev->rawTemperature = RawData[3] << 12 | RawData[4] << 4 | RawData[5] >> 4;
+  ++dev->stats.samples;
+
+  return BMP280_OK;
+}
+
+#if BMP280_BURST_READ
+/**
+ * Decode STATUS, CTRL_MEAS and CONFIG from the head of a burst: reject data
+ * of an unfinished forced conversion or during NVM copy, and detect a sensor
+ * which lost its configuration (e.g. after brown-out reset)
+ */
+static inline BMP280_Status BMP280_BurstCheck(struct BMP280_Device *dev,
+                                              const uint8_t *RawData) {
+  uint8_t statusReg = RawData[0], ctrlMeas = RawData[1], config = RawData[2];
+  uint8_t ctrlMeasExpected =
+      dev->ctrlMeas & ~BMP280_VAL_CTRL_MEAS_MODE_NORMAL;
+  uint8_t configExpected = dev->config;
+
+  if (statusReg & BMP280_VAL_STATUS_IM_UPDATE) {
+    return BMP280_BUSY;
+  }
+  if (dev->conversionPending) {
+    if (statusReg & BMP280_VAL_STATUS_MEASURING) {
+      return BMP280_BUSY;
+    }
+    dev->conversionPending = false;
+  }
+
+  // Mode bits are not compared in forced mode - sensor returns to sleep
+  if (dev->acq_mode == BMP280_VAL_CTRL_MEAS_MODE_NORMAL) {
+    ctrlMeasExpected |= BMP280_VAL_CTRL_MEAS_MODE_NORMAL;
   } else {
-    p = (p / (uint32_t)var1) * 2;
+    ctrlMeas &= ~BMP280_VAL_CTRL_MEAS_MODE_NORMAL;
+  }
+  if (ctrlMeas != ctrlMeasExpected || (config & 0xFD) != configExpected) {
+    ++dev->stats.configMismatches;
+    return BMP280_ERROR;
   }
-  var1 = (((int32_t)dig_P9) * ((int32_t)(((p >> 3) * (p >> 3)) >> 13))) >> 12;
-  var2 = (((int32_t)(p >> 2)) * ((int32_t)dig_P8)) >> 13;
-  p = (uint32_t)((int32_t)p + ((var1 + var2 + dig_P7) >> 4));
-  return p;
+
+  return BMP280_OK;
 }
 #endif
@@ -0,0 +1,112 @@
+/**
+ * @file BMP280_Altitude.c
+ * @brief Barometric altitude from compensated pressure in fixed point
+ */
+
+#include "BMP280_Altitude.h"
+
+#include <math.h>
+
+/** ln(2), Q32 */
+#define BMP280_LN2_Q32 2977044472U
+/** BMP280_ALTITUDE_EXPONENT, Q31 */
+#define BMP280_EXPONENT_Q31 408587111
+/** 1.0 in Q30 */
+#define BMP280_ONE_Q30 (1 << 30)
+
+/** ln(1 + k/32) of the table knots, Q32 */
+static const uint32_t lnKnot[32] = {
+    0,          132163268,  260380768,  384881291,  505874286,  623551984,
+    738091233,  849655098,  958394255,  1064448219, 1167946415, 1269009132,
+    1367748360, 1464268541, 1558667227, 1651035675, 1741459379, 1830018543,
+    1916788510, 2001840147, 2085240191, 2167051565, 2247333665, 2326142616,
+    2403531508, 2479550612, 2554247578, 2627667611, 2699853634, 2770846446,
+    2840684851, 2909405794};
+
+/** 1 / (1 + k/32) of the table knots, Q31 */
+static const uint32_t invKnot[32] = {
+    2147483648, 2082408386, 2021161080, 1963413621, 1908874354, 1857283155,
+    1808407283, 1762037865, 1717986918, 1676084798, 1636178018, 1598127366,
+    1561806289, 1527099483, 1493901668, 1462116526, 1431655765, 1402438301,
+    1374389535, 1347440720, 1321528399, 1296593901, 1272582903, 1249445032,
+    1227133513, 1205604855, 1184818564, 1164736894, 1145324612, 1126548799,
+    1108378657, 1090785345};
+
+/** 1/k! for k = 7..2, Q30, Horner order */
+static const int32_t expm1Coefficient[6] = {213044,   1491308,  8947849,
+                                            44739243, 178956971, 536870912};
+
+static int64_t BMP280_AltitudeLn(uint32_t x);
+
+static inline int32_t BMP280_MulQ30(int32_t a, int32_t b);
+
+void BMP280_AltitudeReferenceSet(struct BMP280_Altitude *alt,
+                                 uint32_t reference) {
+  alt->reference = reference;
+  alt->lnReference = BMP280_AltitudeLn(reference);
+}
+
+/**
+ * h = -scale * expm1(a * ln(p / p0)), the Taylor polynomial of expm1 to
+ * the 7th power leaves below 1e-9 for |a * ln(p / p0)| < 0.3
+ */
+int32_t BMP280_AltitudeInt(const struct BMP280_Altitude *alt,
+                           uint32_t pressure) {
+  int64_t lnRatio; // Q32
+  int32_t y;       // a * ln(p / p0), Q30
+  int32_t sum;
+
+  if (pressure == 0 || alt->reference == 0) {
+    return BMP280_ALTITUDE_INVALID;
+  }
+
+  // |ln(p / p0)| < 2 keeps Q30 in range, far beyond 300..1100 hPa
+  lnRatio = BMP280_AltitudeLn(pressure) - alt->lnReference;
+  if (lnRatio >= (int64_t)2 << 32) {
+    lnRatio = ((int64_t)2 << 32) - 4;
+  } else if (lnRatio <= -((int64_t)2 << 32)) {
+    lnRatio = -((int64_t)2 << 32) + 4;
+  }
+  // one 32x32->64 multiply, the clamped ratio fits Q30
+  y = (int32_t)(((int64_t)(int32_t)(lnRatio >> 2) * BMP280_EXPONENT_Q31) >>
+                31);
+
+  sum = expm1Coefficient[0];
+  for (uint8_t k = 1; k < 6; k++) {
+    sum = expm1Coefficient[k] + BMP280_MulQ30(y, sum);
+  }
+  sum = BMP280_ONE_Q30 + BMP280_MulQ30(y, sum);
+  sum = BMP280_MulQ30(y, sum); // expm1(y)
+
+  return (int32_t)((-(int64_t)sum * BMP280_ALTITUDE_SCALE_CM +
+                    (1 << 29)) >> 30);
+}
+
+float BMP280_AltitudeFloat(uint32_t pressure, uint32_t reference) {
+  return BMP280_ALTITUDE_SCALE_CM *
+         (1.0f - powf((float)pressure / (float)reference,
+                      (float)BMP280_ALTITUDE_EXPONENT));
+}
+
+/**
+ * Natural logarithm of x > 0 in Q32: x = 2^n * c_k * (1 + u) with knot
+ * c_k = 1 + k/32 from the top mantissa bits and 0 <= u < 1/32, then
+ * ln(1 + u) from four series terms (error below 1e-8)
+ */
+static int64_t BMP280_AltitudeLn(uint32_t x) {
+  uint32_t n = 31 - (uint32_t)__builtin_clz(x);
+  uint32_t m = x << (31 - n); // 1.0 in Q31 .. 2.0
+  uint32_t k = (m >> 26) & 31;
+  uint32_t d = m - ((32 + k) << 26);
+  uint32_t u = (uint32_t)(((uint64_t)d * invKnot[k]) >> 31); // Q31
+  uint32_t u2 = (uint32_t)(((uint64_t)u * u) >> 31);
+  uint32_t u3 = (uint32_t)(((uint64_t)u2 * u) >> 31);
+  uint32_t u4 = (uint32_t)(((uint64_t)u3 * u) >> 31);
+  uint32_t ln1u = u - u2 / 2 + u3 / 3 - u4 / 4;
+
+  return (int64_t)n * BMP280_LN2_Q32 + lnKnot[k] + ((int64_t)ln1u << 1);
+}
+
+static inline int32_t BMP280_MulQ30(int32_t a, int32_t b) {
+  return (int32_t)(((int64_t)a * b) >> 30);
+}
@@ -0,0 +1,231 @@
+/**
+ * @file BMP280_Array.c
+ * @brief Normal mode sensors spread over several buses, read concurrently
+ */
+
+#include "BMP280_Array.h"
+
+#if BMP280_I2C_IT
+#include "FreeRTOS.h"
+#include "task.h"
+#endif
+
+static void BMP280_ArrayRound(struct BMP280_Array *array);
+
+static bool BMP280_ArrayBusIdle(const struct BMP280_Array *array,
+                                const void *bus);
+
+static void BMP280_ArrayFinish(struct BMP280_Array *array, uint8_t i);
+
+static void BMP280_ArrayWait(struct BMP280_Array *array);
+
+static void BMP280_ArrayQueue(struct BMP280_Array *array,
+                              const struct BMP280_ArraySample *sample);
+
+static bool BMP280_ArrayReleasable(const struct BMP280_Array *array);
+
+static inline uint32_t BMP280_ArrayNow_us(const struct BMP280_Array *array);
+
+bool BMP280_ArrayStart(struct BMP280_Array *array,
+                       struct BMP280_Device *const *sensors,
+                       uint8_t count) {
+  *array = (struct BMP280_Array){0};
+  if (count == 0 || count > BMP280_ARRAY_MAX_SENSORS) {
+    return false;
+  }
+
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t j = 0;
+
+    if (sensors[i]->acq_mode != BMP280_VAL_CTRL_MEAS_MODE_NORMAL) {
+      return false;
+    }
+    while (j < i && sensors[j]->bus != sensors[i]->bus) {
+      ++j;
+    }
+    if (j == i) {
+      ++array->buses;
+    }
+    array->sensor[i] = sensors[i];
+  }
+  array->count = count;
+  array->startTick = sensors[0]->transport->tick_ms(sensors[0]);
+
+  return array->buses <= BMP280_ASYNC_MAX_TRANSFERS;
+}
+
+struct BMP280_ArraySample BMP280_ArrayNext(struct BMP280_Array *array) {
+  struct BMP280_ArraySample sample;
+
+  while (!BMP280_ArrayReleasable(array)) {
+    BMP280_ArrayRound(array);
+  }
+
+  sample = array->queue[0];
+  --array->queued;
+  for (uint8_t n = 0; n < array->queued; n++) {
+    array->queue[n] = array->queue[n + 1];
+  }
+  ++array->samples;
+
+  return sample;
+}
+
+/**
+ * Sleep until the earliest scheduled read, then read every sensor due by
+ * then. Each bus runs one readout at a time; the next due sensor of a bus
+ * starts in the pass that finds the previous readout done.
+ */
+static void BMP280_ArrayRound(struct BMP280_Array *array) {
+  bool due[BMP280_ARRAY_MAX_SENSORS];
+  struct BMP280_Device *first = array->sensor[0];
+  uint32_t now_us;
+  bool pending;
+
+  for (uint8_t i = 1; i < array->count; i++) {
+    if ((int32_t)(array->sensor[i]->normal.next_us - first->normal.next_us) <
+        0) {
+      first = array->sensor[i];
+    }
+  }
+  BMP280_NormalWait(first);
+
+  ++array->rounds;
+  now_us = BMP280_ArrayNow_us(array);
+  for (uint8_t i = 0; i < array->count; i++) {
+    due[i] = (int32_t)(array->sensor[i]->normal.next_us - now_us) <= 0;
+  }
+
+  do {
+    pending = false;
+    for (uint8_t i = 0; i < array->count; i++) {
+      struct BMP280_Device *dev = array->sensor[i];
+
+      if (array->running[i] &&
+          BMP280_MeasurePoll_DMA(dev) != BMP280_ASYNC_BUSY) {
+        BMP280_ArrayFinish(array, i);
+      }
+      if (due[i] && !array->running[i] &&
+          BMP280_ArrayBusIdle(array, dev->bus)) {
+        due[i] = false;
+        if (!BMP280_ArrayBusIdle(array, NULL)) {
+          ++array->overlapped;
+        }
+#if BMP280_I2C_IT
+        dev->waitingTask = xTaskGetCurrentTaskHandle();
+#endif
+        array->running[i] = BMP280_MeasureStart_DMA(dev);
+        if (!array->running[i]) {
+          BMP280_ArrayFinish(array, i);
+        }
+      }
+      pending = pending || due[i] || array->running[i];
+    }
+    if (pending) {
+      BMP280_ArrayWait(array);
+    }
+  } while (pending);
+}
+
+/**
+ * Bus without readout in flight, NULL for all buses
+ */
+static bool BMP280_ArrayBusIdle(const struct BMP280_Array *array,
+                                const void *bus) {
+  for (uint8_t i = 0; i < BMP280_ARRAY_MAX_SENSORS; i++) {
+    if (array->running[i] && (bus == NULL || array->sensor[i]->bus == bus)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Compensate a finished or failed readout and queue it when it is a new
+ * sample
+ */
+static void BMP280_ArrayFinish(struct BMP280_Array *array, uint8_t i) {
+  struct BMP280_Device *dev = array->sensor[i];
+  struct BMP280_ArraySample sample;
+
+  array->running[i] = false;
+  dev->waitingTask = NULL;
+  sample.result = BMP280_MeasureCompleteInt_DMA(dev);
+  // a transfer done on a reconfigured sensor fails as well, duplicates
+  // come back valid
+  if (!(sample.result.flags & BMP280_RESULT_VALID)) {
+    ++array->errors;
+  }
+  if (!BMP280_NormalUpdate(dev)) {
+    return;
+  }
+
+  sample.ready_us = dev->normal.ready_us;
+  sample.sensor = i;
+  BMP280_ArrayQueue(array, &sample);
+}
+
+/**
+ * Readouts take a few hundred microseconds: sleep on the notification of the
+ * completion interrupt when the scheduler runs, deadlines are checked at
+ * least every tick
+ */
+static void BMP280_ArrayWait(struct BMP280_Array *array) {
+  struct BMP280_Device *dev = array->sensor[0];
+
+#if BMP280_I2C_IT
+  if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
+    (void)ulTaskNotifyTake(pdFALSE, 1);
+    return;
+  }
+#endif
+  dev->transport->delay_ms(dev, 1);
+}
+
+/**
+ * Insert by ready time, a sample does not pass one with equal time
+ */
+static void BMP280_ArrayQueue(struct BMP280_Array *array,
+                              const struct BMP280_ArraySample *sample) {
+  uint8_t n = array->queued;
+
+  while (n > 0 &&
+         (int32_t)(array->queue[n - 1].ready_us - sample->ready_us) > 0) {
+    array->queue[n] = array->queue[n - 1];
+    --n;
+  }
+  array->queue[n] = *sample;
+  ++array->queued;
+}
+
+/**
+ * The oldest held sample goes out when no sensor can have an earlier one
+ * ready: the next sample of each sensor comes one period after its last,
+ * less the uncertainty of that estimate. A queue without room for a sample
+ * of every sensor passes it out regardless.
+ */
+static bool BMP280_ArrayReleasable(const struct BMP280_Array *array) {
+  if (array->queued == 0) {
+    return false;
+  }
+  if (array->queued > BMP280_ARRAY_QUEUE_LEN - array->count) {
+    return true;
+  }
+
+  for (uint8_t i = 0; i < array->count; i++) {
+    const struct BMP280_NormalSchedule *normal = &array->sensor[i]->normal;
+    uint32_t earliest_us =
+        normal->ready_us + normal->period_us - normal->readyWidth_us;
+
+    if ((int32_t)(array->queue[0].ready_us - earliest_us) > 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static inline uint32_t BMP280_ArrayNow_us(const struct BMP280_Array *array) {
+  const struct BMP280_Device *dev = array->sensor[0];
+
+  return dev->transport->tick_ms(dev) * 1000U;
+}
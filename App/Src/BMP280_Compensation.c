@@ -0,0 +1,194 @@
+/**
+ * @file BMP280_Compensation.c
+ * @brief BMP280 compensation formulas, independent of MCU HAL
+ */
+
+#include "BMP280_Compensation.h"
+
+/** Smallest dig_P1 handled by approximate formula, keeps Q3 result in range */
+#define BMP280_P_APPROX_P1_MIN 16384
+/** Fractional bits of intermediate pressure in approximate formula */
+#define BMP280_P_APPROX_FRAC 3
+
+void BMP280_CalibrationDerive(const struct BMP280_Calibration *calib,
+                              struct BMP280_CalibrationDerived *derived) {
+  derived->T1_s1 = (int32_t)calib->dig_T1 * 2;
+  derived->P2_s12 = (int64_t)calib->dig_P2 * 4096;
+  derived->P4_s35 = (int64_t)calib->dig_P4 * ((int64_t)1 << 35);
+  derived->P5_s17 = (int64_t)calib->dig_P5 * 131072;
+  derived->P7_s4 = (int64_t)calib->dig_P7 * 16;
+  derived->P4_s16 = (int32_t)calib->dig_P4 * 65536;
+  derived->P5_s1 = (int32_t)calib->dig_P5 * 2;
+  derived->P4_s14 = (int32_t)calib->dig_P4 * 16384;
+  derived->P1_inv = 0;
+  derived->P1_inv_shift = 0;
+  if (calib->dig_P1 >= BMP280_P_APPROX_P1_MIN) {
+    // largest scale keeping P1_inv below 2^30
+    uint8_t shift = 30;
+    while ((3125LL << (9 + shift)) / calib->dig_P1 >= (1LL << 30)) {
+      shift--;
+    }
+    derived->P1_inv = (int32_t)((3125LL << (9 + shift)) / calib->dig_P1);
+    derived->P1_inv_shift = shift;
+  }
+}
+
+/************* COMPENSATION CALCULATION AS PER DATASHEET (page 25)
+ * **************************/
+
+/* Returns temperature in DegC, resolution is 0.01 DegC. Output value of “5123”
+   equals 51.23 DegC. t_fine carries fine temperature to pressure formulas.
+   Terms depending only on calibration come from derived.
+*/
+int32_t BMP280_calculate_T_int32(
+    const struct BMP280_Calibration *calib,
+    const struct BMP280_CalibrationDerived *derived,
+    int32_t adc_T,
+    int32_t *t_fine) {
+  int32_t var1, var2, T;
+  // compensate
+  var1 = (((adc_T >> 3) - derived->T1_s1) * ((int32_t)calib->dig_T2)) >> 11;
+  var2 = (((((adc_T >> 4) - ((int32_t)calib->dig_T1)) *
+            ((adc_T >> 4) - ((int32_t)calib->dig_T1))) >>
+           12) *
+          ((int32_t)calib->dig_T3)) >>
+         14;
+  *t_fine = var1 + var2;
+  T = (*t_fine * 5 + 128) >> 8;
+  // calculate
+  return T;
+}
+
+/* Returns pressure in Pa as unsigned 32 bit integer in Q24.8 format (24 integer
+   bits and 8 fractional bits). Output value of “24674867” represents
+   24674867/256 = 96386.2 Pa = 963.862 hPa
+*/
+uint32_t BMP280_calculate_P_int64(
+    const struct BMP280_Calibration *calib,
+    const struct BMP280_CalibrationDerived *derived,
+    int32_t t_fine,
+    int32_t adc_P) {
+  int64_t var1, var2, p;
+  var1 = ((int64_t)t_fine) - 128000;
+  var2 = var1 * var1 * (int64_t)calib->dig_P6;
+  var2 = var2 + var1 * derived->P5_s17;
+  var2 = var2 + derived->P4_s35;
+  var1 = ((var1 * var1 * (int64_t)calib->dig_P3) >> 8) +
+         var1 * derived->P2_s12;
+  var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)calib->dig_P1) >> 33;
+  if (var1 == 0) {
+    return 0; // avoid exception caused by division by zero
+  }
+  p = 1048576 - adc_P;
+  p = (((p << 31) - var2) * 3125) / var1;
+  var1 = (((int64_t)calib->dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+  var2 = (((int64_t)calib->dig_P8) * p) >> 19;
+  p = ((p + var1 + var2) >> 8) + derived->P7_s4;
+  return (uint32_t)p;
+}
+
+// Returns pressure in Pa as unsigned 32 bit integer. Output value of “96386”
+// equals 96386 Pa = 963.86 hPa
+uint32_t BMP280_calculate_P_int32(
+    const struct BMP280_Calibration *calib,
+    const struct BMP280_CalibrationDerived *derived,
+    int32_t t_fine,
+    int32_t adc_P) {
+  int32_t var1, var2;
+  uint32_t p;
+  var1 = (((int32_t)t_fine) >> 1) - (int32_t)64000;
+  var2 = (((var1 >> 2) * (var1 >> 2)) >> 11) * ((int32_t)calib->dig_P6);
+  var2 = var2 + var1 * derived->P5_s1;
+  var2 = (var2 >> 2) + derived->P4_s16;
+  var1 = (((calib->dig_P3 * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) +
+          ((((int32_t)calib->dig_P2) * var1) >> 1)) >>
+         18;
+  var1 = ((((32768 + var1)) * ((int32_t)calib->dig_P1)) >> 15);
+  if (var1 == 0) {
+    return 0; // avoid exception caused by division by zero
+  }
+  p = (((uint32_t)(((int32_t)1048576) - adc_P) - (var2 >> 12))) * 3125;
+  if (p < 0x80000000) {
+    p = (p << 1) / ((uint32_t)var1);
+  } else {
+    p = (p / (uint32_t)var1) * 2;
+  }
+  var1 = (((int32_t)calib->dig_P9) *
+          ((int32_t)(((p >> 3) * (p >> 3)) >> 13))) >>
+         12;
+  var2 = (((int32_t)(p >> 2)) * ((int32_t)calib->dig_P8)) >> 13;
+  p = (uint32_t)((int32_t)p + ((var1 + var2 + calib->dig_P7) >> 4));
+  return p;
+}
+
+/* Returns pressure in Pa as unsigned 32 bit integer in Q24.8 format, within
+   BMP280_P_APPROX_ERROR of BMP280_calculate_P_int64(). With x = 2^20 - adc_P
+   the 64-bit formula is
+     p = 3125 * 2^9 / dig_P1 * (x - A / 2^31) / (1 + e)
+   before the final correction, where A is its var2 and dig_P1 * 2^14 *
+   (1 + e) its var1. 1 / dig_P1 is precomputed, 1 / (1 + e) is seeded by
+   32-bit hardware division and refined with one Newton step.
+*/
+uint32_t BMP280_calculate_P_approx(
+    const struct BMP280_Calibration *calib,
+    const struct BMP280_CalibrationDerived *derived,
+    int32_t t_fine,
+    int32_t adc_P) {
+  int32_t var1, var2, var1sq, u, p;
+  uint32_t d, r;
+  if (derived->P1_inv == 0 || t_fine < BMP280_P_APPROX_T_FINE_MIN ||
+      t_fine > BMP280_P_APPROX_T_FINE_MAX) {
+    return BMP280_calculate_P_int64(calib, derived, t_fine, adc_P);
+  }
+  var1 = t_fine - 128000;
+  var1sq = (int32_t)(((int64_t)var1 * var1) >> 15);
+  // d = 1 + e in Q30
+  d = (1u << 30) + (int32_t)(((int64_t)var1 * calib->dig_P2) >> 5) +
+      (int32_t)(((int64_t)var1sq * calib->dig_P3) >> 10);
+  if (d - (3u << 28) >= (3u << 28)) {
+    return BMP280_calculate_P_int64(calib, derived, t_fine, adc_P);
+  }
+  // r = 1 / d in Q30, 17-bit seed, error squared by Newton step
+  r = (0xFFFFFFFFu / (d >> 15)) << 13;
+  r = (uint32_t)(((uint64_t)r *
+                  ((2u << 30) - (uint32_t)(((uint64_t)d * r) >> 30))) >>
+                 30);
+  // r = 3125 * 2^9 / dig_P1 / (1 + e) in Q(P1_inv_shift)
+  r = (uint32_t)(((uint64_t)r * (uint32_t)derived->P1_inv) >> 30);
+  // u = x - A / 2^31 in Q10
+  u = ((1048576 - adc_P) << 10) - derived->P4_s14 -
+      (int32_t)(((int64_t)var1 * calib->dig_P5) >> 4) -
+      (int32_t)(((int64_t)var1sq * calib->dig_P6) >> 6);
+  // p in Q24.8 + BMP280_P_APPROX_FRAC bits
+  p = (int32_t)(((int64_t)u * (int32_t)r) >>
+                (derived->P1_inv_shift + 10 - BMP280_P_APPROX_FRAC));
+  // same p >> 13 steps as 64-bit formula
+  var1 = p >> (13 - 8 + BMP280_P_APPROX_FRAC);
+  var1 = (int32_t)(((int64_t)calib->dig_P9 *
+                    (int32_t)(((int64_t)var1 * var1) >> 14)) >>
+                   16);
+  var2 = (int32_t)(((int64_t)calib->dig_P8 * p) >> 19);
+  p = ((p + var1 + var2) >> BMP280_P_APPROX_FRAC) +
+      (int32_t)calib->dig_P7 * 16;
+  return (uint32_t)p;
+}
+
+/**
+ * Only valid results are converted, disabled channels are reported as 0
+ */
+struct BMP280_Result
+BMP280_ResultToFloat(const struct BMP280_ResultInt *result) {
+  struct BMP280_Result out = {0.0f, 0.0f};
+
+  if (!(result->flags & BMP280_RESULT_VALID)) {
+    return out;
+  }
+  if (!(result->flags & BMP280_RESULT_T_DISABLED)) {
+    out.Temperature = result->Temperature / 100.0f;
+  }
+  if (!(result->flags & BMP280_RESULT_P_DISABLED)) {
+    out.Pressure = result->Pressure / 256.0f;
+  }
+
+  return out;
+}
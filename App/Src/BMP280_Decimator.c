@@ -0,0 +1,93 @@
+/**
+ * @file BMP280_Decimator.c
+ * @brief Integer CIC decimation of measurement results
+ */
+
+#include "BMP280_Decimator.h"
+
+/** Flags carried from inputs to the output */
+#define BMP280_DECIMATOR_FLAGS                                                 \
+  (BMP280_RESULT_T_DISABLED | BMP280_RESULT_P_DISABLED)
+
+static int32_t BMP280_DecimatorChannel(struct BMP280_Decimator *dec,
+                                       uint8_t ch, bool output, int32_t x);
+
+bool BMP280_DecimatorInit(struct BMP280_Decimator *dec, uint8_t order,
+                          uint8_t shift) {
+  *dec = (struct BMP280_Decimator){0};
+  if (order == 0 || order > BMP280_DECIMATOR_MAX_ORDER ||
+      shift > BMP280_DECIMATOR_MAX_SHIFT) {
+    return false;
+  }
+  dec->order = order;
+  dec->shift = shift;
+  dec->settle = shift == 0 ? 0 : order - 1;
+  return true;
+}
+
+bool BMP280_DecimatorPush(struct BMP280_Decimator *dec,
+                          const struct BMP280_ResultInt *in,
+                          struct BMP280_ResultInt *out) {
+  bool output;
+
+  if (!(in->flags & BMP280_RESULT_VALID)) {
+    ++dec->skipped;
+    return false;
+  }
+  ++dec->inputs;
+  dec->flags |= in->flags & BMP280_DECIMATOR_FLAGS;
+  output = ++dec->phase >> dec->shift != 0;
+
+  out->Temperature = BMP280_DecimatorChannel(dec, 0, output, in->Temperature);
+  out->Pressure =
+      (uint32_t)BMP280_DecimatorChannel(dec, 1, output, (int32_t)in->Pressure);
+  out->rawTemperature =
+      BMP280_DecimatorChannel(dec, 2, output, in->rawTemperature);
+  out->rawPressure = BMP280_DecimatorChannel(dec, 3, output, in->rawPressure);
+  if (!output) {
+    return false;
+  }
+
+  out->flags = BMP280_RESULT_VALID | dec->flags;
+  dec->flags = 0;
+  dec->phase = 0;
+  if (dec->settle != 0) {
+    --dec->settle;
+    return false;
+  }
+  ++dec->outputs;
+  return true;
+}
+
+/**
+ * Integrators at the input rate, combs with differential delay 1 at the
+ * output rate, gain 2^(order * shift) removed by a rounding shift. All
+ * stages wrap modulo 2^64, the final difference is exact as long as the
+ * filtered value fits its register, which the limits guarantee.
+ */
+static int32_t BMP280_DecimatorChannel(struct BMP280_Decimator *dec,
+                                       uint8_t ch, bool output, int32_t x) {
+  uint64_t *integrator = dec->integrator[ch];
+  uint64_t *comb = dec->comb[ch];
+  uint8_t gain = dec->order * dec->shift;
+  uint64_t y = (uint64_t)(int64_t)x;
+
+  for (uint8_t s = 0; s < dec->order; s++) {
+    integrator[s] += y;
+    y = integrator[s];
+  }
+  if (!output) {
+    return 0;
+  }
+
+  for (uint8_t s = 0; s < dec->order; s++) {
+    uint64_t delayed = comb[s];
+
+    comb[s] = y;
+    y -= delayed;
+  }
+  if (gain == 0) {
+    return (int32_t)(int64_t)y;
+  }
+  return (int32_t)(((int64_t)y + ((int64_t)1 << (gain - 1))) >> gain);
+}
@@ -0,0 +1,162 @@
+/**
+ * @file BMP280_Median.c
+ * @brief Streaming median outlier rejection of measurement results
+ */
+
+#include "BMP280_Median.h"
+
+/** Compare-exchange, a ends up with the smaller value */
+#define BMP280_MEDIAN_SORT(a, b)                                               \
+  do {                                                                         \
+    int32_t lo = (a) < (b) ? (a) : (b);                                        \
+                                                                               \
+    (b) = (a) < (b) ? (b) : (a);                                               \
+    (a) = lo;                                                                  \
+  } while (0)
+
+static int32_t BMP280_MedianOf3(const int32_t *w);
+
+static int32_t BMP280_MedianOf5(const int32_t *w);
+
+static int32_t BMP280_MedianOf7(const int32_t *w);
+
+static int32_t BMP280_MedianChannel(struct BMP280_Median *med, uint8_t ch,
+                                    int32_t x);
+
+static inline uint32_t BMP280_MedianDistance(int32_t a, int32_t b);
+
+bool BMP280_MedianInit(struct BMP280_Median *med, uint8_t window,
+                       uint32_t thresholdT, uint32_t thresholdP) {
+  *med = (struct BMP280_Median){0};
+  if (window == 0 || window > BMP280_MEDIAN_MAX_WINDOW || window % 2 == 0) {
+    return false;
+  }
+  med->window = window;
+  med->thresholdT = thresholdT;
+  med->thresholdP = thresholdP;
+  return true;
+}
+
+bool BMP280_MedianPush(struct BMP280_Median *med,
+                       const struct BMP280_ResultInt *in,
+                       struct BMP280_ResultInt *out) {
+  int32_t median[BMP280_MEDIAN_CHANNELS];
+  int32_t centerT, centerP;
+  uint8_t center;
+
+  if (!(in->flags & BMP280_RESULT_VALID)) {
+    ++med->skipped;
+    return false;
+  }
+  if (med->window == 1) {
+    *out = *in;
+    return true;
+  }
+
+  // newest value goes over the oldest, the center is window / 2 older
+  center = med->next + med->window / 2 + 1;
+  center -= center >= med->window ? med->window : 0;
+  med->flags[med->next] = in->flags;
+  median[0] = BMP280_MedianChannel(med, 0, in->Temperature);
+  median[1] = BMP280_MedianChannel(med, 1, (int32_t)in->Pressure);
+  median[2] = BMP280_MedianChannel(med, 2, in->rawTemperature);
+  median[3] = BMP280_MedianChannel(med, 3, in->rawPressure);
+
+  if (++med->next == med->window) {
+    med->next = 0;
+  }
+  if (med->filled < med->window - 1) {
+    ++med->filled;
+    return false;
+  }
+
+  out->flags = med->flags[center];
+  centerT = med->value[0][center];
+  centerP = med->value[1][center];
+  if (BMP280_MedianDistance(centerT, median[0]) > med->thresholdT ||
+      BMP280_MedianDistance(centerP, median[1]) > med->thresholdP) {
+    out->Temperature = median[0];
+    out->Pressure = (uint32_t)median[1];
+    out->rawTemperature = median[2];
+    out->rawPressure = median[3];
+    out->flags |= BMP280_RESULT_MEDIAN;
+    ++med->replaced;
+  } else {
+    out->Temperature = centerT;
+    out->Pressure = (uint32_t)centerP;
+    out->rawTemperature = med->value[2][center];
+    out->rawPressure = med->value[3][center];
+  }
+  ++med->outputs;
+  return true;
+}
+
+/**
+ * Store the newest value over the oldest and take the median of the
+ * window, the order of values in the ring does not matter
+ */
+static int32_t BMP280_MedianChannel(struct BMP280_Median *med, uint8_t ch,
+                                    int32_t x) {
+  int32_t *w = med->value[ch];
+
+  w[med->next] = x;
+  switch (med->window) {
+  case 3:
+    return BMP280_MedianOf3(w);
+  case 5:
+    return BMP280_MedianOf5(w);
+  default:
+    return BMP280_MedianOf7(w);
+  }
+}
+
+static inline uint32_t BMP280_MedianDistance(int32_t a, int32_t b) {
+  return a > b ? (uint32_t)a - (uint32_t)b : (uint32_t)b - (uint32_t)a;
+}
+
+/**
+ * Selection networks of Paeth, as in N. Devillard, "Fast median search:
+ * an ANSI C implementation" (1998): 3, 7 and 13 compare-exchanges. Every
+ * one compiles to branch-free cmp and conditional moves.
+ */
+static int32_t BMP280_MedianOf3(const int32_t *w) {
+  int32_t p0 = w[0], p1 = w[1], p2 = w[2];
+
+  BMP280_MEDIAN_SORT(p0, p1);
+  BMP280_MEDIAN_SORT(p1, p2);
+  BMP280_MEDIAN_SORT(p0, p1);
+  return p1;
+}
+
+static int32_t BMP280_MedianOf5(const int32_t *w) {
+  int32_t p0 = w[0], p1 = w[1], p2 = w[2], p3 = w[3], p4 = w[4];
+
+  BMP280_MEDIAN_SORT(p0, p1);
+  BMP280_MEDIAN_SORT(p3, p4);
+  BMP280_MEDIAN_SORT(p0, p3);
+  BMP280_MEDIAN_SORT(p1, p4);
+  BMP280_MEDIAN_SORT(p1, p2);
+  BMP280_MEDIAN_SORT(p2, p3);
+  BMP280_MEDIAN_SORT(p1, p2);
+  return p2;
+}
+
+static int32_t BMP280_MedianOf7(const int32_t *w) {
+  int32_t p0 = w[0], p1 = w[1], p2 = w[2], p3 = w[3], p4 = w[4], p5 = w[5],
+          p6 = w[6];
+
+  BMP280_MEDIAN_SORT(p0, p5);
+  BMP280_MEDIAN_SORT(p0, p3);
+  BMP280_MEDIAN_SORT(p1, p6);
+  BMP280_MEDIAN_SORT(p2, p4);
+  BMP280_MEDIAN_SORT(p0, p1);
+  BMP280_MEDIAN_SORT(p3, p5);
+  BMP280_MEDIAN_SORT(p2, p6);
+  BMP280_MEDIAN_SORT(p2, p3);
+  BMP280_MEDIAN_SORT(p3, p6);
+  BMP280_MEDIAN_SORT(p4, p5);
+  BMP280_MEDIAN_SORT(p1, p4);
+  BMP280_MEDIAN_SORT(p1, p3);
+  BMP280_MEDIAN_SORT(p3, p4);
+  return p3;
+}
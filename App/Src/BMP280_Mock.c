@@ -0,0 +1,148 @@
+/**
+ * @file BMP280_Mock.c
+ * @brief In-memory BMP280 transport for host builds of the driver
+ */
+
+#include "BMP280_Mock.h"
+
+#include <string.h>
+
+static BMP280_Status BMP280_MockRead(struct BMP280_Device *dev,
+                                     uint8_t reg,
+                                     uint8_t *data,
+                                     uint16_t size);
+
+static BMP280_Status BMP280_MockWrite(struct BMP280_Device *dev,
+                                      uint8_t reg,
+                                      const uint8_t *data,
+                                      uint16_t size);
+
+static void BMP280_MockRegisterWrite(struct BMP280_Mock *mock,
+                                     uint8_t reg,
+                                     uint8_t value);
+
+static void BMP280_MockDelay_ms(struct BMP280_Device *dev, uint32_t ms);
+
+static uint32_t BMP280_MockTick_ms(const struct BMP280_Device *dev);
+
+const struct BMP280_Transport BMP280_TransportMock = {
+    .read = BMP280_MockRead,
+    .write = BMP280_MockWrite,
+    .delay_ms = BMP280_MockDelay_ms,
+    .tick_ms = BMP280_MockTick_ms,
+};
+
+void BMP280_MockReset(struct BMP280_Mock *mock,
+                      const struct BMP280_Calibration *calib) {
+  const uint16_t words[12] = {
+      calib->dig_T1, (uint16_t)calib->dig_T2, (uint16_t)calib->dig_T3,
+      calib->dig_P1, (uint16_t)calib->dig_P2, (uint16_t)calib->dig_P3,
+      (uint16_t)calib->dig_P4, (uint16_t)calib->dig_P5,
+      (uint16_t)calib->dig_P6, (uint16_t)calib->dig_P7,
+      (uint16_t)calib->dig_P8, (uint16_t)calib->dig_P9};
+
+  memset(mock, 0, sizeof(*mock));
+  mock->failure = BMP280_OK;
+  mock->regs[BMP280_REG_ID] = BMP280_VAL_DEVID;
+  // little endian words from CALIB00 on
+  for (uint8_t i = 0; i < 12; i++) {
+    mock->regs[BMP280_REG_CALIB00 + 2 * i] = (uint8_t)words[i];
+    mock->regs[BMP280_REG_CALIB00 + 2 * i + 1] = (uint8_t)(words[i] >> 8);
+  }
+  BMP280_MockSample(mock, 0x80000, 0x80000); // reset value, skipped channel
+}
+
+void BMP280_MockSample(struct BMP280_Mock *mock, int32_t adc_T, int32_t adc_P) {
+  mock->regs[BMP280_REG_PRESS_MSB] = (uint8_t)(adc_P >> 12);
+  mock->regs[BMP280_REG_PRESS_LSB] = (uint8_t)(adc_P >> 4);
+  mock->regs[BMP280_REG_PRESS_XLSB] = (uint8_t)(adc_P << 4);
+  mock->regs[BMP280_REG_TEMP_MSB] = (uint8_t)(adc_T >> 12);
+  mock->regs[BMP280_REG_TEMP_LSB] = (uint8_t)(adc_T >> 4);
+  mock->regs[BMP280_REG_TEMP_XLSB] = (uint8_t)(adc_T << 4);
+}
+
+void BMP280_MockAttach(struct BMP280_Device *dev, struct BMP280_Mock *mock) {
+  dev->transport = &BMP280_TransportMock;
+  dev->bus = mock;
+  dev->device_address = BMP280_DEVICE_ADDRESS_GND;
+  dev->csPort = NULL;
+  dev->csPin = 0;
+  dev->threeWire = false;
+}
+
+/**
+ * Auto-incrementing read, addresses wrap at the end of the register file
+ */
+static BMP280_Status BMP280_MockRead(struct BMP280_Device *dev,
+                                     uint8_t reg,
+                                     uint8_t *data,
+                                     uint16_t size) {
+  struct BMP280_Mock *mock = dev->bus;
+
+  ++dev->stats.transactions;
+  ++mock->reads;
+  if (mock->failure != BMP280_OK) {
+    return mock->failure;
+  }
+  for (uint16_t i = 0; i < size; i++) {
+    data[i] = mock->regs[(uint8_t)(reg + i)];
+  }
+  return BMP280_OK;
+}
+
+/**
+ * Write of reg followed by address/data pairs, as on the sensor
+ */
+static BMP280_Status BMP280_MockWrite(struct BMP280_Device *dev,
+                                      uint8_t reg,
+                                      const uint8_t *data,
+                                      uint16_t size) {
+  struct BMP280_Mock *mock = dev->bus;
+
+  ++dev->stats.transactions;
+  ++mock->writes;
+  if (mock->failure != BMP280_OK) {
+    return mock->failure;
+  }
+  if (size != 0) {
+    BMP280_MockRegisterWrite(mock, reg, data[0]);
+  }
+  for (uint16_t i = 1; i + 1 < size; i += 2) {
+    BMP280_MockRegisterWrite(mock, data[i], data[i + 1]);
+  }
+  return BMP280_OK;
+}
+
+/**
+ * Only control registers are writable, reset clears them
+ */
+static void BMP280_MockRegisterWrite(struct BMP280_Mock *mock,
+                                     uint8_t reg,
+                                     uint8_t value) {
+  switch (reg) {
+  case BMP280_REG_RESET:
+    if (value == BMP280_VAL_RESET) {
+      mock->regs[BMP280_REG_CTRL_MEAS] = 0;
+      mock->regs[BMP280_REG_CONFIG] = 0;
+    }
+    break;
+  case BMP280_REG_CTRL_MEAS:
+  case BMP280_REG_CONFIG:
+    mock->regs[reg] = value;
+    break;
+  default:
+    break;
+  }
+}
+
+static void BMP280_MockDelay_ms(struct BMP280_Device *dev, uint32_t ms) {
+  struct BMP280_Mock *mock = dev->bus;
+
+  mock->tick_ms += ms;
+}
+
+static uint32_t BMP280_MockTick_ms(const struct BMP280_Device *dev) {
+  const struct BMP280_Mock *mock = dev->bus;
+
+  return mock->tick_ms;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file BMP280_Pair.c
+ * @brief Pipelined forced mode sampling of two sensors on one bus
+ */
+
+#include "BMP280_Pair.h"
+
+static void BMP280_PairTrigger(struct BMP280_Pair *pair, uint8_t i);
+
+static inline uint32_t BMP280_PairTick(const struct BMP280_Pair *pair);
+
+void BMP280_PairStart(struct BMP280_Pair *pair,
+                      struct BMP280_Device *first,
+                      struct BMP280_Device *second) {
+  *pair = (struct BMP280_Pair){0};
+  pair->sensor[0] = first;
+  pair->sensor[1] = second;
+}
+
+/**
+ * Order of bus traffic in a steady pair: read 0, trigger 0, read 1,
+ * trigger 1. Sensor 1 is read while sensor 0 converts and the other way
+ * round, only the waits for the end of conversion are spent idle.
+ */
+struct BMP280_PairSample BMP280_PairMeasure(struct BMP280_Pair *pair) {
+  struct BMP280_PairSample sample;
+  int32_t skew;
+
+  if (!pair->running) {
+    pair->startTick = BMP280_PairTick(pair);
+    pair->running = true;
+  }
+  // first call, or a trigger failed
+  for (uint8_t i = 0; i < 2; i++) {
+    if (!pair->triggered[i]) {
+      BMP280_PairTrigger(pair, i);
+    }
+  }
+
+  for (uint8_t i = 0; i < 2; i++) {
+    struct BMP280_Device *dev = pair->sensor[i];
+
+    if (!pair->triggered[i]) {
+      sample.result[i] = (struct BMP280_ResultInt){0};
+      sample.result[i].flags = BMP280_RESULT_BUS_ERROR;
+      sample.tick_ms[i] = BMP280_PairTick(pair);
+      ++pair->errors;
+      continue;
+    }
+
+    sample.tick_ms[i] = dev->conversionStart;
+    sample.result[i] = BMP280_MeasureInt_I2C(dev);
+    if (sample.result[i].flags & BMP280_RESULT_BUS_ERROR) {
+      ++pair->errors;
+    }
+    // a conversion still pending (read failed, not finished) is kept
+    if (!dev->conversionPending) {
+      BMP280_PairTrigger(pair, i);
+    }
+  }
+
+  skew = (int32_t)(sample.tick_ms[1] - sample.tick_ms[0]);
+  if (skew < 0) {
+    skew = -skew;
+  }
+  if ((uint32_t)skew > pair->maxSkew_ms) {
+    pair->maxSkew_ms = (uint32_t)skew;
+  }
+  ++pair->pairs;
+
+  return sample;
+}
+
+void BMP280_PairReportGet(const struct BMP280_Pair *pair,
+                          struct BMP280_PairReport *report) {
+  uint32_t conversion_us[2];
+  uint32_t longest_us;
+
+  for (uint8_t i = 0; i < 2; i++) {
+    conversion_us[i] = BMP280_MeasurementTimeMax_us(pair->sensor[i]);
+  }
+  longest_us = conversion_us[0] > conversion_us[1] ? conversion_us[0]
+                                                   : conversion_us[1];
+
+  report->pairs = pair->pairs;
+  report->errors = pair->errors;
+  report->elapsed_ms =
+      pair->running ? BMP280_PairTick(pair) - pair->startTick : 0;
+  report->rate_mHz =
+      report->elapsed_ms != 0
+          ? (uint32_t)(2000000ULL * pair->pairs / report->elapsed_ms)
+          : 0;
+  report->pipelined_mHz = 2000000000U / longest_us;
+  report->sequential_mHz =
+      2000000000U / (conversion_us[0] + conversion_us[1]);
+  report->maxSkew_ms = pair->maxSkew_ms;
+}
+
+/**
+ * Start a forced conversion, the sensor is retried on the next pair if the
+ * trigger failed
+ */
+static void BMP280_PairTrigger(struct BMP280_Pair *pair, uint8_t i) {
+  pair->triggered[i] = BMP280_Wake_I2C(pair->sensor[i]);
+}
+
+/**
+ * Both sensors share the time base, the first one's transport gives it
+ */
+static inline uint32_t BMP280_PairTick(const struct BMP280_Pair *pair) {
+  const struct BMP280_Device *dev = pair->sensor[0];
+
+  return dev->transport->tick_ms(dev);
+}
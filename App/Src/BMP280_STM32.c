@@ -0,0 +1,826 @@
+/**
+ * @file BMP280_STM32.c
+ * @brief BMP280 driver transports over STM32 HAL I2C and SPI
+ */
+
+#include "BMP280_STM32.h"
+#include "BMP280_Snapshot.h"
+
+#if BMP280_RTOS
+#include "FreeRTOS.h"
+#include "task.h"
+#endif
+
+_Static_assert(BMP280_OK == (int)HAL_OK && BMP280_ERROR == (int)HAL_ERROR &&
+                   BMP280_BUSY == (int)HAL_BUSY &&
+                   BMP280_TIMEOUT == (int)HAL_TIMEOUT,
+               "HAL status is passed through as BMP280_Status");
+
+static const struct BMP280_Result noResult = {0.0f, 0.0f};
+
+static struct BMP280_Device *asyncDevices[BMP280_ASYNC_MAX_TRANSFERS];
+
+#ifdef HAL_SPI_MODULE_ENABLED
+/** Transmitted during SPI DMA readout, address with read bit and dummies */
+static const uint8_t spiReadoutCommand[BMP280_READOUT_LEN + 1] = {
+    BMP280_READOUT_REG | BMP280_SPI_READ};
+#endif
+
+static BMP280_Status BMP280_Read_I2C(struct BMP280_Device *dev,
+                                     uint8_t reg,
+                                     uint8_t *data,
+                                     uint16_t size);
+
+static BMP280_Status BMP280_Write_I2C(struct BMP280_Device *dev,
+                                      uint8_t reg,
+                                      const uint8_t *data,
+                                      uint16_t size);
+
+static void BMP280_Delay_ms(struct BMP280_Device *dev, uint32_t ms);
+
+static uint32_t BMP280_Tick_ms(const struct BMP280_Device *dev);
+
+static inline I2C_HandleTypeDef *BMP280_I2C(const struct BMP280_Device *dev);
+
+static inline bool BMP280_IsSPI(const struct BMP280_Device *dev);
+
+static bool BMP280_AsyncDeviceGive(struct BMP280_Device *dev);
+
+static void BMP280_AsyncDeviceRelease(struct BMP280_Device *dev);
+
+static struct BMP280_Device *BMP280_AsyncDeviceTake(const void *bus);
+
+static bool BMP280_AsyncBusOwned(const void *bus);
+
+static void BMP280_AsyncDeviceFinish(const void *bus,
+                                     BMP280_AsyncState state);
+
+static HAL_StatusTypeDef BMP280_Transfer(struct BMP280_Device *dev,
+                                         bool read,
+                                         uint8_t reg,
+                                         uint8_t *data,
+                                         uint16_t size);
+
+static HAL_StatusTypeDef BMP280_TransferOnce(struct BMP280_Device *dev,
+                                             bool read,
+                                             uint8_t reg,
+                                             uint8_t *data,
+                                             uint16_t size,
+                                             uint32_t timeout_ms);
+
+static uint32_t BMP280_TransferTimeout_ms(const struct BMP280_Device *dev,
+                                          uint16_t size);
+
+static bool BMP280_BusFault(I2C_HandleTypeDef *hi2c);
+
+static void BMP280_BusRecover(struct BMP280_Device *dev);
+
+#ifdef HAL_SPI_MODULE_ENABLED
+static BMP280_Status BMP280_Read_SPI(struct BMP280_Device *dev,
+                                     uint8_t reg,
+                                     uint8_t *data,
+                                     uint16_t size);
+
+static BMP280_Status BMP280_Write_SPI(struct BMP280_Device *dev,
+                                      uint8_t reg,
+                                      const uint8_t *data,
+                                      uint16_t size);
+
+static HAL_StatusTypeDef BMP280_Transfer_SPI(struct BMP280_Device *dev,
+                                             bool read,
+                                             uint8_t reg,
+                                             uint8_t *data,
+                                             uint16_t size);
+
+static inline SPI_HandleTypeDef *BMP280_SPI(const struct BMP280_Device *dev);
+
+static inline GPIO_TypeDef *BMP280_CsPort(const struct BMP280_Device *dev);
+#endif
+
+const struct BMP280_Transport BMP280_TransportI2C = {
+    .read = BMP280_Read_I2C,
+    .write = BMP280_Write_I2C,
+    .delay_ms = BMP280_Delay_ms,
+    .tick_ms = BMP280_Tick_ms,
+};
+
+#ifdef HAL_SPI_MODULE_ENABLED
+const struct BMP280_Transport BMP280_TransportSPI = {
+    .read = BMP280_Read_SPI,
+    .write = BMP280_Write_SPI,
+    .delay_ms = BMP280_Delay_ms,
+    .tick_ms = BMP280_Tick_ms,
+};
+#endif
+
+/**
+ * Set the transport up and initialize the sensor through the driver core
+ */
+//@{
+bool BMP280_Init_I2C(struct BMP280_Device *dev,
+                     uint8_t osrs_t,
+                     uint8_t osrs_p,
+                     uint8_t acq_mode,
+                     uint8_t t_sb,
+                     uint8_t filter_tc,
+                     I2C_HandleTypeDef *i2c_handle,
+                     uint8_t device_address) {
+  dev->transport = &BMP280_TransportI2C;
+  dev->bus = i2c_handle;
+  dev->device_address = device_address;
+  dev->csPort = NULL;
+  dev->csPin = 0;
+  dev->threeWire = false;
+
+  return BMP280_Init(dev, osrs_t, osrs_p, acq_mode, t_sb, filter_tc);
+}
+
+#ifdef HAL_SPI_MODULE_ENABLED
+bool BMP280_Init_SPI(struct BMP280_Device *dev,
+                     uint8_t osrs_t,
+                     uint8_t osrs_p,
+                     uint8_t acq_mode,
+                     uint8_t t_sb,
+                     uint8_t filter_tc,
+                     SPI_HandleTypeDef *spi_handle,
+                     GPIO_TypeDef *cs_port,
+                     uint16_t cs_pin) {
+  dev->transport = &BMP280_TransportSPI;
+  dev->bus = spi_handle;
+  dev->device_address = 0;
+  dev->csPort = cs_port;
+  dev->csPin = cs_pin;
+  dev->threeWire = spi_handle->Init.Direction == SPI_DIRECTION_1LINE;
+  HAL_GPIO_WritePin(cs_port, cs_pin, GPIO_PIN_SET);
+
+  return BMP280_Init(dev, osrs_t, osrs_p, acq_mode, t_sb, filter_tc);
+} //@}
+#else
+//@}
+#endif
+
+/**
+ * Use the flash snapshot when it was taken with the same address and
+ * settings and the sensor still reports its ID and configuration, so it was
+ * not power cycled since. Otherwise initialize fully and take a new snapshot.
+ */
+bool BMP280_InitWarm_I2C(struct BMP280_Device *dev,
+                         uint8_t osrs_t,
+                         uint8_t osrs_p,
+                         uint8_t acq_mode,
+                         uint8_t t_sb,
+                         uint8_t filter_tc,
+                         I2C_HandleTypeDef *i2c_handle,
+                         uint8_t device_address,
+                         uint8_t slot) {
+  struct BMP280_Snapshot snapshot;
+  uint8_t ctrlMeas = (osrs_t << 5) | (osrs_p << 2) | (acq_mode << 0);
+  uint8_t config = (t_sb << 5) | (filter_tc << 2);
+
+  dev->transport = &BMP280_TransportI2C;
+  dev->bus = i2c_handle;
+  dev->device_address = device_address;
+  dev->csPort = NULL;
+  dev->csPin = 0;
+  dev->threeWire = false;
+  if (BMP280_SnapshotLoad(slot, &snapshot) &&
+      snapshot.chipId == BMP280_VAL_DEVID &&
+      snapshot.deviceAddress == device_address &&
+      snapshot.ctrlMeas == ctrlMeas && snapshot.config == config &&
+      BMP280_Resume(dev, osrs_t, osrs_p, acq_mode, t_sb, filter_tc,
+                    &snapshot.calib)) {
+    return true;
+  }
+
+  if (!BMP280_Init_I2C(dev, osrs_t, osrs_p, acq_mode, t_sb, filter_tc,
+                       i2c_handle, device_address)) {
+    return false;
+  }
+
+  // Blank or stuck NVM reads would be kept across boots, dig_P1 is a divisor
+  if (dev->calib.dig_T1 != 0 && dev->calib.dig_P1 != 0) {
+    snapshot.chipId = BMP280_VAL_DEVID;
+    snapshot.deviceAddress = device_address;
+    snapshot.ctrlMeas = dev->ctrlMeas;
+    snapshot.config = dev->config;
+    snapshot.calib = dev->calib;
+    BMP280_SnapshotStore(slot, &snapshot);
+  }
+  return true;
+}
+
+/**
+ * Register the device as owner of its bus' DMA readout and start the data
+ * burst. Completion is reported by BMP280_I2C_MemRxCpltCallback() or
+ * BMP280_SPI_TxRxCpltCallback().
+ */
+bool BMP280_MeasureStart_DMA(struct BMP280_Device *dev) {
+  if (!BMP280_AsyncDeviceGive(dev)) {
+    return false;
+  }
+
+  ++dev->stats.transactions;
+#ifdef HAL_SPI_MODULE_ENABLED
+  if (BMP280_IsSPI(dev)) {
+    dev->transferDeadline = HAL_GetTick() + BMP280_SPI_TIMEOUT_MS;
+    HAL_GPIO_WritePin(BMP280_CsPort(dev), dev->csPin, GPIO_PIN_RESET);
+    if (dev->threeWire ||
+        HAL_SPI_TransmitReceive_DMA(BMP280_SPI(dev),
+                                    (uint8_t *)spiReadoutCommand,
+                                    dev->rxBuffer,
+                                    BMP280_READOUT_LEN + 1) != HAL_OK) {
+      HAL_GPIO_WritePin(BMP280_CsPort(dev), dev->csPin, GPIO_PIN_SET);
+      BMP280_AsyncDeviceRelease(dev);
+      dev->asyncState = BMP280_ASYNC_ERROR;
+      return false;
+    }
+    return true;
+  }
+#endif
+
+  dev->transferDeadline =
+      HAL_GetTick() + BMP280_TransferTimeout_ms(dev, BMP280_READOUT_LEN);
+  if (HAL_I2C_Mem_Read_DMA(BMP280_I2C(dev),
+                           dev->device_address,
+                           BMP280_READOUT_REG,
+                           1,
+                           dev->rxBuffer,
+                           BMP280_READOUT_LEN) != HAL_OK) {
+    BMP280_AsyncDeviceRelease(dev);
+    dev->asyncState = BMP280_ASYNC_ERROR;
+    if (BMP280_BusFault(BMP280_I2C(dev))) {
+      BMP280_BusRecover(dev);
+    }
+    return false;
+  }
+
+  return true;
+}
+
+BMP280_AsyncState BMP280_MeasurePoll_DMA(struct BMP280_Device *dev) {
+  if (dev->asyncState == BMP280_ASYNC_BUSY &&
+      (int32_t)(HAL_GetTick() - dev->transferDeadline) > 0) {
+    ++dev->stats.timeouts;
+#ifdef HAL_SPI_MODULE_ENABLED
+    if (BMP280_IsSPI(dev)) {
+      (void)HAL_SPI_Abort(BMP280_SPI(dev));
+      BMP280_AsyncDeviceFinish(BMP280_SPI(dev), BMP280_ASYNC_ERROR);
+      return dev->asyncState;
+    }
+#endif
+    BMP280_BusRecover(dev); // releases the readout as BMP280_ASYNC_ERROR
+  }
+
+  return dev->asyncState;
+}
+
+struct BMP280_ResultInt
+BMP280_MeasureCompleteInt_DMA(struct BMP280_Device *dev) {
+  struct BMP280_ResultInt result = {0};
+  const uint8_t *rawData = dev->rxBuffer;
+
+  if (dev->asyncState != BMP280_ASYNC_DONE) {
+    if (dev->asyncState == BMP280_ASYNC_ERROR) {
+      dev->asyncState = BMP280_ASYNC_IDLE;
+    }
+    result.flags = BMP280_RESULT_BUS_ERROR;
+    return result;
+  }
+
+  dev->asyncState = BMP280_ASYNC_IDLE;
+  if (BMP280_IsSPI(dev)) {
+    ++rawData; // received while the address was sent
+  }
+  return BMP280_ReadoutCompensate(dev, rawData);
+}
+
+struct BMP280_Result BMP280_MeasureComplete_DMA(struct BMP280_Device *dev) {
+  struct BMP280_ResultInt result = BMP280_MeasureCompleteInt_DMA(dev);
+
+  if (!(result.flags & BMP280_RESULT_VALID)) {
+    return noResult;
+  }
+
+  return BMP280_ResultToFloat(&result);
+}
+
+void BMP280_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c) {
+  BMP280_AsyncDeviceFinish(hi2c, BMP280_ASYNC_DONE);
+}
+
+void BMP280_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c) {
+  BMP280_AsyncDeviceFinish(hi2c, BMP280_ASYNC_DONE);
+}
+
+void BMP280_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
+  BMP280_AsyncDeviceFinish(hi2c, BMP280_ASYNC_ERROR);
+}
+
+#ifdef HAL_SPI_MODULE_ENABLED
+void BMP280_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi) {
+  BMP280_AsyncDeviceFinish(hspi, BMP280_ASYNC_DONE);
+}
+
+void BMP280_SPI_ErrorCallback(SPI_HandleTypeDef *hspi) {
+  BMP280_AsyncDeviceFinish(hspi, BMP280_ASYNC_ERROR);
+}
+#endif
+
+/**
+ * Register the device as owner of the next interrupt/DMA transfer on its bus.
+ * Completions are matched by bus, so a bus with a transfer in flight, of
+ * this or another device, is busy.
+ */
+static bool BMP280_AsyncDeviceGive(struct BMP280_Device *dev) {
+  uint8_t free = BMP280_ASYNC_MAX_TRANSFERS;
+
+  if (dev->asyncState == BMP280_ASYNC_BUSY) {
+    return false;
+  }
+
+  for (uint8_t slot = 0; slot < BMP280_ASYNC_MAX_TRANSFERS; ++slot) {
+    if (asyncDevices[slot] == NULL) {
+      free = slot;
+    } else if (asyncDevices[slot]->bus == dev->bus) {
+      return false;
+    }
+  }
+  if (free == BMP280_ASYNC_MAX_TRANSFERS) {
+    return false;
+  }
+
+  dev->asyncState = BMP280_ASYNC_BUSY;
+  asyncDevices[free] = dev;
+  return true;
+}
+
+/**
+ * Drop registration of transfer which HAL refused to start
+ */
+static void BMP280_AsyncDeviceRelease(struct BMP280_Device *dev) {
+  for (uint8_t slot = 0; slot < BMP280_ASYNC_MAX_TRANSFERS; ++slot) {
+    if (asyncDevices[slot] == dev) {
+      asyncDevices[slot] = NULL;
+    }
+  }
+}
+
+/**
+ * Find the device which owns the DMA readout running on given bus and release
+ * its slot
+ */
+static struct BMP280_Device *BMP280_AsyncDeviceTake(const void *bus) {
+  struct BMP280_Device *dev;
+
+  for (uint8_t slot = 0; slot < BMP280_ASYNC_MAX_TRANSFERS; ++slot) {
+    dev = asyncDevices[slot];
+    if (dev != NULL && dev->bus == bus) {
+      asyncDevices[slot] = NULL;
+      return dev;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Bus with a DMA readout or interrupt transfer of any device in flight
+ */
+static bool BMP280_AsyncBusOwned(const void *bus) {
+  for (uint8_t slot = 0; slot < BMP280_ASYNC_MAX_TRANSFERS; ++slot) {
+    if (asyncDevices[slot] != NULL && asyncDevices[slot]->bus == bus) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Called from bus interrupt context - store transfer result and wake the task
+ * blocked in BMP280_Transfer_IT(), if there is one
+ */
+static void BMP280_AsyncDeviceFinish(const void *bus,
+                                     BMP280_AsyncState state) {
+  struct BMP280_Device *dev = BMP280_AsyncDeviceTake(bus);
+
+  if (dev == NULL) {
+    return;
+  }
+
+#ifdef HAL_SPI_MODULE_ENABLED
+  if (BMP280_IsSPI(dev)) {
+    HAL_GPIO_WritePin(BMP280_CsPort(dev), dev->csPin, GPIO_PIN_SET);
+  }
+#endif
+
+  dev->asyncState = state;
+
+#if BMP280_I2C_IT
+  if (dev->waitingTask != NULL) {
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+    vTaskNotifyGiveFromISR(dev->waitingTask, &higherPriorityTaskWoken);
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+  }
+#endif
+}
+
+#if BMP280_I2C_IT
+/**
+ * Run one register transfer in interrupt mode, the calling task sleeps until
+ * the I2C event/error interrupt notifies it or the deadline passes
+ */
+static HAL_StatusTypeDef BMP280_Transfer_IT(struct BMP280_Device *dev,
+                                            bool read,
+                                            uint8_t reg,
+                                            uint8_t *data,
+                                            uint16_t size,
+                                            uint32_t timeout_ms) {
+  HAL_StatusTypeDef status;
+  uint32_t primask;
+  bool notified;
+  bool running;
+
+  if (!BMP280_AsyncDeviceGive(dev)) {
+    return HAL_BUSY;
+  }
+
+  dev->waitingTask = xTaskGetCurrentTaskHandle();
+  (void)ulTaskNotifyTake(pdTRUE, 0); // drop stale notification
+
+  if (read) {
+    status = HAL_I2C_Mem_Read_IT(
+        BMP280_I2C(dev), dev->device_address, reg, 1, data, size);
+  } else {
+    status = HAL_I2C_Mem_Write_IT(
+        BMP280_I2C(dev), dev->device_address, reg, 1, data, size);
+  }
+
+  if (status == HAL_OK) {
+    // first tick of the wait is partial
+    notified = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms) + 1) != 0;
+
+    // the completion interrupt must not finish a transfer being released
+    primask = __get_PRIMASK();
+    __disable_irq();
+    running = dev->asyncState == BMP280_ASYNC_BUSY;
+    if (running) {
+      BMP280_AsyncDeviceRelease(dev);
+    }
+    __set_PRIMASK(primask);
+
+    if (!running) {
+      status = (dev->asyncState == BMP280_ASYNC_DONE) ? HAL_OK : HAL_ERROR;
+    } else if (notified) {
+      // woken by a stray notification, HAL cannot abort a memory transfer:
+      // stop it by resetting the bus before another one starts
+      BMP280_BusRecover(dev);
+      status = HAL_ERROR;
+    } else {
+      status = HAL_TIMEOUT; // interrupt never came, BMP280_Transfer() recovers
+    }
+  } else {
+    BMP280_AsyncDeviceRelease(dev);
+  }
+
+  dev->waitingTask = NULL;
+  dev->asyncState = BMP280_ASYNC_IDLE;
+
+  return status;
+}
+#endif
+
+/**
+ * Transport operations, HAL status values are passed through unchanged
+ */
+//@{
+static BMP280_Status BMP280_Read_I2C(struct BMP280_Device *dev,
+                                     uint8_t reg,
+                                     uint8_t *data,
+                                     uint16_t size) {
+  return (BMP280_Status)BMP280_Transfer(dev, true, reg, data, size);
+}
+
+static BMP280_Status BMP280_Write_I2C(struct BMP280_Device *dev,
+                                      uint8_t reg,
+                                      const uint8_t *data,
+                                      uint16_t size) {
+  return (BMP280_Status)BMP280_Transfer(
+      dev, false, reg, (uint8_t *)data, size);
+}
+
+#ifdef HAL_SPI_MODULE_ENABLED
+static BMP280_Status BMP280_Read_SPI(struct BMP280_Device *dev,
+                                     uint8_t reg,
+                                     uint8_t *data,
+                                     uint16_t size) {
+  return (BMP280_Status)BMP280_Transfer_SPI(dev, true, reg, data, size);
+}
+
+static BMP280_Status BMP280_Write_SPI(struct BMP280_Device *dev,
+                                      uint8_t reg,
+                                      const uint8_t *data,
+                                      uint16_t size) {
+  return (BMP280_Status)BMP280_Transfer_SPI(
+      dev, false, reg, (uint8_t *)data, size);
+}
+#endif
+
+/**
+ * Put the calling task to sleep, busy-wait before scheduler starts.
+ * HAL_Delay() adds the partial tick itself.
+ */
+static void BMP280_Delay_ms(struct BMP280_Device *dev, uint32_t ms) {
+  (void)dev;
+  if (ms == 0) {
+    return;
+  }
+
+#if BMP280_RTOS
+  if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
+    vTaskDelay(pdMS_TO_TICKS(ms));
+    return;
+  }
+#endif
+
+  HAL_Delay(ms - 1);
+}
+
+static uint32_t BMP280_Tick_ms(const struct BMP280_Device *dev) {
+  (void)dev;
+  return HAL_GetTick();
+} //@}
+
+/**
+ * Bus handles of the transports, kept untyped in the device context
+ */
+//@{
+static inline I2C_HandleTypeDef *BMP280_I2C(const struct BMP280_Device *dev) {
+  return dev->bus;
+}
+
+static inline bool BMP280_IsSPI(const struct BMP280_Device *dev) {
+#ifdef HAL_SPI_MODULE_ENABLED
+  return dev->transport == &BMP280_TransportSPI;
+#else
+  return false;
+#endif
+}
+
+#ifdef HAL_SPI_MODULE_ENABLED
+static inline SPI_HandleTypeDef *BMP280_SPI(const struct BMP280_Device *dev) {
+  return dev->bus;
+}
+
+static inline GPIO_TypeDef *BMP280_CsPort(const struct BMP280_Device *dev) {
+  return dev->csPort;
+}
+#endif
+//@}
+
+/**
+ * Run one register transfer, failed attempts are repeated up to
+ * BMP280_I2C_RETRIES times, bus faults are recovered first. A transfer
+ * refused because the bus is owned by a DMA readout or another interrupt
+ * transfer is not repeated: HAL_BUSY goes back to the caller, which sees
+ * BMP280_BUSY and reads again later.
+ */
+static HAL_StatusTypeDef BMP280_Transfer(struct BMP280_Device *dev,
+                                         bool read,
+                                         uint8_t reg,
+                                         uint8_t *data,
+                                         uint16_t size) {
+  uint32_t timeout_ms = BMP280_TransferTimeout_ms(dev, size);
+  HAL_StatusTypeDef status = HAL_ERROR;
+
+  for (uint8_t attempt = 0; attempt <= BMP280_I2C_RETRIES; ++attempt) {
+    if (attempt != 0) {
+      ++dev->stats.retries;
+    }
+
+    // BUSY stuck on an idle bus would make HAL wait 25 ms before failing
+    if (BMP280_BusFault(BMP280_I2C(dev))) {
+      BMP280_BusRecover(dev);
+      if (BMP280_BusFault(BMP280_I2C(dev))) {
+        status = HAL_ERROR; // line held low, not even worth a transfer
+        continue;
+      }
+    }
+
+    ++dev->stats.transactions;
+    status = BMP280_TransferOnce(dev, read, reg, data, size, timeout_ms);
+    if (status == HAL_OK) {
+      return HAL_OK;
+    }
+
+    if (status == HAL_TIMEOUT ||
+        (BMP280_I2C(dev)->ErrorCode & HAL_I2C_ERROR_TIMEOUT)) {
+      ++dev->stats.timeouts;
+    }
+    if (status == HAL_TIMEOUT || BMP280_BusFault(BMP280_I2C(dev))) {
+      BMP280_BusRecover(dev);
+    } else if (status == HAL_BUSY) {
+      return status; // bus owned by a DMA readout
+    }
+  }
+
+  return status;
+}
+
+/**
+ * Run one register transfer with deadline, in interrupt mode when enabled
+ * and scheduler is running, otherwise in polling mode
+ */
+static HAL_StatusTypeDef BMP280_TransferOnce(struct BMP280_Device *dev,
+                                             bool read,
+                                             uint8_t reg,
+                                             uint8_t *data,
+                                             uint16_t size,
+                                             uint32_t timeout_ms) {
+#if BMP280_I2C_IT
+  if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
+    return BMP280_Transfer_IT(dev, read, reg, data, size, timeout_ms);
+  }
+#endif
+
+  if (read) {
+    return HAL_I2C_Mem_Read(BMP280_I2C(dev),
+                            dev->device_address,
+                            reg,
+                            1,
+                            data,
+                            size,
+                            timeout_ms);
+  }
+  return HAL_I2C_Mem_Write(BMP280_I2C(dev),
+                           dev->device_address,
+                           reg,
+                           1,
+                           data,
+                           size,
+                           timeout_ms);
+}
+
+#ifdef HAL_SPI_MODULE_ENABLED
+/**
+ * Run one register transfer over SPI in polling mode, the burst is short
+ * enough not to be worth a task switch. The register address carries the
+ * read bit, reads auto-increment, writes are address/data pairs with the
+ * read bit cleared in every address.
+ */
+static HAL_StatusTypeDef BMP280_Transfer_SPI(struct BMP280_Device *dev,
+                                             bool read,
+                                             uint8_t reg,
+                                             uint8_t *data,
+                                             uint16_t size) {
+  uint8_t command[1 + BMP280_SPI_WRITE_MAX];
+  HAL_StatusTypeDef status;
+
+  // chip select of another sensor must stay high during its DMA readout
+  if (BMP280_AsyncBusOwned(dev->bus)) {
+    return HAL_BUSY; // bus owned by a DMA readout
+  }
+
+  if (read) {
+    command[0] = reg | BMP280_SPI_READ;
+  } else {
+    if (size > BMP280_SPI_WRITE_MAX) {
+      return HAL_ERROR;
+    }
+    command[0] = reg & ~BMP280_SPI_READ;
+    for (uint16_t i = 0; i < size; i++) {
+      // odd bytes of a write burst are addresses of the following registers
+      command[1 + i] = (i & 1U) ? data[i] & ~BMP280_SPI_READ : data[i];
+    }
+  }
+
+  ++dev->stats.transactions;
+  HAL_GPIO_WritePin(BMP280_CsPort(dev), dev->csPin, GPIO_PIN_RESET);
+  if (read) {
+    status = HAL_SPI_Transmit(
+        BMP280_SPI(dev), command, 1, BMP280_SPI_TIMEOUT_MS);
+    if (status == HAL_OK) {
+      status = HAL_SPI_Receive(
+          BMP280_SPI(dev), data, size, BMP280_SPI_TIMEOUT_MS);
+    }
+  } else {
+    status = HAL_SPI_Transmit(
+        BMP280_SPI(dev), command, 1 + size, BMP280_SPI_TIMEOUT_MS);
+  }
+  HAL_GPIO_WritePin(BMP280_CsPort(dev), dev->csPin, GPIO_PIN_SET);
+
+  if (status == HAL_TIMEOUT) {
+    ++dev->stats.timeouts;
+  }
+  return status;
+}
+#endif
+
+/**
+ * Bus time of a register transfer: address, register, repeated start
+ * address and data bytes of 9 clocks each, rounded up to whole ms, plus
+ * reserve
+ */
+static uint32_t BMP280_TransferTimeout_ms(const struct BMP280_Device *dev,
+                                          uint16_t size) {
+  uint32_t clocks = (3U + size) * 9U * 1000U;
+  uint32_t speed = BMP280_I2C(dev)->Init.ClockSpeed;
+
+  return (clocks + speed - 1) / speed + BMP280_I2C_TIMEOUT_MARGIN_MS;
+}
+
+/**
+ * Bus or arbitration error of the last transfer, or BUSY flag set while no
+ * transfer is running - the bus has to be recovered before next use
+ */
+static bool BMP280_BusFault(I2C_HandleTypeDef *hi2c) {
+  if (hi2c->ErrorCode & (HAL_I2C_ERROR_BERR | HAL_I2C_ERROR_ARLO |
+                         HAL_I2C_ERROR_TIMEOUT)) {
+    return true;
+  }
+
+  return HAL_I2C_GetState(hi2c) == HAL_I2C_STATE_READY &&
+         __HAL_I2C_GET_FLAG(hi2c, I2C_FLAG_BUSY);
+}
+
+/**
+ * About 5 us, half of 100 kHz SCL period
+ */
+static void BMP280_BusDelay(void) {
+  for (volatile uint32_t cycles = SystemCoreClock / 1000000U; cycles != 0;
+       --cycles) {
+  }
+}
+
+/**
+ * Free a stuck bus, following the BUSY flag workaround of the STM32F10x
+ * errata sheet. Transfers in flight on the bus are reported as failed, the
+ * pins are driven as GPIO: SCL is pulsed until the slave releases SDA, then
+ * a STOP condition ends whatever it was sending. A peripheral reset clears
+ * a stuck BUSY flag before the HAL initializes the peripheral again.
+ */
+static void BMP280_BusRecover(struct BMP280_Device *dev) {
+  I2C_HandleTypeDef *hi2c = BMP280_I2C(dev);
+  GPIO_InitTypeDef gpio = {0};
+  struct BMP280_Device *owner;
+  uint32_t primask;
+  uint16_t scl;
+  uint16_t sda;
+
+  ++dev->stats.busRecoveries;
+
+  // the transfer interrupt must not finish a readout being released
+  primask = __get_PRIMASK();
+  __disable_irq();
+  while ((owner = BMP280_AsyncDeviceTake(hi2c)) != NULL) {
+    owner->asyncState = BMP280_ASYNC_ERROR;
+  }
+  __set_PRIMASK(primask);
+  (void)HAL_I2C_DeInit(hi2c);
+
+  // default pins: I2C1 on PB6/PB7 or remapped PB8/PB9, I2C2 on PB10/PB11
+  if (hi2c->Instance == I2C1) {
+    bool remap = AFIO->MAPR & AFIO_MAPR_I2C1_REMAP;
+    scl = remap ? GPIO_PIN_8 : GPIO_PIN_6;
+    sda = remap ? GPIO_PIN_9 : GPIO_PIN_7;
+  } else {
+    scl = GPIO_PIN_10;
+    sda = GPIO_PIN_11;
+  }
+
+  HAL_GPIO_WritePin(GPIOB, scl | sda, GPIO_PIN_SET);
+  gpio.Pin = scl | sda;
+  gpio.Mode = GPIO_MODE_OUTPUT_OD;
+  gpio.Speed = GPIO_SPEED_FREQ_HIGH;
+  HAL_GPIO_Init(GPIOB, &gpio);
+  BMP280_BusDelay();
+
+  for (uint8_t pulse = 0; pulse < BMP280_I2C_RECOVERY_PULSES &&
+                          HAL_GPIO_ReadPin(GPIOB, sda) == GPIO_PIN_RESET;
+       ++pulse) {
+    HAL_GPIO_WritePin(GPIOB, scl, GPIO_PIN_RESET);
+    BMP280_BusDelay();
+    HAL_GPIO_WritePin(GPIOB, scl, GPIO_PIN_SET);
+    BMP280_BusDelay();
+  }
+
+  // STOP: SDA rises while SCL is high
+  HAL_GPIO_WritePin(GPIOB, scl, GPIO_PIN_RESET);
+  BMP280_BusDelay();
+  HAL_GPIO_WritePin(GPIOB, sda, GPIO_PIN_RESET);
+  BMP280_BusDelay();
+  HAL_GPIO_WritePin(GPIOB, scl, GPIO_PIN_SET);
+  BMP280_BusDelay();
+  HAL_GPIO_WritePin(GPIOB, sda, GPIO_PIN_SET);
+  BMP280_BusDelay();
+
+  if (hi2c->Instance == I2C1) {
+    __HAL_RCC_I2C1_FORCE_RESET();
+    __HAL_RCC_I2C1_RELEASE_RESET();
+  } else {
+    __HAL_RCC_I2C2_FORCE_RESET();
+    __HAL_RCC_I2C2_RELEASE_RESET();
+  }
+  (void)HAL_I2C_Init(hi2c); // MspInit returns the pins to I2C function
+}
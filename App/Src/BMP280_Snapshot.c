@@ -0,0 +1,90 @@
+/**
+ * @file BMP280_Snapshot.c
+ * @brief Sensor calibration and configuration kept in flash for warm boot
+ */
+
+#include "BMP280_Snapshot.h"
+
+#include <stddef.h>
+#include <string.h>
+
+_Static_assert(sizeof(struct BMP280_Snapshot) % 2 == 0,
+               "records are programmed in half-words");
+_Static_assert(sizeof(struct BMP280_Snapshot) * BMP280_SNAPSHOT_SLOTS <=
+                   BMP280_SNAPSHOT_PAGE_SIZE,
+               "records have to fit in the reserved page");
+
+static const struct BMP280_Snapshot *BMP280_SnapshotSlot(uint8_t slot);
+
+static uint32_t BMP280_SnapshotCrc(const struct BMP280_Snapshot *snapshot);
+
+/**
+ * Record of a slot in the reserved page, read directly from flash
+ */
+static const struct BMP280_Snapshot *BMP280_SnapshotSlot(uint8_t slot) {
+  return (const struct BMP280_Snapshot *)BMP280_SNAPSHOT_ADDRESS + slot;
+}
+
+/**
+ * Bitwise CRC-32 (IEEE, reflected), record is read once per boot so a table
+ * is not worth its flash
+ */
+static uint32_t BMP280_SnapshotCrc(const struct BMP280_Snapshot *snapshot) {
+  const uint8_t *data = (const uint8_t *)snapshot;
+  uint32_t crc = 0xFFFFFFFFU;
+
+  for (size_t i = 0; i < offsetof(struct BMP280_Snapshot, crc); i++) {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320U & -(crc & 1U));
+    }
+  }
+  return ~crc;
+}
+
+bool BMP280_SnapshotLoad(uint8_t slot, struct BMP280_Snapshot *snapshot) {
+  if (slot >= BMP280_SNAPSHOT_SLOTS) {
+    return false;
+  }
+
+  memcpy(snapshot, BMP280_SnapshotSlot(slot), sizeof(*snapshot));
+  return snapshot->magic == BMP280_SNAPSHOT_MAGIC &&
+         snapshot->crc == BMP280_SnapshotCrc(snapshot);
+}
+
+bool BMP280_SnapshotStore(uint8_t slot, struct BMP280_Snapshot *snapshot) {
+  struct BMP280_Snapshot page[BMP280_SNAPSHOT_SLOTS];
+  FLASH_EraseInitTypeDef erase = {
+      .TypeErase = FLASH_TYPEERASE_PAGES,
+      .PageAddress = BMP280_SNAPSHOT_ADDRESS,
+      .NbPages = 1,
+  };
+  uint32_t pageError;
+  const uint16_t *halfWords = (const uint16_t *)page;
+  HAL_StatusTypeDef status;
+
+  if (slot >= BMP280_SNAPSHOT_SLOTS) {
+    return false;
+  }
+
+  snapshot->magic = BMP280_SNAPSHOT_MAGIC;
+  snapshot->crc = BMP280_SnapshotCrc(snapshot);
+  if (memcmp(BMP280_SnapshotSlot(slot), snapshot, sizeof(*snapshot)) == 0) {
+    return true; // spare the page an erase cycle
+  }
+
+  // Other slots survive the erase through a RAM copy
+  memcpy(page, BMP280_SnapshotSlot(0), sizeof(page));
+  page[slot] = *snapshot;
+
+  HAL_FLASH_Unlock();
+  status = HAL_FLASHEx_Erase(&erase, &pageError);
+  for (size_t i = 0; status == HAL_OK && i < sizeof(page) / 2; i++) {
+    status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD,
+                               BMP280_SNAPSHOT_ADDRESS + 2 * i, halfWords[i]);
+  }
+  HAL_FLASH_Lock();
+
+  return status == HAL_OK &&
+         memcmp(BMP280_SnapshotSlot(slot), snapshot, sizeof(*snapshot)) == 0;
+}
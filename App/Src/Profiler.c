@@ -0,0 +1,109 @@
+/**
+ * @file Profiler.c
+ * @brief DWT cycle counter probes with per-probe statistics
+ */
+
+#include "Profiler.h"
+
+#if PROFILER_ENABLED
+
+#include "stm32f1xx_hal.h"
+#include <stddef.h>
+#include <stdio.h>
+
+_Static_assert(DWT_BASE + offsetof(DWT_Type, CYCCNT) == 0xE0001004UL,
+               "PROFILER_CYCCNT has to be DWT->CYCCNT");
+
+static const char *const probeNames[PROFILER_PROBE_COUNT] = {
+    "bmp280 readout",
+    "bmp280 temperature",
+    "bmp280 pressure",
+    "status measure",
+    "status printf",
+    "usart2 mutex",
+    "status init",
+    "altitude fixed",
+    "altitude float",
+    "status median",
+};
+
+static Profiler_Stats probeStats[PROFILER_PROBE_COUNT];
+
+/** Cycles of empty PROFILER_BEGIN/PROFILER_END pair */
+static uint32_t probeOverhead;
+
+void Profiler_Init(void) {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  // empty pairs of the real macros, fastest run taken as overhead
+  probeOverhead = 0;
+  Profiler_Reset();
+  for (uint8_t i = 0; i < 8; i++) {
+    PROFILER_BEGIN(PROFILER_BMP280_READOUT);
+    PROFILER_END(PROFILER_BMP280_READOUT);
+  }
+  probeOverhead = probeStats[PROFILER_BMP280_READOUT].min;
+
+  Profiler_Reset();
+}
+
+void Profiler_Reset(void) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  for (uint8_t i = 0; i < PROFILER_PROBE_COUNT; i++) {
+    probeStats[i] = (Profiler_Stats){0, UINT32_MAX, 0, 0};
+  }
+  __set_PRIMASK(primask);
+}
+
+void Profiler_Record(Profiler_Probe probe, uint32_t cycles) {
+  Profiler_Stats *stats = &probeStats[probe];
+
+  cycles = cycles > probeOverhead ? cycles - probeOverhead : 0;
+
+  // probes may close in different tasks
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  stats->count++;
+  stats->total += cycles;
+  if (cycles < stats->min) {
+    stats->min = cycles;
+  }
+  if (cycles > stats->max) {
+    stats->max = cycles;
+  }
+  __set_PRIMASK(primask);
+}
+
+void Profiler_Dump(void) {
+  uint32_t cyclesPerUs = SystemCoreClock / 1000000;
+
+  printf("probe                count        min        max       mean"
+         "   mean us\r\n");
+  for (uint8_t i = 0; i < PROFILER_PROBE_COUNT; i++) {
+    Profiler_Stats stats;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    stats = probeStats[i];
+    __set_PRIMASK(primask);
+
+    if (stats.count == 0) {
+      printf("%-18s %7lu          -          -          -         -\r\n",
+             probeNames[i], 0UL);
+      continue;
+    }
+    uint32_t mean = (uint32_t)(stats.total / stats.count);
+    printf("%-18s %7lu %10lu %10lu %10lu %9lu\r\n",
+           probeNames[i],
+           (unsigned long)stats.count,
+           (unsigned long)stats.min,
+           (unsigned long)stats.max,
+           (unsigned long)mean,
+           (unsigned long)(mean / cyclesPerUs));
+  }
+}
+
+#endif
@@ -27,7 +27,13 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
-#include "BMP280.h"
+#include "BMP280_Altitude.h"
+#include "BMP280_Array.h"
+#include "BMP280_Decimator.h"
+#include "BMP280_Median.h"
+#include "BMP280_Pair.h"
+#include "BMP280_STM32.h"
+#include "Profiler.h"
 #include "i2c.h"
 /* USER CODE END Includes */
 
@@ -38,6 +44,37 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+/** Forced mode sample period of status task in ms, 0 = normal mode */
+#define STATUS_FORCED_PERIOD_MS 0
+/** Sensor ID and configuration check period in forced mode in ms */
+#define STATUS_HEALTH_PERIOD_MS 60000
+/** Flash snapshot slot of the status sensor */
+#define STATUS_SNAPSHOT_SLOT 0
+/** Second sensor at 0x77 on I2C1 sampled in pairs with the first one in
+    forced mode, see BMP280_Pair.h, 0 = one sensor */
+#define STATUS_PAIR 0
+/** Throughput report period of the pair, in pairs */
+#define STATUS_PAIR_REPORT 100
+/** Sensors at 0x76 and 0x77 on I2C1 and on I2C2 read concurrently in normal
+    mode, see BMP280_Array.h, 0 = one sensor */
+#define STATUS_ARRAY 0
+/** Throughput report period of the array, in samples */
+#define STATUS_ARRAY_REPORT 1000
+/** log2 of decimation ratio of the status sensor at x1 oversampling in
+    normal mode, about 150 Hz in, see BMP280_Decimator.h, 0 = no decimation */
+#define STATUS_DECIMATION 0
+/** Cascaded boxcar stages of the decimation */
+#define STATUS_DECIMATION_ORDER 1
+/** Median window ahead of the decimation, 3, 5 or 7 remove spikes of up to
+    1, 2 or 3 samples, see BMP280_Median.h, 1 = off */
+#define STATUS_MEDIAN_WINDOW 1
+/** Deviations from the median kept by the median stage, in 0.01 degC and
+    in Q24.8 Pa; x1 oversampling noise is about 1.3 Pa */
+#define STATUS_MEDIAN_THRESHOLD_T 50
+#define STATUS_MEDIAN_THRESHOLD_P (10U << 8)
+/** Zero altitude pressure of the status task, Q24.8 Pa, local QNH for
+    altitude above sea level */
+#define STATUS_ALTITUDE_REFERENCE BMP280_ALTITUDE_STANDARD_REFERENCE
 
 /* USER CODE END PD */
 
@@ -49,7 +86,21 @@
 /* Private variables ---------------------------------------------------------*/
 /* USER CODE BEGIN Variables */
 osThreadId_t vStatusTaskHandle;
+struct BMP280_Device bmp280;
 struct BMP280_Result bmp280_result;
+struct BMP280_Altitude bmp280_altitude;
+#if STATUS_PAIR
+struct BMP280_Device bmp280Second;
+struct BMP280_Pair bmp280Pair;
+#endif
+#if STATUS_ARRAY
+struct BMP280_Device bmp280Sensors[4];
+struct BMP280_Array bmp280Array;
+#endif
+#if STATUS_DECIMATION
+struct BMP280_Decimator bmp280Decimator;
+struct BMP280_Median bmp280Median;
+#endif
 /* USER CODE END Variables */
 /* Definitions for statusTask */
 osThreadId_t statusTaskHandle;
@@ -71,6 +122,18 @@ const osMutexAttr_t USART2TxMutex_attributes = {.name = "USART2TxMutex"};
 
 /* Private function prototypes -----------------------------------------------*/
 /* USER CODE BEGIN FunctionPrototypes */
+#if STATUS_PAIR
+static void StatusPairRun(void);
+#endif
+#if STATUS_ARRAY
+static void StatusArrayRun(void);
+#endif
+#if STATUS_DECIMATION
+static void StatusDecimationRun(void);
+#endif
+#if PROFILER_ENABLED
+static void StatusProfilerCommand(void);
+#endif
 
 /* USER CODE END FunctionPrototypes */
 
@@ -155,26 +218,109 @@ void vStatusTask(void *argument) {
   /* USER CODE BEGIN vStatusTask */
   /* Infinite loop */
   printf("System initializing\r\n");
-
-  BMP280_Init_I2C(BMP280_VAL_CTRL_MEAS_OSRS_T_16,
-                  BMP280_VAL_CTRL_MEAS_OSRS_P_16,
-                  BMP280_VAL_CTRL_MEAS_MODE_NORMAL,
-                  BMP280_VAL_CTRL_CONFIG_T_SB_0_5,
-                  BMP280_VAL_CTRL_CONFIG_FILTER_0,
-                  hi2c1,
-                  BMP280_DEVICE_ADDRESS_GND);
+#if STATUS_PAIR
+  StatusPairRun(); // does not return
+#endif
+#if STATUS_ARRAY
+  StatusArrayRun(); // does not return
+#endif
+#if STATUS_DECIMATION
+  StatusDecimationRun(); // does not return
+#endif
+
+  PROFILER_BEGIN(PROFILER_STATUS_INIT);
+  if (!BMP280_InitWarm_I2C(&bmp280,
+                           BMP280_VAL_CTRL_MEAS_OSRS_T_16,
+                           BMP280_VAL_CTRL_MEAS_OSRS_P_16,
+#if STATUS_FORCED_PERIOD_MS
+                           BMP280_VAL_CTRL_MEAS_MODE_FORCED,
+#else
+                           BMP280_VAL_CTRL_MEAS_MODE_NORMAL,
+#endif
+                           BMP280_VAL_CTRL_CONFIG_T_SB_0_5,
+                           BMP280_VAL_CTRL_CONFIG_FILTER_0,
+                           &hi2c1,
+                           BMP280_DEVICE_ADDRESS_GND,
+                           STATUS_SNAPSHOT_SLOT)) {
+    printf("Sensor 0 setup failed\r\n");
+    osThreadSuspend(osThreadGetId());
+  }
+  PROFILER_END(PROFILER_STATUS_INIT);
+  BMP280_AltitudeReferenceSet(&bmp280_altitude, STATUS_ALTITUDE_REFERENCE);
+#if STATUS_FORCED_PERIOD_MS
+  BMP280_ForcedPeriodSet(&bmp280, STATUS_FORCED_PERIOD_MS);
+  BMP280_HealthPeriodSet(&bmp280, STATUS_HEALTH_PERIOD_MS);
+#endif
 
   while (true) {
-    bmp280_result = BMP280_Measure_I2C(hi2c1, BMP280_DEVICE_ADDRESS_GND);
+    struct BMP280_ResultInt sample;
+
+    PROFILER_BEGIN(PROFILER_STATUS_MEASURE);
+#if STATUS_FORCED_PERIOD_MS
+    // sleeps until the next period, sensor sleeps between conversions
+    sample = BMP280_MeasureForcedInt_I2C(&bmp280);
+#else
+    // sleeps until the next sample is ready in normal mode
+    BMP280_NormalWait(&bmp280);
+#if BMP280_I2C_IT
+    // woken by the completion interrupt instead of the next tick
+    bmp280.waitingTask = xTaskGetCurrentTaskHandle();
+    (void)ulTaskNotifyTake(pdTRUE, 0); // drop stale notification
+#endif
+    if (BMP280_MeasureStart_DMA(&bmp280)) {
+      // the deadline is checked at least every tick
+      while (BMP280_MeasurePoll_DMA(&bmp280) == BMP280_ASYNC_BUSY) {
+#if BMP280_I2C_IT
+        (void)ulTaskNotifyTake(pdTRUE, 1);
+#else
+        osDelay(1); // let other tasks run while I2C1 transfer is in flight
+#endif
+      }
+    }
+#if BMP280_I2C_IT
+    bmp280.waitingTask = NULL;
+#endif
+    sample = BMP280_MeasureCompleteInt_DMA(&bmp280);
+#endif
+    PROFILER_END(PROFILER_STATUS_MEASURE);
+#if !STATUS_FORCED_PERIOD_MS
+    if (!BMP280_NormalUpdate(&bmp280)) {
+      continue; // duplicate or failed read, print new samples only
+    }
+#endif
+    if (!(sample.flags & BMP280_RESULT_VALID)) {
+      continue; // bus error or stale sample, no pressure to convert
+    }
+    // Q24.8 pressure straight from the integer compensation
+    PROFILER_BEGIN(PROFILER_ALTITUDE_FIXED);
+    int32_t altitude_cm =
+        BMP280_AltitudeInt(&bmp280_altitude, sample.Pressure);
+    PROFILER_END(PROFILER_ALTITUDE_FIXED);
+#if PROFILER_ENABLED
+    // soft float cost for comparison only, result unused
+    PROFILER_BEGIN(PROFILER_ALTITUDE_FLOAT);
+    volatile float altitudeFloat_cm =
+        BMP280_AltitudeFloat(sample.Pressure, STATUS_ALTITUDE_REFERENCE);
+    PROFILER_END(PROFILER_ALTITUDE_FLOAT);
+    (void)altitudeFloat_cm;
+#endif
+    bmp280_result = BMP280_ResultToFloat(&sample);
 
     if (osMutexAcquire(USART2TxMutexHandle, osWaitForever) == osOK) {
+      PROFILER_BEGIN(PROFILER_USART2_MUTEX);
       // printf("Pressure\tTemperature\r\n");
-      printf("%0.2f hPa\r\n%0.2f deg C\r\n",
+      PROFILER_BEGIN(PROFILER_STATUS_PRINTF);
+      printf("%0.2f hPa\r\n%0.2f deg C\r\n%ld cm\r\n",
              bmp280_result.Pressure / 100,
-             bmp280_result.Temperature);
+             bmp280_result.Temperature,
+             (long)altitude_cm);
+      PROFILER_END(PROFILER_STATUS_PRINTF);
+      PROFILER_END(PROFILER_USART2_MUTEX);
+#if PROFILER_ENABLED
+      StatusProfilerCommand();
+#endif
       osMutexRelease(USART2TxMutexHandle);
     }
-    osDelay(50);
   }
   /* USER CODE END vStatusTask */
 }
@@ -206,5 +352,214 @@ void vLedTask(void *argument) {
 
 /* Private application code --------------------------------------------------*/
 /* USER CODE BEGIN Application */
+#if STATUS_PAIR
+/**
+ * @brief Status task loop of two sensors, each one is read while the other
+ * one converts
+ */
+static void StatusPairRun(void) {
+  static const uint8_t addresses[2] = {BMP280_DEVICE_ADDRESS_GND,
+                                       BMP280_DEVICE_ADDRESS_VDDIO};
+  struct BMP280_Device *sensors[2] = {&bmp280, &bmp280Second};
+  struct BMP280_PairSample sample;
+  struct BMP280_PairReport report;
+
+  for (uint8_t i = 0; i < 2; i++) {
+    if (!BMP280_InitWarm_I2C(sensors[i],
+                             BMP280_VAL_CTRL_MEAS_OSRS_T_16,
+                             BMP280_VAL_CTRL_MEAS_OSRS_P_16,
+                             BMP280_VAL_CTRL_MEAS_MODE_FORCED,
+                             BMP280_VAL_CTRL_CONFIG_T_SB_0_5,
+                             BMP280_VAL_CTRL_CONFIG_FILTER_0,
+                             &hi2c1,
+                             addresses[i],
+                             STATUS_SNAPSHOT_SLOT + i)) {
+      // the pair sequence needs both sensors
+      printf("Sensor %u setup failed\r\n", i);
+      osThreadSuspend(osThreadGetId());
+    }
+    BMP280_HealthPeriodSet(sensors[i], STATUS_HEALTH_PERIOD_MS);
+  }
+  BMP280_PairStart(&bmp280Pair, &bmp280, &bmp280Second);
+
+  while (true) {
+    sample = BMP280_PairMeasure(&bmp280Pair);
+
+    if (osMutexAcquire(USART2TxMutexHandle, osWaitForever) != osOK) {
+      continue;
+    }
+    for (uint8_t i = 0; i < 2; i++) {
+      bmp280_result = BMP280_ResultToFloat(&sample.result[i]);
+      printf("%lu ms %u: %0.2f hPa %0.2f deg C\r\n",
+             (unsigned long)sample.tick_ms[i], i,
+             bmp280_result.Pressure / 100, bmp280_result.Temperature);
+    }
+    if (bmp280Pair.pairs % STATUS_PAIR_REPORT == 0) {
+      BMP280_PairReportGet(&bmp280Pair, &report);
+      printf("%lu pairs, %lu errors, skew %lu ms: %lu mHz, "
+             "limit %lu mHz, sequential %lu mHz\r\n",
+             (unsigned long)report.pairs, (unsigned long)report.errors,
+             (unsigned long)report.maxSkew_ms,
+             (unsigned long)report.rate_mHz,
+             (unsigned long)report.pipelined_mHz,
+             (unsigned long)report.sequential_mHz);
+    }
+    osMutexRelease(USART2TxMutexHandle);
+  }
+}
+#endif
+
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c) {
+  BMP280_I2C_MemRxCpltCallback(hi2c);
+}
+
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c) {
+  BMP280_I2C_MemTxCpltCallback(hi2c);
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
+  BMP280_I2C_ErrorCallback(hi2c);
+}
+
+#ifdef HAL_SPI_MODULE_ENABLED
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi) {
+  BMP280_SPI_TxRxCpltCallback(hspi);
+}
+
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi) {
+  BMP280_SPI_ErrorCallback(hspi);
+}
+#endif
+
+#if STATUS_ARRAY
+/**
+ * @brief Status task loop of four sensors on two buses, the latest sample
+ * of each is printed with the array throughput
+ */
+static void StatusArrayRun(void) {
+  static I2C_HandleTypeDef *const buses[2] = {&hi2c1, &hi2c2};
+  static const uint8_t addresses[2] = {BMP280_DEVICE_ADDRESS_GND,
+                                       BMP280_DEVICE_ADDRESS_VDDIO};
+  struct BMP280_Device *sensors[4];
+  struct BMP280_ResultInt latest[4] = {0};
+  struct BMP280_ArraySample sample;
+  uint32_t elapsed_ms;
+
+  for (uint8_t i = 0; i < 4; i++) {
+    sensors[i] = &bmp280Sensors[i];
+    // x1/x4 standard resolution, about 80 Hz per sensor
+    if (!BMP280_InitWarm_I2C(sensors[i],
+                             BMP280_VAL_CTRL_MEAS_OSRS_T_1,
+                             BMP280_VAL_CTRL_MEAS_OSRS_P_4,
+                             BMP280_VAL_CTRL_MEAS_MODE_NORMAL,
+                             BMP280_VAL_CTRL_CONFIG_T_SB_0_5,
+                             BMP280_VAL_CTRL_CONFIG_FILTER_0,
+                             buses[i / 2],
+                             addresses[i % 2],
+                             i)) {
+      printf("Sensor %u setup failed\r\n", i);
+      osThreadSuspend(osThreadGetId());
+    }
+  }
+  if (!BMP280_ArrayStart(&bmp280Array, sensors, 4)) {
+    printf("Sensor array setup failed\r\n");
+    osThreadSuspend(osThreadGetId());
+  }
+
+  while (true) {
+    sample = BMP280_ArrayNext(&bmp280Array);
+    latest[sample.sensor] = sample.result;
+    if (bmp280Array.samples % STATUS_ARRAY_REPORT != 0 ||
+        osMutexAcquire(USART2TxMutexHandle, osWaitForever) != osOK) {
+      continue;
+    }
+    elapsed_ms = HAL_GetTick() - bmp280Array.startTick;
+    printf("%lu samples in %lu ms, %lu errors, %lu overlapped\r\n",
+           (unsigned long)bmp280Array.samples, (unsigned long)elapsed_ms,
+           (unsigned long)bmp280Array.errors,
+           (unsigned long)bmp280Array.overlapped);
+    for (uint8_t i = 0; i < 4; i++) {
+      bmp280_result = BMP280_ResultToFloat(&latest[i]);
+      printf("%u: %0.2f hPa %0.2f deg C\r\n", i,
+             bmp280_result.Pressure / 100, bmp280_result.Temperature);
+    }
+    osMutexRelease(USART2TxMutexHandle);
+  }
+}
+#endif
+
+#if STATUS_DECIMATION
+/**
+ * @brief Status task loop of one sensor sampled fast at low resolution and
+ * decimated to a slow low-noise stream, spikes removed before
+ */
+static void StatusDecimationRun(void) {
+  struct BMP280_ResultInt sample;
+  struct BMP280_ResultInt cleaned;
+  struct BMP280_ResultInt filtered;
+  bool clean;
+
+  // x1/x1 ultra low power, 0.5 ms standby: about 150 Hz
+  if (!BMP280_InitWarm_I2C(&bmp280,
+                           BMP280_VAL_CTRL_MEAS_OSRS_T_1,
+                           BMP280_VAL_CTRL_MEAS_OSRS_P_1,
+                           BMP280_VAL_CTRL_MEAS_MODE_NORMAL,
+                           BMP280_VAL_CTRL_CONFIG_T_SB_0_5,
+                           BMP280_VAL_CTRL_CONFIG_FILTER_0,
+                           &hi2c1,
+                           BMP280_DEVICE_ADDRESS_GND,
+                           STATUS_SNAPSHOT_SLOT)) {
+    printf("Sensor 0 setup failed\r\n");
+    osThreadSuspend(osThreadGetId());
+  }
+  BMP280_MedianInit(&bmp280Median, STATUS_MEDIAN_WINDOW,
+                    STATUS_MEDIAN_THRESHOLD_T, STATUS_MEDIAN_THRESHOLD_P);
+  BMP280_DecimatorInit(&bmp280Decimator, STATUS_DECIMATION_ORDER,
+                       STATUS_DECIMATION);
+
+  while (true) {
+    sample = BMP280_MeasureNormalInt_I2C(&bmp280);
+    PROFILER_BEGIN(PROFILER_STATUS_MEDIAN);
+    clean = BMP280_MedianPush(&bmp280Median, &sample, &cleaned);
+    PROFILER_END(PROFILER_STATUS_MEDIAN);
+    if (!clean ||
+        !BMP280_DecimatorPush(&bmp280Decimator, &cleaned, &filtered) ||
+        osMutexAcquire(USART2TxMutexHandle, osWaitForever) != osOK) {
+      continue;
+    }
+    bmp280_result = BMP280_ResultToFloat(&filtered);
+    printf("%0.2f hPa %0.2f deg C, %lu in, %lu skipped, %lu replaced\r\n",
+           bmp280_result.Pressure / 100, bmp280_result.Temperature,
+           (unsigned long)bmp280Decimator.inputs,
+           (unsigned long)(bmp280Decimator.skipped + bmp280Median.skipped),
+           (unsigned long)bmp280Median.replaced);
+#if PROFILER_ENABLED
+    StatusProfilerCommand();
+#endif
+    osMutexRelease(USART2TxMutexHandle);
+  }
+}
+#endif
+
+#if PROFILER_ENABLED
+/**
+ * @brief 'p' received on USART2 dumps probe statistics, 'r' clears them,
+ * called with USART2TxMutex held
+ */
+static void StatusProfilerCommand(void) {
+  if (USART2->SR & USART_SR_RXNE) {
+    switch (USART2->DR & 0xFF) {
+    case 'p':
+      Profiler_Dump();
+      break;
+    case 'r':
+      Profiler_Reset();
+      break;
+    default:
+      break;
+    }
+  }
+}
+#endif
 
 /* USER CODE END Application */
@@ -0,0 +1,151 @@
+/**
+ * @file bmp280_altitude_check.c
+ * @brief Certify error bound of BMP280_AltitudeInt() and time it
+ *
+ * Every Q24.8 pressure of 300..1100 hPa is run through the fixed-point
+ * altitude and compared with the barometric formula in double precision,
+ * for references at both ends of the range and at standard sea level.
+ * The check fails when an error exceeds BMP280_ALTITUDE_MAX_ERROR_CM. The
+ * powf() version is measured the same way.
+ *
+ * Host timings compare the integer code with powf() on a hardware FPU;
+ * on the FPU-less Cortex-M3 powf() runs in soft float, enable
+ * PROFILER_ENABLED to get both in cycles from the status task.
+ *
+ * Usage:
+ *   bmp280_altitude_check             sweep the default references
+ *   bmp280_altitude_check HPA ..      sweep given references
+ */
+
+#include "BMP280_Altitude.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/** Sensor range, Q24.8 Pa */
+#define CHECK_P_MIN (30000U << 8)
+#define CHECK_P_MAX (110000U << 8)
+#define CHECK_REFERENCES 4
+#define BENCH_SAMPLES 65536
+#define BENCH_REPEATS 50
+
+static const double defaultReference_hPa[CHECK_REFERENCES] = {300.0, 900.0,
+                                                              1013.25, 1100.0};
+
+static double Check_Exact(uint32_t pressure, uint32_t reference) {
+  return BMP280_ALTITUDE_SCALE_CM *
+         (1.0 - pow((double)pressure / reference, BMP280_ALTITUDE_EXPONENT));
+}
+
+static double Check_Now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Largest errors over the whole pressure range for one reference
+ */
+static int Check_Reference(double reference_hPa) {
+  struct BMP280_Altitude alt;
+  uint32_t reference = (uint32_t)(reference_hPa * 100 * 256 + 0.5);
+  double maxInt = 0.0;
+  double maxFloat = 0.0;
+  uint32_t worst = CHECK_P_MIN;
+
+  BMP280_AltitudeReferenceSet(&alt, reference);
+  for (uint32_t p = CHECK_P_MIN; p <= CHECK_P_MAX; p++) {
+    double exact = Check_Exact(p, reference);
+    double errInt = fabs(BMP280_AltitudeInt(&alt, p) - exact);
+
+    if (errInt > maxInt) {
+      maxInt = errInt;
+      worst = p;
+    }
+    // float error changes slowly, every 61st pressure is enough
+    if (p % 61 == 0) {
+      double errFloat = fabs(BMP280_AltitudeFloat(p, reference) - exact);
+
+      if (errFloat > maxFloat) {
+        maxFloat = errFloat;
+      }
+    }
+  }
+
+  printf("%9.2f %12.3f %12.2f %12.3f\n", reference_hPa, maxInt,
+         worst / 25600.0, maxFloat);
+  if (maxInt > BMP280_ALTITUDE_MAX_ERROR_CM) {
+    printf("FAIL reference %.2f hPa: %.3f cm over bound %d cm\n",
+           reference_hPa, maxInt, BMP280_ALTITUDE_MAX_ERROR_CM);
+    return 1;
+  }
+  return 0;
+}
+
+static volatile int64_t benchSink;
+
+/**
+ * Best time of BENCH_REPEATS runs over pressures spread across the range
+ */
+static void Check_Bench(void) {
+  static uint32_t pressure[BENCH_SAMPLES];
+  struct BMP280_Altitude alt;
+  double bestInt = 1e9;
+  double bestFloat = 1e9;
+
+  BMP280_AltitudeReferenceSet(&alt, BMP280_ALTITUDE_STANDARD_REFERENCE);
+  for (uint32_t i = 0; i < BENCH_SAMPLES; i++) {
+    pressure[i] = CHECK_P_MIN + (uint32_t)((uint64_t)i * 2654435761U %
+                                           (CHECK_P_MAX - CHECK_P_MIN));
+  }
+
+  for (int run = 0; run < BENCH_REPEATS; run++) {
+    int64_t sum = 0;
+    double start = Check_Now();
+    double elapsed;
+
+    for (uint32_t i = 0; i < BENCH_SAMPLES; i++) {
+      sum += BMP280_AltitudeInt(&alt, pressure[i]);
+    }
+    elapsed = Check_Now() - start;
+    bestInt = elapsed < bestInt ? elapsed : bestInt;
+
+    start = Check_Now();
+    for (uint32_t i = 0; i < BENCH_SAMPLES; i++) {
+      sum += (int64_t)BMP280_AltitudeFloat(
+          pressure[i], BMP280_ALTITUDE_STANDARD_REFERENCE);
+    }
+    elapsed = Check_Now() - start;
+    bestFloat = elapsed < bestFloat ? elapsed : bestFloat;
+    benchSink = sum;
+  }
+
+  printf("host ns/sample: fixed point %.1f, powf %.1f\n",
+         bestInt * 1e9 / BENCH_SAMPLES, bestFloat * 1e9 / BENCH_SAMPLES);
+}
+
+int main(int argc, char **argv) {
+  int failures = 0;
+
+  printf("max error in cm over 300..1100 hPa\n");
+  printf("%9s %12s %12s %12s\n", "ref hPa", "fixed", "at hPa", "powf");
+  if (argc > 1) {
+    for (int i = 1; i < argc; i++) {
+      failures += Check_Reference(atof(argv[i]));
+    }
+  } else {
+    for (int i = 0; i < CHECK_REFERENCES; i++) {
+      failures += Check_Reference(defaultReference_hPa[i]);
+    }
+  }
+  Check_Bench();
+
+  if (failures != 0) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
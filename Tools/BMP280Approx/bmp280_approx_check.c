@@ -0,0 +1,301 @@
+/**
+ * @file bmp280_approx_check.c
+ * @brief Certify error bound of BMP280_calculate_P_approx()
+ *
+ * For one t_fine both pressure formulas are linear in x = 2^20 - adc_P up
+ * to roundings before their final correction step:
+ * - 64-bit formula: p = floor(((x << 31) - A) * 3125 / D)
+ * - approximation: p = floor((1024 * x - c) * W / 2^(shift + 7)) / 8
+ * A, D, c and W depend on t_fine only and are computed here exactly as the
+ * firmware does. The difference of two linear functions is largest at the
+ * ends of the x range, roundings of the correction step are bounded term by
+ * term. Every integer t_fine of BMP280_P_APPROX_T_FINE_MIN..MAX (-40..85
+ * degC) is enumerated, so the bound holds for the whole adc_P range within
+ * it. Outside it the firmware uses the 64-bit formula; a sweep over the
+ * rest of the t_fine range reachable by 20-bit adc_T checks that the
+ * result there is exact.
+ *
+ * Usage:
+ *   bmp280_approx_check                   datasheet calibration
+ *   bmp280_approx_check T1 T2 T3 P1 .. P9 own calibration words
+ *   bmp280_approx_check -r N              N random calibration sets
+ */
+
+#include "BMP280_Compensation.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHECK_T_FINE_MIN BMP280_P_APPROX_T_FINE_MIN
+#define CHECK_T_FINE_MAX BMP280_P_APPROX_T_FINE_MAX
+/** Temperature bands of error table, 0.01 degC */
+#define CHECK_BANDS 5
+/** Spacing of measured sweep */
+#define CHECK_SWEEP_T 61
+#define CHECK_SWEEP_ADC 53
+#define CHECK_SWEEP_OUTSIDE 853
+/** adc_P of 1100 and 300 hPa for datasheet calibration, 32-bit formula
+    column is measured in this range only */
+#define CHECK_ADC_P_MIN 330000
+#define CHECK_ADC_P_MAX 820000
+
+static const struct BMP280_Calibration datasheetCalib = {
+    27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600,
+    6000};
+
+static const int32_t bandLimit[CHECK_BANDS + 1] = {-4000, -1500, 1000,
+                                                   3500,  6000,  8500};
+
+typedef struct CheckBand {
+  double bound;   /**< Certified error of approximation, LSB */
+  int32_t approx; /**< Measured error of approximation, LSB */
+  int32_t int32;  /**< Measured error of 32-bit formula, LSB */
+  long fallback;  /**< t_fine values handled by 64-bit formula */
+} CheckBand;
+
+static uint32_t checkSeed = 0x9E3779B9u;
+
+static uint32_t Check_Random(void) {
+  checkSeed ^= checkSeed << 13;
+  checkSeed ^= checkSeed >> 17;
+  checkSeed ^= checkSeed << 5;
+  return checkSeed;
+}
+
+static int16_t Check_RandomWord(int16_t nominal, int16_t spread) {
+  return (int16_t)(nominal + (int32_t)(Check_Random() % (2u * spread + 1u)) -
+                   spread);
+}
+
+static int Check_Band(int32_t t_fine) {
+  int32_t T = (t_fine * 5 + 128) >> 8;
+  int band = 0;
+  while (band < CHECK_BANDS - 1 && T >= bandLimit[band + 1]) {
+    band++;
+  }
+  return band;
+}
+
+/* Certified bound for one t_fine, negative if 64-bit formula is used */
+static double Check_Bound(const struct BMP280_Calibration *calib,
+                          const struct BMP280_CalibrationDerived *derived,
+                          int32_t t_fine) {
+  // 64-bit formula terms
+  int64_t v = (int64_t)t_fine - 128000;
+  int64_t A = v * v * calib->dig_P6 + v * derived->P5_s17 + derived->P4_s35;
+  int64_t D = ((v * v * calib->dig_P3) >> 8) + v * derived->P2_s12;
+  D = ((((int64_t)1) << 47) + D) * calib->dig_P1 >> 33;
+
+  // approximation terms, same steps as BMP280_calculate_P_approx()
+  int32_t var1 = t_fine - 128000;
+  int32_t var1sq = (int32_t)(((int64_t)var1 * var1) >> 15);
+  uint32_t d = (1u << 30) + (int32_t)(((int64_t)var1 * calib->dig_P2) >> 5) +
+               (int32_t)(((int64_t)var1sq * calib->dig_P3) >> 10);
+  if (derived->P1_inv == 0 || d - (3u << 28) >= (3u << 28) || D <= 0) {
+    return -1.0;
+  }
+  uint32_t r = (0xFFFFFFFFu / (d >> 15)) << 13;
+  r = (uint32_t)(((uint64_t)r *
+                  ((2u << 30) - (uint32_t)(((uint64_t)d * r) >> 30))) >>
+                 30);
+  r = (uint32_t)(((uint64_t)r * (uint32_t)derived->P1_inv) >> 30);
+  int32_t c = derived->P4_s14 +
+              (int32_t)(((int64_t)var1 * calib->dig_P5) >> 4) +
+              (int32_t)(((int64_t)var1sq * calib->dig_P6) >> 6);
+
+  // unrounded pressures before correction step, LSB of Q24.8
+  long double scale = ldexpl((long double)r, -(derived->P1_inv_shift + 10));
+  long double slope_a = 1024.0L * scale;
+  long double slope_r = 3125.0L * 2147483648.0L / (256.0L * (long double)D);
+  long double offset_a = (long double)c * scale;
+  long double offset_r = 3125.0L * (long double)A / (256.0L * (long double)D);
+  long double delta = 0.0L, y = 0.0L;
+  const long double x_end[2] = {1.0L, 1048576.0L};
+  for (int i = 0; i < 2; i++) {
+    long double y_a = x_end[i] * slope_a - offset_a;
+    long double y_r = x_end[i] * slope_r - offset_r;
+    delta = fmaxl(delta, fabsl(y_a - y_r));
+    y = fmaxl(y, fmaxl(fabsl(y_a), fabsl(y_r)));
+    // intermediate u and p of approximation have to fit int32
+    if (fabsl(1024.0L * x_end[i] - c) >= 2147483648.0L ||
+        fabsl(y_a) * 8.0L + 2.0L * (1 << 29) >= 2147483648.0L) {
+      return INFINITY;
+    }
+  }
+
+  // difference of pressures after their own roundings
+  double alpha = (double)delta + 1.0 / 8 + 1.0 / 256 + 1e-9;
+  // p >> 13 terms differ by at most one step unless alpha reaches 32
+  double q = (double)y / 32 + 1;
+  double P8 = abs(calib->dig_P8), P9 = abs(calib->dig_P9);
+  double var1_diff = P9 * ceil(alpha / 32) * (2 * q + ceil(alpha / 32)) /
+                         8589934592.0 +
+                     P9 / 524288.0 + 1.0 / 8 + 1.0 / 256;
+  double var2_diff = P8 * alpha / 524288.0 + 1.0 / 8 + 1.0 / 256;
+  return alpha + var1_diff + var2_diff;
+}
+
+/* Certify one calibration set and fill error table, returns bound in LSB */
+static int32_t Check_Calibration(const struct BMP280_Calibration *calib,
+                                 CheckBand *band) {
+  struct BMP280_CalibrationDerived derived;
+  double worst = 0.0;
+
+  BMP280_CalibrationDerive(calib, &derived);
+  for (int b = 0; b < CHECK_BANDS; b++) {
+    band[b] = (CheckBand){0};
+  }
+
+  for (int32_t t_fine = CHECK_T_FINE_MIN; t_fine <= CHECK_T_FINE_MAX;
+       t_fine++) {
+    CheckBand *current = &band[Check_Band(t_fine)];
+    double bound = Check_Bound(calib, &derived, t_fine);
+    if (bound < 0.0) {
+      current->fallback++;
+      continue;
+    }
+    current->bound = fmax(current->bound, bound);
+    worst = fmax(worst, bound);
+  }
+
+  // measured errors on a grid, must stay within certified bound
+  for (int32_t t_fine = CHECK_T_FINE_MIN; t_fine <= CHECK_T_FINE_MAX;
+       t_fine += CHECK_SWEEP_T) {
+    CheckBand *current = &band[Check_Band(t_fine)];
+    for (int32_t adc_P = 0; adc_P < 1048576; adc_P += CHECK_SWEEP_ADC) {
+      uint32_t reference =
+          BMP280_calculate_P_int64(calib, &derived, t_fine, adc_P);
+      int32_t error = abs((int32_t)(
+          BMP280_calculate_P_approx(calib, &derived, t_fine, adc_P) -
+          reference));
+      if (error > current->approx) {
+        current->approx = error;
+      }
+      if (adc_P >= CHECK_ADC_P_MIN && adc_P <= CHECK_ADC_P_MAX) {
+        error = abs((int32_t)(
+            (BMP280_calculate_P_int32(calib, &derived, t_fine, adc_P) << 8) -
+            reference));
+        if (error > current->int32) {
+          current->int32 = error;
+        }
+      }
+    }
+  }
+
+  // |difference| < bound + 1 and is an integer
+  return isinf(worst) ? INT32_MAX : (int32_t)ceil(worst);
+}
+
+/* Outside the certified t_fine range the 64-bit formula has to be used,
+   returns the number of differing results */
+static long Check_Outside(const struct BMP280_Calibration *calib,
+                          int32_t *reachMin,
+                          int32_t *reachMax) {
+  struct BMP280_CalibrationDerived derived;
+  long wrong = 0;
+
+  BMP280_CalibrationDerive(calib, &derived);
+  *reachMin = INT32_MAX;
+  *reachMax = INT32_MIN;
+  for (int32_t adc_T = 0; adc_T < 1048576; adc_T++) {
+    int32_t t_fine;
+    (void)BMP280_calculate_T_int32(calib, &derived, adc_T, &t_fine);
+    *reachMin = t_fine < *reachMin ? t_fine : *reachMin;
+    *reachMax = t_fine > *reachMax ? t_fine : *reachMax;
+  }
+
+  for (int32_t t_fine = *reachMin; t_fine <= *reachMax;
+       t_fine += CHECK_SWEEP_T) {
+    if (t_fine >= CHECK_T_FINE_MIN && t_fine <= CHECK_T_FINE_MAX) {
+      t_fine = CHECK_T_FINE_MAX + 1;
+    }
+    for (int32_t adc_P = 0; adc_P < 1048576; adc_P += CHECK_SWEEP_OUTSIDE) {
+      wrong += BMP280_calculate_P_approx(calib, &derived, t_fine, adc_P) !=
+               BMP280_calculate_P_int64(calib, &derived, t_fine, adc_P);
+    }
+  }
+  return wrong;
+}
+
+static void Check_Print(const CheckBand *band) {
+  printf("  band [degC]    int64  int32 (measured)   approx (certified/measured)"
+         "  fallback\n");
+  for (int b = 0; b < CHECK_BANDS; b++) {
+    printf("  %4d..%-4d %8d %8d LSB %7.2f Pa %5.0f / %-3d LSB %7.3f Pa %6ld\n",
+           bandLimit[b] / 100, bandLimit[b + 1] / 100, 0, band[b].int32,
+           band[b].int32 / 256.0, ceil(band[b].bound), band[b].approx,
+           ceil(band[b].bound) / 256.0, band[b].fallback);
+  }
+}
+
+int main(int argc, char **argv) {
+  struct BMP280_Calibration calib = datasheetCalib;
+  CheckBand band[CHECK_BANDS];
+  int sets = 1;
+  int failed = 0;
+
+  if (argc == 3 && argv[1][0] == '-' && argv[1][1] == 'r') {
+    sets = atoi(argv[2]);
+  } else if (argc == 13) {
+    int16_t *word = &calib.dig_T2;
+    calib.dig_T1 = (uint16_t)strtol(argv[1], NULL, 0);
+    word[0] = (int16_t)strtol(argv[2], NULL, 0);
+    word[1] = (int16_t)strtol(argv[3], NULL, 0);
+    calib.dig_P1 = (uint16_t)strtol(argv[4], NULL, 0);
+    for (int i = 5; i < 13; i++) {
+      (&calib.dig_P2)[i - 5] = (int16_t)strtol(argv[i], NULL, 0);
+    }
+  } else if (argc != 1) {
+    fprintf(stderr, "usage: %s [-r N | T1 T2 T3 P1 .. P9]\n", argv[0]);
+    return 2;
+  }
+
+  int32_t worst = 0;
+  for (int s = 0; s < sets; s++) {
+    if (s > 0) {
+      calib.dig_T1 = (uint16_t)(27504 + Check_Random() % 4000 - 2000);
+      calib.dig_T2 = Check_RandomWord(26435, 2000);
+      calib.dig_T3 = Check_RandomWord(-1000, 500);
+      calib.dig_P1 = (uint16_t)(36477 + Check_Random() % 6000 - 3000);
+      calib.dig_P2 = Check_RandomWord(-10685, 1000);
+      calib.dig_P3 = Check_RandomWord(3024, 500);
+      calib.dig_P4 = Check_RandomWord(2855, 2000);
+      calib.dig_P5 = Check_RandomWord(140, 200);
+      calib.dig_P6 = Check_RandomWord(-7, 10);
+      calib.dig_P7 = Check_RandomWord(15500, 500);
+      calib.dig_P8 = Check_RandomWord(-14600, 1000);
+      calib.dig_P9 = Check_RandomWord(6000, 1000);
+    }
+    int32_t bound = Check_Calibration(&calib, band);
+    int32_t reachMin, reachMax;
+    long outside = Check_Outside(&calib, &reachMin, &reachMax);
+    for (int b = 0; b < CHECK_BANDS; b++) {
+      if (band[b].approx > bound) {
+        failed = 1;
+      }
+    }
+    if (outside != 0) {
+      printf("calibration %d: %ld results outside t_fine %d..%d differ from "
+             "64-bit formula\n",
+             s, outside, CHECK_T_FINE_MIN, CHECK_T_FINE_MAX);
+      failed = 1;
+    }
+    if (bound > worst) {
+      worst = bound;
+    }
+    if (s == 0 || bound > BMP280_P_APPROX_ERROR) {
+      printf("calibration %d: certified error %d LSB (%.4f Pa), reachable "
+             "t_fine %d..%d exact outside %d..%d\n",
+             s, bound, bound / 256.0, reachMin, reachMax, CHECK_T_FINE_MIN,
+             CHECK_T_FINE_MAX);
+      Check_Print(band);
+    }
+  }
+  printf("worst certified error over %d set(s): %d LSB, limit %d\n", sets,
+         worst, BMP280_P_APPROX_ERROR);
+  if (worst > BMP280_P_APPROX_ERROR || failed) {
+    printf("FAILED\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,262 @@
+/**
+ * @file bmp280_batch.c
+ * @brief Host-side batch compensation of archived BMP280 raw samples
+ *
+ * Temperature is computed in 32-bit lanes, pressure in 64-bit lanes. x86
+ * has no packed 64-bit multiply or arithmetic shift before AVX-512, both
+ * are emulated with 32-bit operations. The 64-bit division is done per lane
+ * by scalar code.
+ */
+
+#include "bmp280_batch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BMP280_BATCH_X86 1
+#else
+#define BMP280_BATCH_X86 0
+#endif
+
+/** Samples compensated per block, t_fine of one block is kept on stack */
+#define BMP280_BATCH_BLOCK 256
+
+/************* SCALAR **************************/
+
+static void BMP280_Batch_T_Scalar(const struct BMP280_Calibration *calib,
+                                  const struct BMP280_CalibrationDerived *derived,
+                                  const int32_t *adc_T,
+                                  int32_t *temperature,
+                                  int32_t *t_fine,
+                                  size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    temperature[i] =
+        BMP280_calculate_T_int32(calib, derived, adc_T[i], &t_fine[i]);
+  }
+}
+
+static void BMP280_Batch_P_Scalar(const struct BMP280_Calibration *calib,
+                                  const struct BMP280_CalibrationDerived *derived,
+                                  const int32_t *t_fine,
+                                  const int32_t *adc_P,
+                                  uint32_t *pressure,
+                                  size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    pressure[i] = BMP280_calculate_P_int64(calib, derived, t_fine[i], adc_P[i]);
+  }
+}
+
+/* Division step of the 64-bit formula, zero denominator lanes are left for
+   callers to mask */
+static void BMP280_Batch_Divide(int64_t *numerator,
+                                const int64_t *denominator,
+                                int lanes) {
+  for (int i = 0; i < lanes; i++) {
+    if (denominator[i] != 0) {
+      numerator[i] /= denominator[i];
+    }
+  }
+}
+
+#if BMP280_BATCH_X86
+
+/************* AVX2 **************************/
+
+__attribute__((target("avx2"))) static inline __m256i
+BMP280_Batch_Sign64_AVX2(__m256i a) {
+  return _mm256_srai_epi32(_mm256_shuffle_epi32(a, _MM_SHUFFLE(3, 3, 1, 1)),
+                           31);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+BMP280_Batch_Sra64_AVX2(__m256i a, int shift) {
+  return _mm256_or_si256(_mm256_srl_epi64(a, _mm_cvtsi32_si128(shift)),
+                         _mm256_sll_epi64(BMP280_Batch_Sign64_AVX2(a),
+                                          _mm_cvtsi32_si128(64 - shift)));
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+BMP280_Batch_Mul64_AVX2(__m256i a, __m256i b) {
+  __m256i cross =
+      _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+                       _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+  return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32));
+}
+
+/* Multiply by broadcast 32-bit signed constant, one cross product less */
+__attribute__((target("avx2"))) static inline __m256i
+BMP280_Batch_MulC64_AVX2(__m256i a, __m256i c) {
+  __m256i cross =
+      _mm256_sub_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), c),
+                       _mm256_and_si256(a, BMP280_Batch_Sign64_AVX2(c)));
+  return _mm256_add_epi64(_mm256_mul_epu32(a, c), _mm256_slli_epi64(cross, 32));
+}
+
+__attribute__((target("avx2"))) static void
+BMP280_Batch_T_AVX2(const struct BMP280_Calibration *calib,
+                    const struct BMP280_CalibrationDerived *derived,
+                    const int32_t *adc_T,
+                    int32_t *temperature,
+                    int32_t *t_fine,
+                    size_t count) {
+  const __m256i T1 = _mm256_set1_epi32(calib->dig_T1);
+  const __m256i T1_s1 = _mm256_set1_epi32(derived->T1_s1);
+  const __m256i T2 = _mm256_set1_epi32(calib->dig_T2);
+  const __m256i T3 = _mm256_set1_epi32(calib->dig_T3);
+  const __m256i round = _mm256_set1_epi32(128);
+  size_t i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    __m256i adc = _mm256_loadu_si256((const __m256i *)&adc_T[i]);
+    __m256i var1 = _mm256_srai_epi32(
+        _mm256_mullo_epi32(_mm256_sub_epi32(_mm256_srai_epi32(adc, 3), T1_s1),
+                           T2),
+        11);
+    __m256i d = _mm256_sub_epi32(_mm256_srai_epi32(adc, 4), T1);
+    __m256i var2 = _mm256_srai_epi32(
+        _mm256_mullo_epi32(_mm256_srai_epi32(_mm256_mullo_epi32(d, d), 12), T3),
+        14);
+    __m256i fine = _mm256_add_epi32(var1, var2);
+    __m256i T = _mm256_srai_epi32(
+        _mm256_add_epi32(
+            _mm256_add_epi32(_mm256_slli_epi32(fine, 2), fine), round),
+        8);
+    _mm256_storeu_si256((__m256i *)&t_fine[i], fine);
+    _mm256_storeu_si256((__m256i *)&temperature[i], T);
+  }
+  BMP280_Batch_T_Scalar(calib, derived, &adc_T[i], &temperature[i],
+                        &t_fine[i], count - i);
+}
+
+__attribute__((target("avx2"))) static void
+BMP280_Batch_P_AVX2(const struct BMP280_Calibration *calib,
+                    const struct BMP280_CalibrationDerived *derived,
+                    const int32_t *t_fine,
+                    const int32_t *adc_P,
+                    uint32_t *pressure,
+                    size_t count) {
+  const __m256i P1 = _mm256_set1_epi64x(calib->dig_P1);
+  const __m256i P2_s12 = _mm256_set1_epi64x(derived->P2_s12);
+  const __m256i P3 = _mm256_set1_epi64x(calib->dig_P3);
+  const __m256i P4_s35 = _mm256_set1_epi64x(derived->P4_s35);
+  const __m256i P5 = _mm256_set1_epi64x(calib->dig_P5);
+  const __m256i P6 = _mm256_set1_epi64x(calib->dig_P6);
+  const __m256i P7_s4 = _mm256_set1_epi64x(derived->P7_s4);
+  const __m256i P8 = _mm256_set1_epi64x(calib->dig_P8);
+  const __m256i P9 = _mm256_set1_epi64x(calib->dig_P9);
+  const __m256i t_fine0 = _mm256_set1_epi64x(128000);
+  const __m256i p0 = _mm256_set1_epi64x(1048576);
+  const __m256i bias = _mm256_set1_epi64x((int64_t)1 << 47);
+  const __m256i scale = _mm256_set1_epi64x(3125);
+  const __m256i pack = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+  size_t i = 0;
+
+  for (; i + 4 <= count; i += 4) {
+    __m256i fine =
+        _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)&t_fine[i]));
+    __m256i adc =
+        _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)&adc_P[i]));
+    __m256i var1 = _mm256_sub_epi64(fine, t_fine0);
+    __m256i square = BMP280_Batch_Mul64_AVX2(var1, var1);
+    __m256i var2 = _mm256_add_epi64(
+        _mm256_add_epi64(
+            BMP280_Batch_MulC64_AVX2(square, P6),
+            _mm256_slli_epi64(BMP280_Batch_MulC64_AVX2(var1, P5), 17)),
+        P4_s35);
+    var1 = _mm256_add_epi64(
+        BMP280_Batch_Sra64_AVX2(BMP280_Batch_MulC64_AVX2(square, P3), 8),
+        BMP280_Batch_MulC64_AVX2(var1, P2_s12));
+    var1 = BMP280_Batch_Sra64_AVX2(
+        BMP280_Batch_MulC64_AVX2(_mm256_add_epi64(bias, var1), P1), 33);
+    __m256i p = _mm256_sub_epi64(p0, adc);
+    p = BMP280_Batch_MulC64_AVX2(
+        _mm256_sub_epi64(_mm256_slli_epi64(p, 31), var2), scale);
+
+    int64_t quotient[4], denominator[4];
+    _mm256_storeu_si256((__m256i *)quotient, p);
+    _mm256_storeu_si256((__m256i *)denominator, var1);
+    BMP280_Batch_Divide(quotient, denominator, 4);
+    __m256i q = _mm256_loadu_si256((const __m256i *)quotient);
+    // zero denominator lanes return 0 like the scalar formula
+    __m256i zero = _mm256_cmpeq_epi64(var1, _mm256_setzero_si256());
+
+    __m256i p_s13 = BMP280_Batch_Sra64_AVX2(q, 13);
+    var1 = BMP280_Batch_Sra64_AVX2(
+        BMP280_Batch_Mul64_AVX2(BMP280_Batch_MulC64_AVX2(p_s13, P9), p_s13), 25);
+    var2 = BMP280_Batch_Sra64_AVX2(BMP280_Batch_MulC64_AVX2(q, P8), 19);
+    p = _mm256_add_epi64(
+        BMP280_Batch_Sra64_AVX2(
+            _mm256_add_epi64(_mm256_add_epi64(q, var1), var2), 8),
+        P7_s4);
+    p = _mm256_andnot_si256(zero, p);
+    _mm_storeu_si128(
+        (__m128i *)&pressure[i],
+        _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(p, pack)));
+  }
+  BMP280_Batch_P_Scalar(calib, derived, &t_fine[i], &adc_P[i], &pressure[i],
+                        count - i);
+}
+
+#endif /* BMP280_BATCH_X86 */
+
+/************* DISPATCH **************************/
+
+BMP280_BatchKernel BMP280_Batch_KernelSelect(BMP280_BatchKernel kernel) {
+#if BMP280_BATCH_X86
+  __builtin_cpu_init();
+  bool avx2 = __builtin_cpu_supports("avx2");
+#else
+  bool avx2 = false;
+#endif
+  // two 64-bit lanes of SSE4.1 were slower than the scalar pressure
+  // formula, so there is no kernel between scalar and AVX2
+  if (kernel != BMP280_BATCH_SCALAR && !avx2) {
+    return BMP280_BATCH_SCALAR;
+  }
+  return avx2 && kernel == BMP280_BATCH_AUTO ? BMP280_BATCH_AVX2 : kernel;
+}
+
+const char *BMP280_Batch_KernelName(BMP280_BatchKernel kernel) {
+  switch (kernel) {
+  case BMP280_BATCH_SCALAR:
+    return "scalar";
+  case BMP280_BATCH_AVX2:
+    return "avx2";
+  default:
+    return "auto";
+  }
+}
+
+BMP280_BatchKernel
+BMP280_Batch_Compensate(const struct BMP280_Calibration *calib,
+                        const int32_t *adc_T,
+                        const int32_t *adc_P,
+                        int32_t *temperature,
+                        uint32_t *pressure,
+                        size_t count,
+                        BMP280_BatchKernel kernel) {
+  struct BMP280_CalibrationDerived derived;
+  int32_t t_fine[BMP280_BATCH_BLOCK];
+
+  kernel = BMP280_Batch_KernelSelect(kernel);
+  BMP280_CalibrationDerive(calib, &derived);
+
+  for (size_t i = 0; i < count; i += BMP280_BATCH_BLOCK) {
+    size_t n = count - i < BMP280_BATCH_BLOCK ? count - i : BMP280_BATCH_BLOCK;
+    switch (kernel) {
+#if BMP280_BATCH_X86
+    case BMP280_BATCH_AVX2:
+      BMP280_Batch_T_AVX2(calib, &derived, &adc_T[i], &temperature[i], t_fine,
+                          n);
+      BMP280_Batch_P_AVX2(calib, &derived, t_fine, &adc_P[i], &pressure[i], n);
+      break;
+#endif
+    default:
+      BMP280_Batch_T_Scalar(calib, &derived, &adc_T[i], &temperature[i],
+                            t_fine, n);
+      BMP280_Batch_P_Scalar(calib, &derived, t_fine, &adc_P[i], &pressure[i],
+                            n);
+      break;
+    }
+  }
+  return kernel;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file bmp280_batch.h
+ * @brief Host-side batch compensation of archived BMP280 raw samples
+ *
+ * Struct-of-arrays batches of raw adc_T/adc_P values are compensated with
+ * one calibration set. An AVX2 kernel is selected at run time, both
+ * kernels give results bit-identical to the firmware formulas in
+ * BMP280_Compensation.c (int32 temperature, int64 pressure).
+ */
+
+#pragma once
+
+#include "BMP280_Compensation.h"
+#include <stddef.h>
+
+/**
+ * @brief Batch compensation kernel
+ */
+typedef enum BMP280_BatchKernel {
+  BMP280_BATCH_AUTO = 0, /**< AVX2 if supported, scalar otherwise */
+  BMP280_BATCH_SCALAR,   /**< Firmware formulas, one sample at a time */
+  BMP280_BATCH_AVX2      /**< 8 temperature / 4 pressure lanes */
+} BMP280_BatchKernel;
+
+/**
+ * @brief Resolve kernel which will actually run on this CPU
+ * @param kernel Requested kernel, unsupported ones fall back to scalar
+ * @return Kernel used by BMP280_Batch_Compensate()
+ */
+BMP280_BatchKernel BMP280_Batch_KernelSelect(BMP280_BatchKernel kernel);
+
+/**
+ * @brief Printable kernel name
+ * @param kernel Kernel
+ * @return Name string
+ */
+const char *BMP280_Batch_KernelName(BMP280_BatchKernel kernel);
+
+/**
+ * @brief Compensate a batch of raw samples
+ *
+ * Every sample is compensated, skipped-channel markers (0x80000) are not
+ * filtered out. Output arrays may not overlap input arrays.
+ * @param calib Calibration constants of the sensor which took the samples
+ * @param adc_T Raw temperature values
+ * @param adc_P Raw pressure values
+ * @param temperature Output temperatures in 0.01 degC
+ * @param pressure Output pressures in Pa, Q24.8 format
+ * @param count Number of samples
+ * @param kernel Requested kernel
+ * @return Kernel which was used
+ */
+BMP280_BatchKernel
+BMP280_Batch_Compensate(const struct BMP280_Calibration *calib,
+                        const int32_t *adc_T,
+                        const int32_t *adc_P,
+                        int32_t *temperature,
+                        uint32_t *pressure,
+                        size_t count,
+                        BMP280_BatchKernel kernel);
+
+/* BMP280_BATCH_H_ */
@@ -0,0 +1,138 @@
+/**
+ * @file bmp280_batch_bench.c
+ * @brief Bit-exactness check and throughput of batch compensation kernels
+ *
+ * Usage: bmp280_batch_bench [samples]
+ */
+
+#include "bmp280_batch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_SAMPLES_DEFAULT (1u << 20)
+#define BENCH_REPEATS 25
+#define BENCH_CALIBRATIONS 64
+
+/* Datasheet example calibration */
+static const struct BMP280_Calibration datasheetCalib = {
+    27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600,
+    6000};
+
+static uint32_t benchSeed = 0x2545F491u;
+
+static uint32_t Bench_Random(void) {
+  benchSeed ^= benchSeed << 13;
+  benchSeed ^= benchSeed >> 17;
+  benchSeed ^= benchSeed << 5;
+  return benchSeed;
+}
+
+static int16_t Bench_RandomWord(int16_t nominal, int16_t spread) {
+  return (int16_t)(nominal + (int32_t)(Bench_Random() % (2u * spread + 1u)) -
+                   spread);
+}
+
+/* Calibration words scattered around datasheet example */
+static void Bench_RandomCalibration(struct BMP280_Calibration *calib) {
+  *calib = datasheetCalib;
+  calib->dig_T1 = (uint16_t)(27504 + Bench_Random() % 2000 - 1000);
+  calib->dig_T2 = Bench_RandomWord(26435, 1000);
+  calib->dig_T3 = Bench_RandomWord(-1000, 200);
+  calib->dig_P1 = (uint16_t)(36477 + Bench_Random() % 2000 - 1000);
+  calib->dig_P2 = Bench_RandomWord(-10685, 500);
+  calib->dig_P3 = Bench_RandomWord(3024, 200);
+  calib->dig_P4 = Bench_RandomWord(2855, 500);
+  calib->dig_P5 = Bench_RandomWord(140, 100);
+  calib->dig_P6 = Bench_RandomWord(-7, 5);
+  calib->dig_P7 = Bench_RandomWord(15500, 500);
+  calib->dig_P8 = Bench_RandomWord(-14600, 500);
+  calib->dig_P9 = Bench_RandomWord(6000, 500);
+}
+
+static double Bench_Now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+  size_t count = argc > 1 ? strtoul(argv[1], NULL, 0) : BENCH_SAMPLES_DEFAULT;
+  int32_t *adc_T = malloc(count * sizeof(*adc_T));
+  int32_t *adc_P = malloc(count * sizeof(*adc_P));
+  int32_t *refT = malloc(count * sizeof(*refT));
+  uint32_t *refP = malloc(count * sizeof(*refP));
+  int32_t *T = malloc(count * sizeof(*T));
+  uint32_t *P = malloc(count * sizeof(*P));
+  const BMP280_BatchKernel kernels[] = {
+      BMP280_BATCH_SCALAR, BMP280_BATCH_AVX2};
+  int failed = 0;
+
+  if (count == 0 || !adc_T || !adc_P || !refT || !refP || !T || !P) {
+    fprintf(stderr, "bad sample count\n");
+    return 2;
+  }
+  // full 20-bit ADC range, covers out of range divisions and overflows
+  for (size_t i = 0; i < count; i++) {
+    adc_T[i] = (int32_t)(Bench_Random() & 0xFFFFF);
+    adc_P[i] = (int32_t)(Bench_Random() & 0xFFFFF);
+  }
+
+  for (int c = 0; c < BENCH_CALIBRATIONS; c++) {
+    struct BMP280_Calibration calib;
+    if (c == 0) {
+      calib = datasheetCalib;
+    } else {
+      Bench_RandomCalibration(&calib);
+    }
+    BMP280_Batch_Compensate(&calib, adc_T, adc_P, refT, refP, count,
+                            BMP280_BATCH_SCALAR);
+    for (size_t k = 1; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+      BMP280_BatchKernel used = BMP280_Batch_Compensate(
+          &calib, adc_T, adc_P, T, P, count, kernels[k]);
+      if (used != kernels[k]) {
+        continue;
+      }
+      if (memcmp(T, refT, count * sizeof(*T)) != 0 ||
+          memcmp(P, refP, count * sizeof(*P)) != 0) {
+        printf("MISMATCH %s calibration %d\n", BMP280_Batch_KernelName(used),
+               c);
+        failed = 1;
+      }
+    }
+  }
+  printf("bit-exact check: %s (%d calibrations x %zu samples)\n",
+         failed ? "FAILED" : "ok", BENCH_CALIBRATIONS, count);
+
+  // throughput on readings a sensor actually produces, about -40..85 degC
+  // and 300..1100 hPa for datasheet calibration
+  for (size_t i = 0; i < count; i++) {
+    adc_T[i] = (int32_t)(312000 + Bench_Random() % 400000);
+    adc_P[i] = (int32_t)(330000 + Bench_Random() % 490000);
+  }
+  for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+    if (BMP280_Batch_KernelSelect(kernels[k]) != kernels[k]) {
+      printf("%-8s not supported\n", BMP280_Batch_KernelName(kernels[k]));
+      continue;
+    }
+    double best = 1e30;
+    for (int r = 0; r < BENCH_REPEATS; r++) {
+      double start = Bench_Now();
+      BMP280_Batch_Compensate(&datasheetCalib, adc_T, adc_P, T, P, count,
+                              kernels[k]);
+      double elapsed = Bench_Now() - start;
+      best = elapsed < best ? elapsed : best;
+    }
+    printf("%-8s %8.1f Msamples/s\n", BMP280_Batch_KernelName(kernels[k]),
+           (double)count / best * 1e-6);
+  }
+
+  free(adc_T);
+  free(adc_P);
+  free(refT);
+  free(refP);
+  free(T);
+  free(P);
+  return failed;
+}
@@ -0,0 +1,445 @@
+/**
+ * @file bmp280_bench.c
+ * @brief Host microbenchmark of firmware compensation code
+ *
+ * Times the formulas of BMP280_Compensation.c one call per sample, the way
+ * the firmware runs them, over raw sample sets a sensor actually produces.
+ * The Measure kernel runs the whole driver readout of BMP280.c (burst read,
+ * burst check, parsing, compensation) against the in-memory transport of
+ * BMP280_Mock.c, so it shows the driver overhead on top of the formulas.
+ * Each kernel is timed as the best of several runs, taken in turns with the
+ * other kernels, which filters scheduler noise.
+ *
+ * A shared host also has slow phases of a fraction of a second, 30-50% off.
+ * The whole measurement is therefore repeated in up to BENCH_PASSES passes and
+ * the fastest time of every kernel is kept; compare mode stops as soon as no
+ * kernel is over the threshold.
+ *
+ * Baseline file holds one "kernel set ns/sample" line per result. Compare
+ * mode reports every kernel slower than its baseline by more than the
+ * threshold and exits with 1, so it can gate a firmware release.
+ *
+ * Usage:
+ *   bmp280_bench [-n samples] [-r repeats]   print results
+ *   bmp280_bench -s FILE                     save results as baseline
+ *   bmp280_bench -c FILE [-t percent]        compare against baseline
+ */
+
+#include "BMP280_Compensation.h"
+#include "BMP280_Mock.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_SAMPLES_DEFAULT 16384
+#define BENCH_REPEATS_DEFAULT 200
+/** Allowed slowdown against baseline, percent */
+#define BENCH_THRESHOLD_DEFAULT 10.0
+#define BENCH_NAME_LEN 32
+#define BENCH_RESULTS_MAX 32
+/** Passes of whole measurement, fastest one counts */
+#define BENCH_PASSES 12
+
+/* Datasheet example calibration */
+static const struct BMP280_Calibration datasheetCalib = {
+    27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600,
+    6000};
+
+/**
+ * @brief Raw sample set, adc ranges are for datasheet calibration
+ */
+typedef struct Bench_SampleSet {
+  const char *name;
+  int32_t adcTMin, adcTMax; /**< temperature span */
+  int32_t adcPMin, adcPMax; /**< pressure span */
+  int32_t noise;            /**< sample to sample noise, ADC LSB */
+} Bench_SampleSet;
+
+static const struct Bench_SampleSet sampleSets[] = {
+    /* 20..25 degC, ~1000 hPa */
+    {"indoor", 519000, 524000, 415000, 418000, 40},
+    /* -20..40 degC, weather changes */
+    {"outdoor", 400000, 560000, 405000, 440000, 200},
+    /* -40..85 degC, 300..1100 hPa, uncorrelated samples */
+    {"fullrange", 312000, 712000, 330000, 820000, 0},
+};
+
+#define BENCH_SETS (sizeof(sampleSets) / sizeof(sampleSets[0]))
+
+/**
+ * @brief Inputs of one sample set, t_fine precomputed for pressure kernels
+ */
+typedef struct Bench_Data {
+  int32_t *adc_T;
+  int32_t *adc_P;
+  int32_t *t_fine;
+  struct BMP280_ResultInt *results;
+  size_t count;
+} Bench_Data;
+
+typedef struct Bench_Result {
+  char kernel[BENCH_NAME_LEN];
+  char set[BENCH_NAME_LEN];
+  double ns;
+} Bench_Result;
+
+static struct BMP280_CalibrationDerived derived;
+
+/* Driver context on the simulated sensor, Measure kernel */
+static struct BMP280_Device benchDevice;
+static struct BMP280_Mock benchMock;
+
+static const struct timespec passPause = {0, 200000000};
+
+/* results are accumulated here, so the compiler cannot drop the calls */
+static volatile uint32_t benchSink;
+
+static uint32_t benchSeed = 0x2545F491u;
+
+static uint32_t Bench_Random(void) {
+  benchSeed ^= benchSeed << 13;
+  benchSeed ^= benchSeed >> 17;
+  benchSeed ^= benchSeed << 5;
+  return benchSeed;
+}
+
+static double Bench_Now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* Slow drift across the span with noise on top, like consecutive readings */
+static int32_t Bench_Walk(int32_t min, int32_t max, int32_t noise, size_t i,
+                          size_t count) {
+  int32_t value;
+
+  if (noise == 0) {
+    return min + (int32_t)(Bench_Random() % (uint32_t)(max - min));
+  }
+  value = min + (int32_t)((int64_t)(max - min) * (int64_t)i / (int64_t)count);
+  value += (int32_t)(Bench_Random() % (2u * noise + 1u)) - noise;
+  return value;
+}
+
+static void Bench_Fill(struct Bench_Data *data,
+                       const struct Bench_SampleSet *set) {
+  for (size_t i = 0; i < data->count; i++) {
+    data->adc_T[i] =
+        Bench_Walk(set->adcTMin, set->adcTMax, set->noise, i, data->count);
+    data->adc_P[i] =
+        Bench_Walk(set->adcPMin, set->adcPMax, set->noise, i, data->count);
+    data->results[i].rawTemperature = data->adc_T[i];
+    data->results[i].rawPressure = data->adc_P[i];
+    data->results[i].Temperature = BMP280_calculate_T_int32(
+        &datasheetCalib, &derived, data->adc_T[i], &data->t_fine[i]);
+    data->results[i].Pressure = BMP280_calculate_P_int64(
+        &datasheetCalib, &derived, data->t_fine[i], data->adc_P[i]);
+    data->results[i].flags = BMP280_RESULT_VALID;
+  }
+}
+
+static void Bench_Temperature(const struct Bench_Data *data) {
+  uint32_t sum = 0;
+  int32_t t_fine;
+
+  for (size_t i = 0; i < data->count; i++) {
+    sum += (uint32_t)BMP280_calculate_T_int32(&datasheetCalib, &derived,
+                                              data->adc_T[i], &t_fine);
+  }
+  benchSink = sum + (uint32_t)t_fine;
+}
+
+static void Bench_Pressure64(const struct Bench_Data *data) {
+  uint32_t sum = 0;
+
+  for (size_t i = 0; i < data->count; i++) {
+    sum += BMP280_calculate_P_int64(&datasheetCalib, &derived, data->t_fine[i],
+                                    data->adc_P[i]);
+  }
+  benchSink = sum;
+}
+
+static void Bench_Pressure32(const struct Bench_Data *data) {
+  uint32_t sum = 0;
+
+  for (size_t i = 0; i < data->count; i++) {
+    sum += BMP280_calculate_P_int32(&datasheetCalib, &derived, data->t_fine[i],
+                                    data->adc_P[i]);
+  }
+  benchSink = sum;
+}
+
+static void Bench_PressureApprox(const struct Bench_Data *data) {
+  uint32_t sum = 0;
+
+  for (size_t i = 0; i < data->count; i++) {
+    sum += BMP280_calculate_P_approx(&datasheetCalib, &derived,
+                                     data->t_fine[i], data->adc_P[i]);
+  }
+  benchSink = sum;
+}
+
+static void Bench_Float(const struct Bench_Data *data) {
+  float sum = 0.0f;
+
+  for (size_t i = 0; i < data->count; i++) {
+    struct BMP280_Result out = BMP280_ResultToFloat(&data->results[i]);
+    sum += out.Temperature + out.Pressure;
+  }
+  benchSink = (uint32_t)sum;
+}
+
+static void Bench_Measure(const struct Bench_Data *data) {
+  uint32_t sum = 0;
+
+  for (size_t i = 0; i < data->count; i++) {
+    struct BMP280_ResultInt result;
+
+    BMP280_MockSample(&benchMock, data->adc_T[i], data->adc_P[i]);
+    result = BMP280_MeasureInt_I2C(&benchDevice);
+    sum += result.Pressure + (uint32_t)result.Temperature;
+  }
+  benchSink = sum;
+}
+
+typedef struct Bench_Kernel {
+  const char *name;
+  void (*run)(const struct Bench_Data *data);
+} Bench_Kernel;
+
+static const struct Bench_Kernel kernels[] = {
+    {"T_int32", Bench_Temperature},
+    {"P_int64", Bench_Pressure64},
+    {"P_int32", Bench_Pressure32},
+    {"P_approx", Bench_PressureApprox},
+    {"ToFloat", Bench_Float},
+    {"Measure", Bench_Measure},
+};
+
+#define BENCH_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+/* Kernels run in turns, so a slow phase of the host hits all of them */
+static void Bench_TimeAll(const struct Bench_Data *data, int repeats,
+                          double *ns) {
+  for (size_t k = 0; k < BENCH_KERNELS; k++) {
+    kernels[k].run(data); // warm caches and branch predictors
+    ns[k] = 1e30;
+  }
+  for (int r = 0; r < repeats; r++) {
+    for (size_t k = 0; k < BENCH_KERNELS; k++) {
+      double start = Bench_Now();
+      kernels[k].run(data);
+      double elapsed = Bench_Now() - start;
+      ns[k] = elapsed < ns[k] ? elapsed : ns[k];
+    }
+  }
+  for (size_t k = 0; k < BENCH_KERNELS; k++) {
+    ns[k] *= 1e9 / (double)data->count;
+  }
+}
+
+/* One measurement of all sets and kernels, keeps the fastest time */
+static int Bench_Pass(struct Bench_Data *data, int repeats, int pass,
+                      struct Bench_Result *results) {
+  int n = 0;
+
+  for (size_t set = 0; set < BENCH_SETS; set++) {
+    double ns[BENCH_KERNELS];
+
+    Bench_Fill(data, &sampleSets[set]);
+    Bench_TimeAll(data, repeats, ns);
+    for (size_t k = 0; k < BENCH_KERNELS; k++) {
+      struct Bench_Result *result = &results[n++];
+      if (pass == 0 || ns[k] < result->ns) {
+        snprintf(result->kernel, sizeof(result->kernel), "%s",
+                 kernels[k].name);
+        snprintf(result->set, sizeof(result->set), "%s",
+                 sampleSets[set].name);
+        result->ns = ns[k];
+      }
+    }
+  }
+  return n;
+}
+
+static int Bench_Load(const char *path, struct Bench_Result *baseline) {
+  FILE *f = fopen(path, "r");
+  int n = 0;
+
+  if (!f) {
+    return -1;
+  }
+  while (n < BENCH_RESULTS_MAX &&
+         fscanf(f, "%31s %31s %lf", baseline[n].kernel, baseline[n].set,
+                &baseline[n].ns) == 3) {
+    n++;
+  }
+  fclose(f);
+  return n;
+}
+
+static int Bench_Save(const char *path, const struct Bench_Result *results,
+                      int n) {
+  FILE *f = fopen(path, "w");
+
+  if (!f) {
+    return -1;
+  }
+  for (int i = 0; i < n; i++) {
+    fprintf(f, "%s %s %.3f\n", results[i].kernel, results[i].set,
+            results[i].ns);
+  }
+  return fclose(f);
+}
+
+static const struct Bench_Result *
+Bench_Find(const struct Bench_Result *baseline, int n,
+           const struct Bench_Result *result) {
+  for (int i = 0; i < n; i++) {
+    if (strcmp(baseline[i].kernel, result->kernel) == 0 &&
+        strcmp(baseline[i].set, result->set) == 0) {
+      return &baseline[i];
+    }
+  }
+  return NULL;
+}
+
+/* Kernels missing in baseline are new and not counted */
+static int Bench_Regressions(const struct Bench_Result *baseline,
+                             int baselineCount,
+                             const struct Bench_Result *results,
+                             int resultCount, double threshold) {
+  int regressions = 0;
+
+  for (int i = 0; i < resultCount; i++) {
+    const struct Bench_Result *base =
+        Bench_Find(baseline, baselineCount, &results[i]);
+    if (base && (results[i].ns / base->ns - 1.0) * 100.0 > threshold) {
+      regressions++;
+    }
+  }
+  return regressions;
+}
+
+int main(int argc, char **argv) {
+  size_t count = BENCH_SAMPLES_DEFAULT;
+  int repeats = BENCH_REPEATS_DEFAULT;
+  double threshold = BENCH_THRESHOLD_DEFAULT;
+  const char *savePath = NULL;
+  const char *comparePath = NULL;
+  struct Bench_Result results[BENCH_RESULTS_MAX];
+  struct Bench_Result baseline[BENCH_RESULTS_MAX];
+  int baselineCount = 0;
+  int resultCount = 0;
+  int regressions = 0;
+  struct Bench_Data data;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:r:s:c:t:")) != -1) {
+    switch (opt) {
+    case 'n':
+      count = strtoul(optarg, NULL, 0);
+      break;
+    case 'r':
+      repeats = atoi(optarg);
+      break;
+    case 's':
+      savePath = optarg;
+      break;
+    case 'c':
+      comparePath = optarg;
+      break;
+    case 't':
+      threshold = atof(optarg);
+      break;
+    default:
+      fprintf(stderr,
+              "usage: %s [-n samples] [-r repeats] [-s FILE | -c FILE "
+              "[-t percent]]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  if (comparePath) {
+    baselineCount = Bench_Load(comparePath, baseline);
+    if (baselineCount <= 0) {
+      fprintf(stderr, "cannot read baseline %s\n", comparePath);
+      return 2;
+    }
+  }
+
+  data.count = count;
+  data.adc_T = malloc(count * sizeof(*data.adc_T));
+  data.adc_P = malloc(count * sizeof(*data.adc_P));
+  data.t_fine = malloc(count * sizeof(*data.t_fine));
+  data.results = malloc(count * sizeof(*data.results));
+  if (count == 0 || repeats <= 0 || !data.adc_T || !data.adc_P ||
+      !data.t_fine || !data.results) {
+    fprintf(stderr, "bad sample count\n");
+    return 2;
+  }
+  BMP280_CalibrationDerive(&datasheetCalib, &derived);
+  BMP280_MockReset(&benchMock, &datasheetCalib);
+  BMP280_MockAttach(&benchDevice, &benchMock);
+  if (!BMP280_Init(&benchDevice, BMP280_VAL_CTRL_MEAS_OSRS_T_16,
+                   BMP280_VAL_CTRL_MEAS_OSRS_P_16,
+                   BMP280_VAL_CTRL_MEAS_MODE_NORMAL,
+                   BMP280_VAL_CTRL_CONFIG_T_SB_0_5,
+                   BMP280_VAL_CTRL_CONFIG_FILTER_0)) {
+    fprintf(stderr, "driver init on mock transport failed\n");
+    return 2;
+  }
+
+  for (int pass = 0; pass < BENCH_PASSES; pass++) {
+    resultCount = Bench_Pass(&data, repeats, pass, results);
+    if (comparePath && Bench_Regressions(baseline, baselineCount, results,
+                                         resultCount, threshold) == 0) {
+      break;
+    }
+    nanosleep(&passPause, NULL); // give a slow phase of the host time to end
+  }
+
+  printf("%-9s %-10s %10s %14s", "kernel", "set", "ns/sample", "Msamples/s");
+  printf(comparePath ? " %10s %8s\n" : "\n", "baseline", "change");
+  for (int i = 0; i < resultCount; i++) {
+    const struct Bench_Result *result = &results[i];
+    printf("%-9s %-10s %10.2f %14.1f", result->kernel, result->set, result->ns,
+           1e3 / result->ns);
+    if (comparePath) {
+      const struct Bench_Result *base =
+          Bench_Find(baseline, baselineCount, result);
+      if (base) {
+        double change = (result->ns / base->ns - 1.0) * 100.0;
+        printf(" %10.2f %+7.1f%%%s", base->ns, change,
+               change > threshold ? "  REGRESSION" : "");
+      } else {
+        printf(" %10s", "-");
+      }
+    }
+    printf("\n");
+  }
+  if (comparePath) {
+    regressions = Bench_Regressions(baseline, baselineCount, results,
+                                    resultCount, threshold);
+  }
+
+  free(data.adc_T);
+  free(data.adc_P);
+  free(data.t_fine);
+  free(data.results);
+
+  if (savePath) {
+    if (Bench_Save(savePath, results, resultCount) != 0) {
+      fprintf(stderr, "cannot write baseline %s\n", savePath);
+      return 2;
+    }
+    printf("baseline saved to %s\n", savePath);
+  }
+  if (comparePath) {
+    printf("%d regression(s) above %.1f%%\n", regressions, threshold);
+  }
+  return regressions ? 1 : 0;
+}
@@ -0,0 +1,253 @@
+/**
+ * @file bmp280_decimator_check.c
+ * @brief Check noise reduction of BMP280_Decimator against theory
+ *
+ * Gaussian noise on a constant pressure and temperature goes through every
+ * order and a range of ratios. The output standard deviation has to match
+ * sqrt(sum(h^2)) of the normalized CIC impulse response h, plus rounding
+ * of the output, within CHECK_TOLERANCE. Constant inputs at the ends of the
+ * int32 range must come out exactly after integrator wraparound, invalid
+ * results must be skipped and disabled flags carried over.
+ *
+ * Usage:
+ *   bmp280_decimator_check       run all checks, exit status 1 on failure
+ */
+
+#include "BMP280_Decimator.h"
+#include <math.h>
+#include <stdio.h>
+
+/** Outputs measured per setting, std estimate within about 0.5 % */
+#define CHECK_OUTPUTS 20000
+/** Allowed relative difference of measured and theoretical std */
+#define CHECK_TOLERANCE 0.03
+/** Input noise of pressure in Q24.8 Pa (8 Pa) and of raw pressure */
+#define CHECK_SIGMA_P 2048.0
+#define CHECK_SIGMA_RAW 160.0
+#define CHECK_PRESSURE (101325U << 8)
+#define CHECK_RAW_P 415148
+#define CHECK_WRAP_INPUTS 100000
+
+static const uint8_t checkShift[] = {1, 2, 4, 6, 8};
+
+static int failures;
+
+#define CHECK(cond, ...)                                                       \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__);                              \
+      printf(__VA_ARGS__);                                                     \
+      printf("\n");                                                            \
+      ++failures;                                                              \
+    }                                                                          \
+  } while (0)
+
+static uint64_t rngState = 0x9E3779B97F4A7C15ULL;
+
+static double Check_Uniform(void) {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 7;
+  rngState ^= rngState << 17;
+  return ((rngState >> 11) + 0.5) / 9007199254740992.0;
+}
+
+/** Box-Muller, one of the pair is enough */
+static double Check_Gauss(void) {
+  double u = Check_Uniform();
+  double v = Check_Uniform();
+
+  return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/**
+ * Std reduction of white noise: impulse response of order boxcars of
+ * length ratio, normalized to unit DC gain
+ */
+static double Check_Theory(uint8_t order, uint32_t ratio) {
+  static double h[BMP280_DECIMATOR_MAX_ORDER << BMP280_DECIMATOR_MAX_SHIFT];
+  static double next[BMP280_DECIMATOR_MAX_ORDER << BMP280_DECIMATOR_MAX_SHIFT];
+  uint32_t len = 1;
+  double sum = 0.0;
+
+  h[0] = 1.0;
+  for (uint8_t s = 0; s < order; s++) {
+    for (uint32_t i = 0; i < len + ratio - 1; i++) {
+      next[i] = 0.0;
+      for (uint32_t k = 0; k < ratio; k++) {
+        if (i >= k && i - k < len) {
+          next[i] += h[i - k] / ratio;
+        }
+      }
+    }
+    len += ratio - 1;
+    for (uint32_t i = 0; i < len; i++) {
+      h[i] = next[i];
+    }
+  }
+  for (uint32_t i = 0; i < len; i++) {
+    sum += h[i] * h[i];
+  }
+  return sqrt(sum);
+}
+
+/**
+ * Measured std of pressure and raw pressure outputs against the noise of
+ * the input and rounding to whole output LSBs
+ */
+static void Check_Noise(uint8_t order, uint8_t shift) {
+  struct BMP280_Decimator dec;
+  struct BMP280_ResultInt in = {0};
+  struct BMP280_ResultInt out;
+  uint32_t ratio = 1U << shift;
+  double theory = Check_Theory(order, ratio);
+  double sumP = 0.0, sumP2 = 0.0, sumR = 0.0, sumR2 = 0.0;
+  double stdP, stdR, expectP, expectR;
+  uint32_t n = 0;
+
+  CHECK(BMP280_DecimatorInit(&dec, order, shift), "init %u %u", order, shift);
+  in.flags = BMP280_RESULT_VALID;
+  in.Temperature = 2508;
+  in.rawTemperature = 519888;
+  while (n < CHECK_OUTPUTS) {
+    in.Pressure = (uint32_t)lround(CHECK_PRESSURE + CHECK_SIGMA_P *
+                                                        Check_Gauss());
+    in.rawPressure = (int32_t)lround(CHECK_RAW_P + CHECK_SIGMA_RAW *
+                                                       Check_Gauss());
+    if (!BMP280_DecimatorPush(&dec, &in, &out)) {
+      continue;
+    }
+    double p = (double)out.Pressure - CHECK_PRESSURE;
+    double r = (double)out.rawPressure - CHECK_RAW_P;
+
+    sumP += p;
+    sumP2 += p * p;
+    sumR += r;
+    sumR2 += r * r;
+    ++n;
+    CHECK(out.Temperature == 2508 && out.rawTemperature == 519888,
+          "order %u shift %u: constant channel changed", order, shift);
+  }
+
+  stdP = sqrt(sumP2 / n - (sumP / n) * (sumP / n));
+  stdR = sqrt(sumR2 / n - (sumR / n) * (sumR / n));
+  // input rounding to integers adds 1/12 LSB^2 too, filtered like noise
+  expectP = sqrt(theory * theory * (CHECK_SIGMA_P * CHECK_SIGMA_P + 1.0 / 12) +
+                 1.0 / 12);
+  expectR = sqrt(theory * theory *
+                     (CHECK_SIGMA_RAW * CHECK_SIGMA_RAW + 1.0 / 12) +
+                 1.0 / 12);
+  printf("%5u %5u %10.4f %10.4f %10.4f %10.4f\n", order, ratio,
+         1.0 / sqrt(ratio), theory, stdP / CHECK_SIGMA_P,
+         stdR / CHECK_SIGMA_RAW);
+  CHECK(fabs(stdP / expectP - 1.0) < CHECK_TOLERANCE,
+        "order %u ratio %u: pressure std %.3f, theory %.3f", order, ratio,
+        stdP, expectP);
+  CHECK(fabs(stdR / expectR - 1.0) < CHECK_TOLERANCE,
+        "order %u ratio %u: raw pressure std %.3f, theory %.3f", order, ratio,
+        stdR, expectR);
+  CHECK(dec.outputs == CHECK_OUTPUTS &&
+            dec.inputs == (uint32_t)(CHECK_OUTPUTS + order - 1) * ratio,
+        "order %u ratio %u: %u inputs for %u outputs", order, ratio,
+        (unsigned)dec.inputs, (unsigned)dec.outputs);
+}
+
+/**
+ * Extreme constants at the largest gain, integrators wrap many times
+ */
+static void Check_Wrap(void) {
+  static const int32_t values[] = {INT32_MAX, INT32_MIN, -1, 0};
+  struct BMP280_Decimator dec;
+  struct BMP280_ResultInt in = {0};
+  struct BMP280_ResultInt out;
+
+  for (unsigned v = 0; v < sizeof(values) / sizeof(values[0]); v++) {
+    uint32_t outputs = 0;
+    uint32_t wrong = 0;
+
+    BMP280_DecimatorInit(&dec, BMP280_DECIMATOR_MAX_ORDER,
+                         BMP280_DECIMATOR_MAX_SHIFT);
+    in.flags = BMP280_RESULT_VALID;
+    in.Temperature = values[v];
+    in.rawTemperature = values[v];
+    in.rawPressure = values[v];
+    in.Pressure = (uint32_t)values[v];
+    for (uint32_t i = 0; i < CHECK_WRAP_INPUTS; i++) {
+      if (BMP280_DecimatorPush(&dec, &in, &out)) {
+        ++outputs;
+        wrong += out.Temperature != values[v] ||
+                 out.rawTemperature != values[v] ||
+                 out.rawPressure != values[v] ||
+                 out.Pressure != (uint32_t)values[v];
+      }
+    }
+    CHECK(outputs > 0 && wrong == 0, "constant %ld: %u of %u outputs wrong",
+          (long)values[v], (unsigned)wrong, (unsigned)outputs);
+  }
+}
+
+/**
+ * Ratio 1 passes through, invalid results are skipped, disabled flags of
+ * any input reach the output, bad settings are refused
+ */
+static void Check_Flags(void) {
+  struct BMP280_Decimator dec;
+  struct BMP280_ResultInt in = {0};
+  struct BMP280_ResultInt out;
+  uint32_t outputs = 0;
+
+  CHECK(!BMP280_DecimatorInit(&dec, 0, 2), "order 0 accepted");
+  CHECK(!BMP280_DecimatorInit(&dec, BMP280_DECIMATOR_MAX_ORDER + 1, 2),
+        "order above limit accepted");
+  CHECK(!BMP280_DecimatorInit(&dec, 1, BMP280_DECIMATOR_MAX_SHIFT + 1),
+        "shift above limit accepted");
+
+  BMP280_DecimatorInit(&dec, 2, 0);
+  in.flags = BMP280_RESULT_VALID;
+  in.Pressure = 12345;
+  CHECK(BMP280_DecimatorPush(&dec, &in, &out) && out.Pressure == 12345,
+        "ratio 1 does not pass through");
+
+  BMP280_DecimatorInit(&dec, 1, 2);
+  for (uint32_t i = 0; i < 8; i++) {
+    in.flags = BMP280_RESULT_VALID;
+    in.Pressure = 1000;
+    if (i == 1) {
+      in.flags = BMP280_RESULT_BUS_ERROR;
+      in.Pressure = 0;
+    } else if (i == 2) {
+      in.flags = BMP280_RESULT_STALE;
+      in.Pressure = 0;
+    } else if (i == 3) {
+      in.flags |= BMP280_RESULT_T_DISABLED;
+    }
+    if (BMP280_DecimatorPush(&dec, &in, &out)) {
+      ++outputs;
+      CHECK(out.Pressure == 1000, "invalid input reached output: %u",
+            (unsigned)out.Pressure);
+      CHECK(out.flags == (BMP280_RESULT_VALID | BMP280_RESULT_T_DISABLED),
+            "output flags 0x%x", out.flags);
+    }
+  }
+  CHECK(outputs == 1 && dec.skipped == 2, "%u outputs, %u skipped",
+        (unsigned)outputs, (unsigned)dec.skipped);
+}
+
+int main(void) {
+  printf("white noise std out/in\n");
+  printf("%5s %5s %10s %10s %10s %10s\n", "order", "ratio", "1/sqrt(R)",
+         "theory", "Q24.8 P", "raw P");
+  for (uint8_t order = 1; order <= BMP280_DECIMATOR_MAX_ORDER; order++) {
+    for (unsigned i = 0; i < sizeof(checkShift); i++) {
+      Check_Noise(order, checkShift[i]);
+    }
+  }
+  Check_Wrap();
+  Check_Flags();
+
+  if (failures != 0) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,199 @@
+/**
+ * @file bmp280_devices_check.c
+ * @brief Check that two sensor contexts keep their own calibration and state
+ *
+ * Two mock sensors carry different calibration coefficients and are set up
+ * with different settings. They are measured in turn with the same raw
+ * values, so a result compensated with the other sensor's calibration, a
+ * setting leaking from one context into the other or a transfer reaching
+ * the wrong sensor shows up. Every result is compared with the datasheet
+ * floating point formula for both calibration sets: it has to match its
+ * own and differ from the other one.
+ *
+ * Usage:
+ *   bmp280_devices_check  run all checks, exit status 1 on failure
+ */
+
+#include "BMP280_Mock.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CHECK_SAMPLES 16
+/* Datasheet example raw values, stepped per sample */
+#define CHECK_ADC_T 519888
+#define CHECK_ADC_P 415148
+#define CHECK_ADC_STEP 1024
+
+/** Reference tolerance: 0.01 degC, 1 Pa in Q24.8 */
+#define CHECK_TOLERANCE_T 1
+#define CHECK_TOLERANCE_P 256
+
+/* Datasheet example calibration for sensor 0, another part for sensor 1 */
+static const struct BMP280_Calibration checkCalib[2] = {
+    {27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600,
+     6000},
+    {27821, 25845, 50, 36699, -10514, 3024, 4916, -126, -7, 15500, -14600,
+     6000},
+};
+
+/** Settings of each sensor: forced x16/x16, normal x1/x4 with filter */
+static const uint8_t checkSettings[2][5] = {
+    {BMP280_VAL_CTRL_MEAS_OSRS_T_16, BMP280_VAL_CTRL_MEAS_OSRS_P_16,
+     BMP280_VAL_CTRL_MEAS_MODE_FORCED, BMP280_VAL_CTRL_CONFIG_T_SB_0_5,
+     BMP280_VAL_CTRL_CONFIG_FILTER_0},
+    {BMP280_VAL_CTRL_MEAS_OSRS_T_1, BMP280_VAL_CTRL_MEAS_OSRS_P_4,
+     BMP280_VAL_CTRL_MEAS_MODE_NORMAL, BMP280_VAL_CTRL_CONFIG_T_SB_62_5,
+     BMP280_VAL_CTRL_CONFIG_FILTER_4},
+};
+
+static struct BMP280_Mock mocks[2];
+static struct BMP280_Device devices[2];
+static int failures;
+
+#define CHECK(cond, ...)                                                       \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__);                              \
+      printf(__VA_ARGS__);                                                     \
+      printf("\n");                                                            \
+      ++failures;                                                              \
+    }                                                                          \
+  } while (0)
+
+/**
+ * Datasheet double precision compensation of raw values with one
+ * calibration set, temperature in 0.01 degC and pressure in Q24.8 Pa
+ */
+static void CheckReference(const struct BMP280_Calibration *c,
+                           int32_t adc_T,
+                           int32_t adc_P,
+                           double *temperature,
+                           double *pressure) {
+  double var1, var2, t_fine, p;
+
+  var1 = (adc_T / 16384.0 - c->dig_T1 / 1024.0) * c->dig_T2;
+  var2 = (adc_T / 131072.0 - c->dig_T1 / 8192.0) *
+         (adc_T / 131072.0 - c->dig_T1 / 8192.0) * c->dig_T3;
+  t_fine = var1 + var2;
+  *temperature = t_fine / 5120.0 * 100.0;
+
+  var1 = t_fine / 2.0 - 64000.0;
+  var2 = var1 * var1 * c->dig_P6 / 32768.0;
+  var2 = var2 + var1 * c->dig_P5 * 2.0;
+  var2 = var2 / 4.0 + c->dig_P4 * 65536.0;
+  var1 = (c->dig_P3 * var1 * var1 / 524288.0 + c->dig_P2 * var1) / 524288.0;
+  var1 = (1.0 + var1 / 32768.0) * c->dig_P1;
+  p = 1048576.0 - adc_P;
+  p = (p - var2 / 4096.0) * 6250.0 / var1;
+  var1 = c->dig_P9 * p * p / 2147483648.0;
+  var2 = p * c->dig_P8 / 32768.0;
+  *pressure = (p + (var1 + var2 + c->dig_P7) / 16.0) * 256.0;
+}
+
+static bool CheckInit(uint8_t i) {
+  const uint8_t *s = checkSettings[i];
+
+  return BMP280_Init(&devices[i], s[0], s[1], s[2], s[3], s[4]);
+}
+
+/**
+ * Each context holds the calibration and settings of its own sensor
+ */
+static void CheckContext(uint8_t i) {
+  const uint8_t *s = checkSettings[i];
+  const struct BMP280_Device *dev = &devices[i];
+
+  CHECK(memcmp(&dev->calib, &checkCalib[i], sizeof(dev->calib)) == 0,
+        "sensor %u: calibration of another sensor", i);
+  CHECK(dev->osrs_t == s[0] && dev->osrs_p == s[1] && dev->acq_mode == s[2] &&
+            dev->t_sb == s[3] && dev->filter_tc == s[4],
+        "sensor %u: settings of another sensor", i);
+  CHECK(dev->bus == &mocks[i], "sensor %u: attached to another mock", i);
+}
+
+/**
+ * Measure sensor i holding sample k, only its own mock may see transfers
+ */
+static void CheckMeasure(uint8_t i, int32_t k) {
+  const uint8_t other = 1 - i;
+  const uint32_t otherReads = mocks[other].reads;
+  const uint32_t otherWrites = mocks[other].writes;
+  const int32_t adc_T = CHECK_ADC_T + k * CHECK_ADC_STEP;
+  const int32_t adc_P = CHECK_ADC_P - k * CHECK_ADC_STEP;
+  struct BMP280_ResultInt result;
+
+  BMP280_MockSample(&mocks[i], adc_T, adc_P);
+  result = BMP280_MeasureInt_I2C(&devices[i]);
+  CHECK(result.flags & BMP280_RESULT_VALID, "sensor %u sample %ld: flags 0x%x",
+        i, (long)k, result.flags);
+  CHECK(result.rawTemperature == adc_T && result.rawPressure == adc_P,
+        "sensor %u sample %ld: raw values of another sample", i, (long)k);
+  CHECK(mocks[other].reads == otherReads &&
+            mocks[other].writes == otherWrites,
+        "sensor %u sample %ld: transfer reached sensor %u", i, (long)k,
+        other);
+
+  for (uint8_t c = 0; c < 2; c++) {
+    double temperature, pressure;
+    bool match;
+
+    CheckReference(&checkCalib[c], adc_T, adc_P, &temperature, &pressure);
+    match = fabs(result.Temperature - temperature) <= CHECK_TOLERANCE_T &&
+            fabs(result.Pressure - pressure) <= CHECK_TOLERANCE_P;
+    CHECK(match == (c == i),
+          "sensor %u sample %ld: T %ld P %lu, calibration %u gives "
+          "T %.1f P %.1f",
+          i, (long)k, (long)result.Temperature,
+          (unsigned long)result.Pressure, c, temperature, pressure);
+  }
+}
+
+int main(void) {
+  uint8_t ctrlMeas, config;
+
+  for (uint8_t i = 0; i < 2; i++) {
+    BMP280_MockReset(&mocks[i], &checkCalib[i]);
+    BMP280_MockAttach(&devices[i], &mocks[i]);
+  }
+  for (uint8_t i = 0; i < 2; i++) {
+    CHECK(CheckInit(i), "sensor %u: init", i);
+  }
+  for (uint8_t i = 0; i < 2; i++) {
+    CheckContext(i);
+    CHECK(mocks[i].regs[BMP280_REG_CTRL_MEAS] == devices[i].ctrlMeas &&
+              mocks[i].regs[BMP280_REG_CONFIG] == devices[i].config,
+          "sensor %u: registers hold another configuration", i);
+  }
+  printf("init: sensor 0 %lu reads %lu writes, sensor 1 %lu reads %lu "
+         "writes\n",
+         (unsigned long)mocks[0].reads, (unsigned long)mocks[0].writes,
+         (unsigned long)mocks[1].reads, (unsigned long)mocks[1].writes);
+
+  // back-to-back, the same raw values on both sensors
+  for (int32_t k = 0; k < CHECK_SAMPLES; k++) {
+    CheckMeasure(0, k);
+    CheckMeasure(1, k);
+  }
+
+  // setting sensor 0 up again leaves sensor 1 as it was
+  ctrlMeas = devices[1].ctrlMeas;
+  config = devices[1].config;
+  CHECK(CheckInit(0), "sensor 0: second init");
+  CHECK(devices[1].ctrlMeas == ctrlMeas && devices[1].config == config,
+        "sensor 1: configuration changed by sensor 0 init");
+  for (uint8_t i = 0; i < 2; i++) {
+    CheckContext(i);
+  }
+  for (int32_t k = CHECK_SAMPLES; k < 2 * CHECK_SAMPLES; k++) {
+    CheckMeasure(1, k);
+    CheckMeasure(0, k);
+  }
+
+  if (failures != 0) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
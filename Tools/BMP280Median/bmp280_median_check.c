@@ -0,0 +1,317 @@
+/**
+ * @file bmp280_median_check.c
+ * @brief Check BMP280_Median against a sorting reference and on spikes
+ *
+ * Random streams with many ties and over the full int32 range go through
+ * every window. An output has to be the center sample when its temperature
+ * and pressure are within the thresholds of the medians found by sorting
+ * the last window inputs, otherwise the medians flagged
+ * BMP280_RESULT_MEDIAN. A noisy pressure with a step and spikes of 1 to 3
+ * samples shows how many spikes each window passes, how much the step is
+ * delayed and how many samples are touched, as a plain median and with a
+ * threshold above the noise. Flag and setup handling is checked last, host
+ * ns/result are printed for reference only.
+ *
+ * Usage:
+ *   bmp280_median_check       run all checks, exit status 1 on failure
+ */
+
+#include "BMP280_Median.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define CHECK_SAMPLES 200000
+/** Spike stream: noise and spike height in Q24.8 Pa */
+#define CHECK_PRESSURE (101325 << 8)
+#define CHECK_NOISE 512
+#define CHECK_SPIKE (1000 << 8)
+#define CHECK_STEP (50 << 8)
+#define CHECK_SPIKE_EVERY 50
+#define CHECK_STEP_AT 100000
+/** Pressure threshold of the spike stream, well above the noise */
+#define CHECK_THRESHOLD_P (100 << 8)
+
+static const uint8_t checkWindow[] = {3, 5, 7};
+
+static int failures;
+
+#define CHECK(cond, ...)                                                       \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__);                              \
+      printf(__VA_ARGS__);                                                     \
+      printf("\n");                                                            \
+      ++failures;                                                              \
+    }                                                                          \
+  } while (0)
+
+static uint32_t rngState = 2463534242U;
+
+static uint32_t Check_Random(void) {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return rngState;
+}
+
+static int Check_Compare(const void *a, const void *b) {
+  int32_t x = *(const int32_t *)a;
+  int32_t y = *(const int32_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+static int32_t Check_ReferenceMedian(const int32_t *history, uint32_t n,
+                                     uint8_t window) {
+  int32_t sorted[BMP280_MEDIAN_MAX_WINDOW];
+
+  for (uint8_t i = 0; i < window; i++) {
+    sorted[i] = history[n - window + 1 + i];
+  }
+  qsort(sorted, window, sizeof(sorted[0]), Check_Compare);
+  return sorted[window / 2];
+}
+
+/**
+ * Values from a small alphabet cover every order pattern with ties, the
+ * full range catches overflow in comparisons
+ */
+static void Check_Reference(uint8_t window, uint32_t range,
+                            uint32_t threshold) {
+  static int32_t history[BMP280_MEDIAN_CHANNELS][CHECK_SAMPLES];
+  struct BMP280_Median med;
+  struct BMP280_ResultInt in = {0};
+  struct BMP280_ResultInt out;
+  uint32_t wrong = 0;
+  uint32_t flagWrong = 0;
+  uint32_t outputs = 0;
+
+  BMP280_MedianInit(&med, window, threshold, threshold);
+  in.flags = BMP280_RESULT_VALID;
+  for (uint32_t n = 0; n < CHECK_SAMPLES; n++) {
+    for (uint8_t ch = 0; ch < BMP280_MEDIAN_CHANNELS; ch++) {
+      uint32_t r = Check_Random();
+
+      history[ch][n] = range != 0 ? (int32_t)(r % range) : (int32_t)r;
+    }
+    in.Temperature = history[0][n];
+    in.Pressure = (uint32_t)history[1][n];
+    in.rawTemperature = history[2][n];
+    in.rawPressure = history[3][n];
+    if (!BMP280_MedianPush(&med, &in, &out)) {
+      CHECK(n + 1 < window, "window %u: no output at %u", window,
+            (unsigned)n);
+      continue;
+    }
+    int32_t field[BMP280_MEDIAN_CHANNELS] = {
+        out.Temperature, (int32_t)out.Pressure, out.rawTemperature,
+        out.rawPressure};
+    int32_t median[BMP280_MEDIAN_CHANNELS];
+    uint32_t center = n - window / 2;
+    bool replaced = false;
+
+    ++outputs;
+    for (uint8_t ch = 0; ch < BMP280_MEDIAN_CHANNELS; ch++) {
+      median[ch] = Check_ReferenceMedian(history[ch], n, window);
+    }
+    // temperature and pressure decide, distances in 64 bits
+    for (uint8_t ch = 0; ch < 2; ch++) {
+      replaced = replaced ||
+                 llabs((int64_t)history[ch][center] - median[ch]) > threshold;
+    }
+    for (uint8_t ch = 0; ch < BMP280_MEDIAN_CHANNELS; ch++) {
+      wrong += field[ch] != (replaced ? median[ch] : history[ch][center]);
+    }
+    flagWrong += replaced != ((out.flags & BMP280_RESULT_MEDIAN) != 0);
+  }
+  CHECK(wrong == 0 && flagWrong == 0,
+        "window %u range %u threshold %u: %u fields, %u flags wrong", window,
+        (unsigned)range, (unsigned)threshold, (unsigned)wrong,
+        (unsigned)flagWrong);
+  CHECK(outputs == (uint32_t)(CHECK_SAMPLES - window + 1) &&
+            med.outputs == outputs,
+        "window %u: %u outputs", window, (unsigned)outputs);
+}
+
+/**
+ * Noisy pressure with a step, runs of 1, 2 and 3 spike samples in turn
+ */
+static void Check_Spikes(uint8_t window, uint32_t threshold) {
+  static int32_t input[CHECK_SAMPLES];
+  static bool spike[CHECK_SAMPLES];
+  struct BMP280_Median med;
+  struct BMP280_ResultInt in = {0};
+  struct BMP280_ResultInt out;
+  uint32_t passed[4] = {0};
+  uint32_t runs[4] = {0};
+  uint32_t delay = 0;
+  uint32_t changed = 0;
+
+  for (uint32_t n = 0; n < CHECK_SAMPLES; n++) {
+    input[n] = CHECK_PRESSURE + (n >= CHECK_STEP_AT ? CHECK_STEP : 0) +
+               (int32_t)(Check_Random() % (2 * CHECK_NOISE + 1)) -
+               CHECK_NOISE;
+    spike[n] = false;
+  }
+  for (uint32_t n = CHECK_SPIKE_EVERY; n + 3 < CHECK_SAMPLES;
+       n += CHECK_SPIKE_EVERY) {
+    uint8_t len = 1 + (n / CHECK_SPIKE_EVERY) % 3;
+
+    if (n <= CHECK_STEP_AT && n + CHECK_SPIKE_EVERY > CHECK_STEP_AT) {
+      continue; // keep the step clean
+    }
+    ++runs[len];
+    for (uint8_t k = 0; k < len; k++) {
+      input[n + k] += CHECK_SPIKE;
+      spike[n + k] = true;
+    }
+  }
+
+  BMP280_MedianInit(&med, window, 0, threshold);
+  in.flags = BMP280_RESULT_VALID;
+  for (uint32_t n = 0; n < CHECK_SAMPLES; n++) {
+    in.Pressure = (uint32_t)input[n];
+    if (!BMP280_MedianPush(&med, &in, &out)) {
+      continue;
+    }
+    uint32_t center = n - window / 2;
+    bool high = (int32_t)out.Pressure > CHECK_PRESSURE + CHECK_STEP +
+                                            CHECK_SPIKE / 2;
+
+    changed += !spike[center] && (int32_t)out.Pressure != input[center];
+    // count each passed run once, at its first sample
+    if (high && spike[center] && !spike[center - 1]) {
+      uint8_t len = 1;
+
+      while (len < 3 && spike[center + len]) {
+        ++len;
+      }
+      ++passed[len];
+    }
+    if (delay == 0 && n >= CHECK_STEP_AT &&
+        (int32_t)out.Pressure > CHECK_PRESSURE + CHECK_STEP / 2) {
+      delay = n - CHECK_STEP_AT;
+    }
+  }
+
+  printf("%6u %6u %8u/%-5u %8u/%-5u %8u/%-5u %6u %10.2f\n", window,
+         (unsigned)(threshold >> 8), (unsigned)passed[1], (unsigned)runs[1],
+         (unsigned)passed[2], (unsigned)runs[2], (unsigned)passed[3],
+         (unsigned)runs[3], (unsigned)delay,
+         100.0 * med.replaced / med.outputs);
+  for (uint8_t len = 1; len <= 3; len++) {
+    CHECK(len <= window / 2 ? passed[len] == 0 : passed[len] == runs[len],
+          "window %u: %u of %u spikes of %u samples passed", window,
+          (unsigned)passed[len], (unsigned)runs[len], len);
+  }
+  CHECK(delay == window / 2, "window %u: step delayed by %u samples", window,
+        (unsigned)delay);
+  CHECK(threshold == 0 || changed == 0,
+        "window %u: %u samples without spike changed", window,
+        (unsigned)changed);
+}
+
+/**
+ * Setup limits, pass-through, skipping and flags of the center sample
+ */
+static void Check_Flags(void) {
+  struct BMP280_Median med;
+  struct BMP280_ResultInt in = {0};
+  struct BMP280_ResultInt out;
+  uint32_t outputs = 0;
+
+  CHECK(!BMP280_MedianInit(&med, 0, 0, 0), "window 0 accepted");
+  CHECK(!BMP280_MedianInit(&med, 4, 0, 0), "even window accepted");
+  CHECK(!BMP280_MedianInit(&med, BMP280_MEDIAN_MAX_WINDOW + 2, 0, 0),
+        "window above limit accepted");
+
+  BMP280_MedianInit(&med, 1, 0, 0);
+  in.flags = BMP280_RESULT_VALID;
+  in.Pressure = 12345;
+  CHECK(BMP280_MedianPush(&med, &in, &out) && out.Pressure == 12345 &&
+            out.flags == BMP280_RESULT_VALID,
+        "window 1 does not pass through");
+
+  // sample 2 has temperature disabled, sample 3 is a bus error
+  BMP280_MedianInit(&med, 3, 0, 0);
+  for (uint32_t i = 0; i < 6; i++) {
+    in.flags = BMP280_RESULT_VALID;
+    in.Pressure = 1000;
+    if (i == 2) {
+      in.flags |= BMP280_RESULT_T_DISABLED;
+    } else if (i == 3) {
+      in.flags = BMP280_RESULT_BUS_ERROR;
+      in.Pressure = 0;
+    }
+    if (BMP280_MedianPush(&med, &in, &out)) {
+      ++outputs;
+      CHECK(out.Pressure == 1000, "bus error reached output");
+      CHECK(out.flags == (BMP280_RESULT_VALID |
+                          (i == 4 ? BMP280_RESULT_T_DISABLED : 0)),
+            "input %u: output flags 0x%x", (unsigned)i, out.flags);
+    }
+  }
+  CHECK(outputs == 3 && med.skipped == 1, "%u outputs, %u skipped",
+        (unsigned)outputs, (unsigned)med.skipped);
+}
+
+static double Check_Now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static volatile uint32_t benchSink;
+
+static void Check_Bench(uint8_t window) {
+  struct BMP280_Median med;
+  struct BMP280_ResultInt in = {0};
+  struct BMP280_ResultInt out;
+  uint32_t sum = 0;
+  double start;
+
+  BMP280_MedianInit(&med, window, 0, 0);
+  in.flags = BMP280_RESULT_VALID;
+  start = Check_Now();
+  for (uint32_t n = 0; n < CHECK_SAMPLES; n++) {
+    in.Pressure = Check_Random();
+    in.Temperature = (int32_t)in.Pressure >> 3;
+    if (BMP280_MedianPush(&med, &in, &out)) {
+      sum += out.Pressure;
+    }
+  }
+  benchSink = sum;
+  printf("window %u: host %.1f ns/result\n", window,
+         (Check_Now() - start) * 1e9 / CHECK_SAMPLES);
+}
+
+int main(void) {
+  for (unsigned i = 0; i < sizeof(checkWindow); i++) {
+    Check_Reference(checkWindow[i], 2, 0);
+    Check_Reference(checkWindow[i], 5, 0);
+    Check_Reference(checkWindow[i], 50, 10);
+    Check_Reference(checkWindow[i], 0, 0);
+    Check_Reference(checkWindow[i], 0, 1U << 31);
+  }
+
+  printf("spikes passed of 1, 2 and 3 samples, step delay in samples\n");
+  printf("%6s %6s %14s %14s %14s %6s %10s\n", "window", "Pa", "1", "2", "3",
+         "delay", "flagged %");
+  for (unsigned i = 0; i < sizeof(checkWindow); i++) {
+    Check_Spikes(checkWindow[i], 0);
+    Check_Spikes(checkWindow[i], CHECK_THRESHOLD_P);
+  }
+  Check_Flags();
+  for (unsigned i = 0; i < sizeof(checkWindow); i++) {
+    Check_Bench(checkWindow[i]);
+  }
+
+  if (failures != 0) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
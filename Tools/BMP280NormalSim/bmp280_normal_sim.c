@@ -0,0 +1,219 @@
+/**
+ * @file bmp280_normal_sim.c
+ * @brief Run the normal mode read schedule against a free-running sensor
+ *
+ * The driver core talks to a mock sensor through a wrapper keeping a
+ * microsecond clock. The sensor produces a new raw sample every output
+ * period whatever the driver does, numbered so that every result tells
+ * which sample it is: the period is off from the datasheet prediction and
+ * every ready time jitters. The task sleeps in 1 ms ticks and wakes up
+ * with random latency, as under FreeRTOS, and the burst read takes bus
+ * time. For every t_sb setting and several period errors,
+ * BMP280_MeasureNormalInt_I2C() has to return each produced sample exactly
+ * once and the statistics have to agree: no duplicate, no missed sample.
+ *
+ * Usage:
+ *   bmp280_normal_sim     run all settings, exit status 1 on failure
+ */
+
+#include "BMP280_Mock.h"
+#include <stdio.h>
+
+#define SIM_SAMPLES 200
+/** Raw samples count up from here, sample k holds base + k */
+#define SIM_ADC_T 400000
+#define SIM_ADC_P 300000
+/** Ready time jitter of the sensor, +- us */
+#define SIM_JITTER_US 50
+/** Task wake latency after a tick, 0 .. us */
+#define SIM_LATENCY_US 300
+/** Burst readout at 400 kHz */
+#define SIM_READ_US 250
+
+/* Datasheet example calibration */
+static const struct BMP280_Calibration simCalib = {
+    27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600,
+    6000};
+
+/** Actual period over predicted, in ppm */
+static const int32_t simPeriodError_ppm[] = {-30000, -5000, 0, 5000, 30000};
+
+/** Simulated sensor, the mock has to stay first: dev->bus points to it */
+typedef struct SimSensor {
+  struct BMP280_Mock mock;
+  uint64_t phase_us;  // ready time of sample 0
+  uint32_t period_us; // actual output period
+  int64_t sample;     // sample in data registers
+} SimSensor;
+
+static uint64_t now_us;
+static uint32_t rngState = 0x2545F491u;
+static int failures;
+
+#define CHECK(cond, ...)                                                       \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__);                              \
+      printf(__VA_ARGS__);                                                     \
+      printf("\n");                                                            \
+      ++failures;                                                              \
+    }                                                                          \
+  } while (0)
+
+static uint32_t SimRandom(uint32_t range) {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return rngState % range;
+}
+
+/**
+ * Ready time of sample k, the same jitter every time it is asked for
+ */
+static uint64_t SimReady_us(const struct SimSensor *sensor, int64_t k) {
+  uint32_t hash = (uint32_t)k * 2654435761u;
+
+  hash ^= hash >> 15;
+  return sensor->phase_us + (uint64_t)k * sensor->period_us +
+         hash % (2 * SIM_JITTER_US + 1) - SIM_JITTER_US;
+}
+
+/**
+ * The data registers hold the newest finished sample when the burst starts
+ */
+static BMP280_Status SimRead(struct BMP280_Device *dev,
+                             uint8_t reg,
+                             uint8_t *data,
+                             uint16_t size) {
+  struct SimSensor *sensor = dev->bus;
+
+  if (reg == BMP280_READOUT_REG) {
+    while (SimReady_us(sensor, sensor->sample + 1) <= now_us) {
+      ++sensor->sample;
+    }
+    BMP280_MockSample(&sensor->mock, SIM_ADC_T + (int32_t)sensor->sample,
+                      SIM_ADC_P + (int32_t)sensor->sample);
+  }
+  now_us += SIM_READ_US;
+  return BMP280_TransportMock.read(dev, reg, data, size);
+}
+
+static BMP280_Status SimWrite(struct BMP280_Device *dev,
+                              uint8_t reg,
+                              const uint8_t *data,
+                              uint16_t size) {
+  now_us += SIM_READ_US / 2;
+  return BMP280_TransportMock.write(dev, reg, data, size);
+}
+
+/**
+ * vTaskDelay(): wake on a tick, the first one is partial, plus latency
+ */
+static void SimDelay_ms(struct BMP280_Device *dev, uint32_t ms) {
+  (void)dev;
+  now_us = (now_us / 1000 + ms) * 1000 + SimRandom(SIM_LATENCY_US + 1);
+}
+
+static uint32_t SimTick_ms(const struct BMP280_Device *dev) {
+  (void)dev;
+  return (uint32_t)(now_us / 1000);
+}
+
+static const struct BMP280_Transport simTransport = {
+    .read = SimRead,
+    .write = SimWrite,
+    .delay_ms = SimDelay_ms,
+    .tick_ms = SimTick_ms,
+};
+
+/**
+ * @brief Outcome of one run
+ */
+typedef struct SimRun {
+  uint32_t period_us;   // predicted by the driver at start
+  double readsPerSample;
+  struct BMP280_Stats stats;
+} SimRun;
+
+static struct SimSensor sensor;
+static struct BMP280_Device device;
+
+/**
+ * Consume SIM_SAMPLES results, each has to be the sample after the one
+ * before
+ */
+static struct SimRun SimRunNormal(uint8_t t_sb, int32_t error_ppm) {
+  struct SimRun run;
+  struct BMP280_ResultInt result;
+  int32_t previous = 0;
+
+  BMP280_MockReset(&sensor.mock, &simCalib);
+  BMP280_MockAttach(&device, &sensor.mock);
+  device.transport = &simTransport;
+  now_us = 1000000 + SimRandom(1000000);
+  CHECK(BMP280_Init(&device, BMP280_VAL_CTRL_MEAS_OSRS_T_1,
+                    BMP280_VAL_CTRL_MEAS_OSRS_P_4,
+                    BMP280_VAL_CTRL_MEAS_MODE_NORMAL, t_sb,
+                    BMP280_VAL_CTRL_CONFIG_FILTER_0),
+        "t_sb %u: init", t_sb);
+  run.period_us = BMP280_NormalPeriod_us(&device);
+
+  // free-running since before init, at a random phase
+  sensor.period_us =
+      (uint32_t)((int64_t)run.period_us * (1000000 + error_ppm) / 1000000);
+  sensor.phase_us = now_us - SimRandom(sensor.period_us);
+  sensor.sample = 0;
+  BMP280_NormalScheduleStart(&device);
+  device.stats = (struct BMP280_Stats){0};
+
+  for (uint32_t i = 0; i < SIM_SAMPLES; i++) {
+    result = BMP280_MeasureNormalInt_I2C(&device);
+    CHECK(result.flags & BMP280_RESULT_VALID,
+          "t_sb %u, %+d ppm: result %u flags 0x%x", t_sb, error_ppm, i,
+          result.flags);
+    if (i != 0) {
+      CHECK(result.rawTemperature == previous + 1,
+            "t_sb %u, %+d ppm: result %u is sample %d after %d", t_sb,
+            error_ppm, i, result.rawTemperature - SIM_ADC_T,
+            previous - SIM_ADC_T);
+    }
+    previous = result.rawTemperature;
+  }
+  run.stats = device.stats;
+  run.readsPerSample = (double)run.stats.samples / SIM_SAMPLES;
+  CHECK(run.stats.duplicates == 0, "t_sb %u, %+d ppm: %lu duplicates", t_sb,
+        error_ppm, (unsigned long)run.stats.duplicates);
+  CHECK(run.stats.missed == 0, "t_sb %u, %+d ppm: %lu missed", t_sb,
+        error_ppm, (unsigned long)run.stats.missed);
+  return run;
+}
+
+int main(void) {
+  struct SimRun run;
+
+  printf("%u samples per run, +-%u us ready jitter, %u us wake latency\n",
+         SIM_SAMPLES, SIM_JITTER_US, SIM_LATENCY_US);
+  printf("%4s %9s %8s %10s %7s %7s %7s %7s\n", "t_sb", "period", "error",
+         "reads/smp", "probes", "dupl", "missed", "resyncs");
+  for (uint8_t t_sb = BMP280_VAL_CTRL_CONFIG_T_SB_0_5;
+       t_sb <= BMP280_VAL_CTRL_CONFIG_T_SB_4000; t_sb++) {
+    for (size_t e = 0;
+         e < sizeof(simPeriodError_ppm) / sizeof(simPeriodError_ppm[0]);
+         e++) {
+      run = SimRunNormal(t_sb, simPeriodError_ppm[e]);
+      printf("%4u %6lu us %+6.1f%% %10.2f %7lu %7lu %7lu %7lu\n", t_sb,
+             (unsigned long)run.period_us, simPeriodError_ppm[e] / 1e4,
+             run.readsPerSample, (unsigned long)run.stats.probes,
+             (unsigned long)run.stats.duplicates,
+             (unsigned long)run.stats.missed,
+             (unsigned long)run.stats.resyncs);
+    }
+  }
+
+  if (failures != 0) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,331 @@
+/**
+ * @file bmp280_pair_sim.c
+ * @brief Run two BMP280 sensors on one simulated I2C bus
+ *
+ * Two mock sensors at 0x76 and 0x77 share a 400 kHz bus and one clock. A
+ * forced mode write starts a conversion of typical length and puts the next
+ * raw sample of a per-sensor sequence in the data registers; reading the
+ * data before the conversion ended is a violation. Bus time is counted from
+ * bytes on the wire and the clock advances by it, so the table shows what
+ * the pipelined sequence of BMP280_Pair.c gains over measuring the sensors
+ * one after the other, and how busy the bus gets. Every result must be a
+ * fresh sample of its own sensor, no sequence number may be skipped, and
+ * compensated with the calibration of that sensor: the two sensors carry
+ * different coefficients and each result is compared with the datasheet
+ * floating point formula for its own set.
+ *
+ * Usage:
+ *   bmp280_pair_sim       run all settings, exit status 1 on failure
+ */
+
+#include "BMP280_Mock.h"
+#include "BMP280_Pair.h"
+#include <math.h>
+#include <stdio.h>
+
+#define SIM_PAIRS 200
+/** I2C clock, 9 clocks per byte with ACK */
+#define SIM_BUS_HZ 400000U
+/** Raw samples of sensor 0 and 1 start here and count up by conversion */
+#define SIM_ADC_T 519888
+#define SIM_ADC_P 415148
+#define SIM_ADC_STEP 4096
+
+/** Reference tolerance: 0.01 degC, 1 Pa in Q24.8 */
+#define SIM_TOLERANCE_T 1
+#define SIM_TOLERANCE_P 256
+
+/* Datasheet example calibration for sensor 0, another part for sensor 1 */
+static const struct BMP280_Calibration simCalib[2] = {
+    {27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600,
+     6000},
+    {27821, 25845, 50, 36699, -10514, 3024, 4916, -126, -7, 15500, -14600,
+     6000},
+};
+
+/** One simulated sensor, the mock has to stay first: dev->bus points to it */
+typedef struct SimSensor {
+  struct BMP280_Mock mock;
+  uint64_t conversionEnd_us;
+  int32_t conversions; // sequence number of the sample in data registers
+  uint32_t violations;
+} SimSensor;
+
+static uint64_t now_us;    // simulated time, shared by both sensors
+static uint64_t busTime_us;
+static int failures;
+
+#define CHECK(cond, ...)                                                       \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__);                              \
+      printf(__VA_ARGS__);                                                     \
+      printf("\n");                                                            \
+      ++failures;                                                              \
+    }                                                                          \
+  } while (0)
+
+static void SimBusBytes(uint32_t bytes) {
+  uint64_t bus_us = (uint64_t)bytes * 9 * 1000000 / SIM_BUS_HZ;
+
+  busTime_us += bus_us;
+  now_us += bus_us;
+}
+
+/**
+ * Address, register, repeated start with address, data
+ */
+static BMP280_Status SimRead(struct BMP280_Device *dev,
+                             uint8_t reg,
+                             uint8_t *data,
+                             uint16_t size) {
+  struct SimSensor *sensor = dev->bus;
+
+  SimBusBytes(3 + size);
+  if (reg == BMP280_READOUT_REG && now_us < sensor->conversionEnd_us) {
+    ++sensor->violations;
+  }
+  return BMP280_TransportMock.read(dev, reg, data, size);
+}
+
+/**
+ * Address, register, data; a forced mode trigger starts a conversion
+ */
+static BMP280_Status SimWrite(struct BMP280_Device *dev,
+                              uint8_t reg,
+                              const uint8_t *data,
+                              uint16_t size) {
+  struct SimSensor *sensor = dev->bus;
+  BMP280_Status status;
+
+  SimBusBytes(2 + size);
+  status = BMP280_TransportMock.write(dev, reg, data, size);
+  if (status == BMP280_OK && reg == BMP280_REG_CTRL_MEAS && size != 0 &&
+      (data[0] & BMP280_VAL_CTRL_MEAS_MODE_NORMAL) != 0 &&
+      (data[0] & BMP280_VAL_CTRL_MEAS_MODE_NORMAL) !=
+          BMP280_VAL_CTRL_MEAS_MODE_NORMAL) {
+    ++sensor->conversions;
+    sensor->conversionEnd_us =
+        now_us + BMP280_MeasurementTimeTypical_us(dev);
+    BMP280_MockSample(&sensor->mock,
+                      SIM_ADC_T + sensor->conversions,
+                      SIM_ADC_P + sensor->conversions);
+  }
+  return status;
+}
+
+/**
+ * Tick of vTaskDelay(), the first one is partial
+ */
+static void SimDelay_ms(struct BMP280_Device *dev, uint32_t ms) {
+  (void)dev;
+  now_us = (now_us / 1000 + ms) * 1000;
+}
+
+static uint32_t SimTick_ms(const struct BMP280_Device *dev) {
+  (void)dev;
+  return (uint32_t)(now_us / 1000);
+}
+
+static const struct BMP280_Transport simTransport = {
+    .read = SimRead,
+    .write = SimWrite,
+    .delay_ms = SimDelay_ms,
+    .tick_ms = SimTick_ms,
+};
+
+/**
+ * @brief Oversampling setting of one run
+ */
+typedef struct SimSetting {
+  const char *name;
+  uint8_t osrs_t;
+  uint8_t osrs_p;
+} SimSetting;
+
+/**
+ * @brief Outcome of one run
+ */
+typedef struct SimRun {
+  double sequential_Hz; // samples of both sensors per second
+  double pipelined_Hz;
+  double busLoad;       // pipelined bus time over elapsed time
+  struct BMP280_PairReport report;
+} SimRun;
+
+static struct SimSensor sensors[2];
+static struct BMP280_Device devices[2];
+
+static void SimSetup(const struct SimSetting *setting) {
+  static const uint8_t addresses[2] = {BMP280_DEVICE_ADDRESS_GND,
+                                       BMP280_DEVICE_ADDRESS_VDDIO};
+
+  now_us = 0;
+  for (uint8_t i = 0; i < 2; i++) {
+    BMP280_MockReset(&sensors[i].mock, &simCalib[i]);
+    sensors[i].conversionEnd_us = 0;
+    sensors[i].conversions = (int32_t)i * SIM_ADC_STEP;
+    sensors[i].violations = 0;
+    BMP280_MockAttach(&devices[i], &sensors[i].mock);
+    devices[i].transport = &simTransport;
+    devices[i].device_address = addresses[i];
+    CHECK(BMP280_Init(&devices[i], setting->osrs_t, setting->osrs_p,
+                      BMP280_VAL_CTRL_MEAS_MODE_SLEEP,
+                      BMP280_VAL_CTRL_CONFIG_T_SB_0_5,
+                      BMP280_VAL_CTRL_CONFIG_FILTER_0),
+          "%s: init of sensor %u", setting->name, i);
+  }
+}
+
+/**
+ * Datasheet double precision compensation of raw values with one
+ * calibration set, temperature in 0.01 degC and pressure in Q24.8 Pa
+ */
+static void SimReference(const struct BMP280_Calibration *c,
+                         int32_t adc_T,
+                         int32_t adc_P,
+                         double *temperature,
+                         double *pressure) {
+  double var1, var2, t_fine, p;
+
+  var1 = (adc_T / 16384.0 - c->dig_T1 / 1024.0) * c->dig_T2;
+  var2 = (adc_T / 131072.0 - c->dig_T1 / 8192.0) *
+         (adc_T / 131072.0 - c->dig_T1 / 8192.0) * c->dig_T3;
+  t_fine = var1 + var2;
+  *temperature = t_fine / 5120.0 * 100.0;
+
+  var1 = t_fine / 2.0 - 64000.0;
+  var2 = var1 * var1 * c->dig_P6 / 32768.0;
+  var2 = var2 + var1 * c->dig_P5 * 2.0;
+  var2 = var2 / 4.0 + c->dig_P4 * 65536.0;
+  var1 = (c->dig_P3 * var1 * var1 / 524288.0 + c->dig_P2 * var1) / 524288.0;
+  var1 = (1.0 + var1 / 32768.0) * c->dig_P1;
+  p = 1048576.0 - adc_P;
+  p = (p - var2 / 4096.0) * 6250.0 / var1;
+  var1 = c->dig_P9 * p * p / 2147483648.0;
+  var2 = p * c->dig_P8 / 32768.0;
+  *pressure = (p + (var1 + var2 + c->dig_P7) / 16.0) * 256.0;
+}
+
+/**
+ * Result has to be a fresh sample following the previous one of the
+ * sensor, compensated with its own calibration and not the other one
+ */
+static void SimResultCheck(const struct SimSetting *setting,
+                           uint8_t i,
+                           const struct BMP280_ResultInt *result,
+                           int32_t *previous) {
+  CHECK(result->flags == BMP280_RESULT_VALID, "%s: sensor %u flags %02x",
+        setting->name, i, result->flags);
+  CHECK(*previous == 0 || result->rawTemperature == *previous + 1,
+        "%s: sensor %u sample %ld after %ld", setting->name, i,
+        (long)result->rawTemperature, (long)*previous);
+  CHECK(result->rawPressure - SIM_ADC_P == result->rawTemperature - SIM_ADC_T,
+        "%s: sensor %u pressure from another sample", setting->name, i);
+  *previous = result->rawTemperature;
+
+  for (uint8_t c = 0; c < 2; c++) {
+    double temperature, pressure;
+    bool match;
+
+    SimReference(&simCalib[c], result->rawTemperature, result->rawPressure,
+                 &temperature, &pressure);
+    match = fabs(result->Temperature - temperature) <= SIM_TOLERANCE_T &&
+            fabs(result->Pressure - pressure) <= SIM_TOLERANCE_P;
+    CHECK(match == (c == i),
+          "%s: sensor %u T %ld P %lu, calibration %u gives T %.1f P %.1f",
+          setting->name, i, (long)result->Temperature,
+          (unsigned long)result->Pressure, c, temperature, pressure);
+  }
+}
+
+static struct SimRun SimRunSetting(const struct SimSetting *setting) {
+  struct SimRun run;
+  struct BMP280_Pair pair;
+  int32_t previous[2] = {0, 0};
+  uint64_t start_us;
+  uint64_t startBus_us;
+
+  // one sensor after the other, blocking forced measurements
+  SimSetup(setting);
+  start_us = now_us;
+  for (uint32_t n = 0; n < SIM_PAIRS; n++) {
+    for (uint8_t i = 0; i < 2; i++) {
+      struct BMP280_ResultInt result = BMP280_MeasureForcedInt_I2C(&devices[i]);
+
+      SimResultCheck(setting, i, &result, &previous[i]);
+    }
+  }
+  run.sequential_Hz = 2e6 * SIM_PAIRS / (double)(now_us - start_us);
+
+  // pipelined pair
+  SimSetup(setting);
+  previous[0] = previous[1] = 0;
+  start_us = now_us;
+  startBus_us = busTime_us;
+  BMP280_PairStart(&pair, &devices[0], &devices[1]);
+  for (uint32_t n = 0; n < SIM_PAIRS; n++) {
+    struct BMP280_PairSample sample = BMP280_PairMeasure(&pair);
+
+    for (uint8_t i = 0; i < 2; i++) {
+      SimResultCheck(setting, i, &sample.result[i], &previous[i]);
+    }
+    CHECK(sample.tick_ms[0] <= sample.tick_ms[1],
+          "%s: sensor 1 triggered before sensor 0", setting->name);
+  }
+  run.pipelined_Hz = 2e6 * SIM_PAIRS / (double)(now_us - start_us);
+  run.busLoad =
+      (double)(busTime_us - startBus_us) / (double)(now_us - start_us);
+  BMP280_PairReportGet(&pair, &run.report);
+
+  for (uint8_t i = 0; i < 2; i++) {
+    CHECK(sensors[i].violations == 0, "%s: sensor %u read %lu times early",
+          setting->name, i, (unsigned long)sensors[i].violations);
+  }
+  CHECK(run.report.pairs == SIM_PAIRS && run.report.errors == 0,
+        "%s: report %lu pairs, %lu errors", setting->name,
+        (unsigned long)run.report.pairs, (unsigned long)run.report.errors);
+  CHECK(run.report.maxSkew_ms <= 1, "%s: trigger skew %lu ms",
+        setting->name, (unsigned long)run.report.maxSkew_ms);
+  // the pair may lose a tick of rounding per conversion, not a conversion
+  CHECK(run.pipelined_Hz > 1.5 * run.sequential_Hz,
+        "%s: pipelined %.1f Hz, sequential %.1f Hz", setting->name,
+        run.pipelined_Hz, run.sequential_Hz);
+  return run;
+}
+
+int main(void) {
+  static const struct SimSetting settings[] = {
+      {"ultra low power x1/x1", BMP280_VAL_CTRL_MEAS_OSRS_T_1,
+       BMP280_VAL_CTRL_MEAS_OSRS_P_1},
+      {"standard x1/x4", BMP280_VAL_CTRL_MEAS_OSRS_T_1,
+       BMP280_VAL_CTRL_MEAS_OSRS_P_4},
+      {"ultra high res x2/x16", BMP280_VAL_CTRL_MEAS_OSRS_T_2,
+       BMP280_VAL_CTRL_MEAS_OSRS_P_16},
+  };
+  const size_t count = sizeof(settings) / sizeof(settings[0]);
+
+  printf("samples of both sensors per second, %u pairs at %u kHz\n",
+         SIM_PAIRS, SIM_BUS_HZ / 1000);
+  printf("%-24s %10s %10s %10s %10s %8s %5s\n", "setting", "sequential",
+         "seq limit", "pipelined", "pipe limit", "bus load", "skew");
+  for (size_t i = 0; i < count; i++) {
+    struct SimRun run = SimRunSetting(&settings[i]);
+
+    printf("%-24s %10.2f %10.2f %10.2f %10.2f %7.2f%% %2lu ms\n",
+           settings[i].name, run.sequential_Hz,
+           run.report.sequential_mHz / 1000.0, run.pipelined_Hz,
+           run.report.pipelined_mHz / 1000.0, 100 * run.busLoad,
+           (unsigned long)run.report.maxSkew_ms);
+    CHECK(run.report.rate_mHz / 1000.0 > 0.9 * run.pipelined_Hz,
+          "%s: report rate %lu mHz", settings[i].name,
+          (unsigned long)run.report.rate_mHz);
+  }
+
+  if (failures != 0) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,831 @@
+/**
+ * @file bmp280_spi_sim.c
+ * @brief Run the BMP280 driver against a simulated sensor over SPI and I2C
+ *
+ * The firmware driver is built unchanged. HAL I2C, SPI and GPIO calls end in
+ * a register model of the sensor which decodes the bus protocol byte by
+ * byte: SPI read bit and auto-increment, write address/data pairs with the
+ * read bit cleared, chip select framing, 3-wire mode selected through
+ * CONFIG, NACK and im_update after soft reset, forced conversion time.
+ * Every run must return the datasheet example values; protocol violations
+ * fail the check. Bus time is counted from bytes on the wire, so the table
+ * compares I2C and SPI transfers, not MCU overhead.
+ *
+ * A stuck I2C bus is simulated as well, see SimStuckBus(): the sensor
+ * holding SDA low or the BUSY flag set without traffic.
+ *
+ * Usage:
+ *   bmp280_spi_sim        run all transports, exit status 1 on failure
+ */
+
+#include "stm32f1xx_hal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Core register access and peripheral addresses of BMP280_STM32.c bus
+   recovery, redirected to the simulated I2C lines of SimStuckBus() */
+static uint32_t simPrimask;
+static I2C_TypeDef simI2CRegs;
+static AFIO_TypeDef simAfio;
+static GPIO_TypeDef simGpioB;
+static void SimPeripheralReset(void);
+#define __get_PRIMASK() (simPrimask)
+#define __disable_irq() (simPrimask = 1)
+#define __set_PRIMASK(x) (simPrimask = (x))
+#undef portYIELD_FROM_ISR
+#define portYIELD_FROM_ISR(x) (void)(x)
+#undef I2C1
+#define I2C1 (&simI2CRegs)
+#undef AFIO
+#define AFIO (&simAfio)
+#undef GPIOB
+#define GPIOB (&simGpioB)
+#undef __HAL_RCC_I2C1_FORCE_RESET
+#define __HAL_RCC_I2C1_FORCE_RESET() SimPeripheralReset()
+#undef __HAL_RCC_I2C1_RELEASE_RESET
+#define __HAL_RCC_I2C1_RELEASE_RESET() ((void)0)
+#undef __HAL_RCC_I2C2_FORCE_RESET
+#define __HAL_RCC_I2C2_FORCE_RESET() SimPeripheralReset()
+#undef __HAL_RCC_I2C2_RELEASE_RESET
+#define __HAL_RCC_I2C2_RELEASE_RESET() ((void)0)
+
+#include "../../App/Src/BMP280_STM32.c"
+
+/** Datasheet example: 25.08 degC, 100653.25 Pa from 64-bit formula */
+#define SIM_ADC_T 519888
+#define SIM_ADC_P 415148
+#define SIM_TEMPERATURE 2508
+#define SIM_PRESSURE_Q24_8 25767233U
+/** APB2 clock of SPI1 */
+#define SIM_PCLK_HZ 72000000U
+/** Sensor ignores the bus, then copies NVM, after soft reset */
+#define SIM_RESET_SILENT_US 1000U
+#define SIM_RESET_NVM_US 2000U
+
+static const uint8_t datasheetCalib[24] = {
+    0x70, 0x6B, 0x43, 0x67, 0x18, 0xFC, 0x7D, 0x8E, 0x43, 0xD6, 0xD0, 0x0B,
+    0x27, 0x0B, 0x8C, 0x00, 0xF9, 0xFF, 0x8C, 0x3C, 0xF8, 0xC6, 0x70, 0x17};
+
+uint32_t SystemCoreClock = 72000000;
+
+static uint64_t now_us;  // simulated time
+static double busTime_us; // bytes on the wire only
+static uint32_t busTransactions;
+static int failures;
+
+/** Register model of one sensor */
+static struct {
+  uint8_t regs[256];
+  uint64_t reset_us;
+  uint64_t conversionEnd_us;
+  uint32_t violations;
+  // SPI frame decoder
+  bool selected;
+  uint32_t frameBytes;
+  uint8_t address;
+  bool reading;
+} sensor;
+
+/**
+ * I2C lines of PB6/PB7 while bus recovery drives them as GPIO, open drain:
+ * a line is high only when neither the MCU nor the sensor pulls it low
+ */
+static struct SimLine {
+  bool scl;               // released by the MCU
+  bool sda;               // released by the MCU
+  uint32_t sdaHeldPulses; // SCL pulses until the sensor releases SDA
+  bool hangNext;          // sensor stops mid-byte in the next transfer
+  uint32_t hangPulses;    // sdaHeldPulses of the hang
+  uint32_t hangTimeout;   // deadline passed to the hung transfer, ms
+  uint16_t hangSize;      // data bytes of the hung transfer
+  uint32_t sclPulses;
+  uint32_t stops;
+  uint32_t resets;
+  uint32_t busyWaits; // transfers started on a busy bus
+} line = {.scl = true, .sda = true};
+
+static GPIO_TypeDef simCsPort;
+static SPI_TypeDef simSpiRegs;
+static void *pendingDma; // handle of DMA transfer completed at next poll
+
+#define CHECK(cond, ...)                                                       \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__);                              \
+      printf(__VA_ARGS__);                                                     \
+      printf("\n");                                                            \
+      ++failures;                                                              \
+    }                                                                          \
+  } while (0)
+
+static void SensorPowerOn(void) {
+  memset(&sensor, 0, sizeof(sensor));
+  memcpy(&sensor.regs[BMP280_REG_CALIB00], datasheetCalib,
+         sizeof(datasheetCalib));
+  sensor.regs[BMP280_REG_ID] = BMP280_VAL_DEVID;
+  sensor.regs[BMP280_REG_PRESS_MSB] = (uint8_t)(SIM_ADC_P >> 12);
+  sensor.regs[BMP280_REG_PRESS_LSB] = (uint8_t)(SIM_ADC_P >> 4);
+  sensor.regs[BMP280_REG_PRESS_XLSB] = (uint8_t)(SIM_ADC_P << 4);
+  sensor.regs[BMP280_REG_TEMP_MSB] = (uint8_t)(SIM_ADC_T >> 12);
+  sensor.regs[BMP280_REG_TEMP_LSB] = (uint8_t)(SIM_ADC_T >> 4);
+  sensor.regs[BMP280_REG_TEMP_XLSB] = (uint8_t)(SIM_ADC_T << 4);
+  sensor.reset_us = now_us - 1000000; // long since powered
+}
+
+static bool SensorSilent(void) {
+  return now_us - sensor.reset_us < SIM_RESET_SILENT_US;
+}
+
+static uint8_t SensorRead(uint8_t reg) {
+  uint8_t *ctrlMeas = &sensor.regs[BMP280_REG_CTRL_MEAS];
+
+  if ((*ctrlMeas & 3) == BMP280_VAL_CTRL_MEAS_MODE_FORCED &&
+      now_us >= sensor.conversionEnd_us) {
+    *ctrlMeas &= ~BMP280_VAL_CTRL_MEAS_MODE_NORMAL; // back to sleep
+  }
+  if (reg == BMP280_REG_STATUS) {
+    return (now_us - sensor.reset_us < SIM_RESET_NVM_US
+                ? BMP280_VAL_STATUS_IM_UPDATE
+                : 0) |
+           ((*ctrlMeas & 3) == BMP280_VAL_CTRL_MEAS_MODE_FORCED
+                ? BMP280_VAL_STATUS_MEASURING
+                : 0);
+  }
+  return sensor.regs[reg];
+}
+
+static void SensorWrite(uint8_t reg, uint8_t value) {
+  if (reg == BMP280_REG_RESET) {
+    if (value == BMP280_VAL_RESET) {
+      sensor.regs[BMP280_REG_CTRL_MEAS] = 0;
+      sensor.regs[BMP280_REG_CONFIG] = 0;
+      sensor.reset_us = now_us;
+    }
+    return;
+  }
+  if (reg != BMP280_REG_CTRL_MEAS && reg != BMP280_REG_CONFIG) {
+    ++sensor.violations; // read only register
+    return;
+  }
+  if (reg == BMP280_REG_CTRL_MEAS && (value & 3) == 1) {
+    sensor.conversionEnd_us = now_us + 1000 + 2300 * 16 * 2;
+  }
+  if (reg == BMP280_REG_CTRL_MEAS && (value & 3) == 2) {
+    value = (value & ~3) | BMP280_VAL_CTRL_MEAS_MODE_FORCED;
+    sensor.conversionEnd_us = now_us + 1000 + 2300 * 16 * 2;
+  }
+  sensor.regs[reg] = value;
+}
+
+static void BusAdvance(uint32_t bits, uint32_t clock_hz) {
+  double us = bits * 1e6 / clock_hz;
+
+  busTime_us += us;
+  now_us += (uint64_t)(us + 0.5) + 1; // at least 1 us of MCU overhead
+}
+
+uint32_t HAL_GetTick(void) { return (uint32_t)(now_us / 1000); }
+
+void HAL_Delay(uint32_t ms) { now_us += (ms + 1) * 1000ULL; }
+
+BaseType_t xTaskGetSchedulerState(void) { return taskSCHEDULER_NOT_STARTED; }
+
+void vTaskDelay(const TickType_t ticks) { now_us += ticks * 1000ULL; }
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) { return NULL; }
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait) {
+  (void)clear;
+  (void)wait;
+  return 0;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {
+  (void)task;
+  (void)woken;
+}
+
+/* I2C: register read is address, register, repeated start, address, data;
+   write is address, register, data; 9 clocks per byte */
+
+static HAL_StatusTypeDef SimI2C(I2C_HandleTypeDef *hi2c,
+                                bool read,
+                                uint16_t reg,
+                                uint8_t *data,
+                                uint16_t size,
+                                uint32_t timeout_ms) {
+  if (hi2c->State != HAL_I2C_STATE_READY) {
+    return HAL_BUSY;
+  }
+  if (hi2c->Instance->SR2 & I2C_SR2_BUSY) {
+    ++line.busyWaits; // HAL waits I2C_TIMEOUT_BUSY_FLAG for a free bus
+    now_us += 25000;
+    return HAL_BUSY;
+  }
+  ++busTransactions;
+  hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+  if (line.hangNext) {
+    // sensor stops mid-byte holding SDA low, HAL waits out the deadline
+    line.hangNext = false;
+    line.hangTimeout = timeout_ms;
+    line.hangSize = size;
+    line.sdaHeldPulses = line.hangPulses;
+    hi2c->Instance->SR2 |= I2C_SR2_BUSY;
+    hi2c->ErrorCode = HAL_I2C_ERROR_TIMEOUT;
+    now_us += (timeout_ms + 1) * 1000ULL;
+    return HAL_ERROR;
+  }
+  if (SensorSilent()) {
+    BusAdvance(9 + 2, hi2c->Init.ClockSpeed);
+    hi2c->ErrorCode = HAL_I2C_ERROR_AF;
+    return HAL_ERROR;
+  }
+
+  BusAdvance((read ? 3 + size : 2 + size) * 9 + 2, hi2c->Init.ClockSpeed);
+  if (read) {
+    for (uint16_t i = 0; i < size; i++) {
+      data[i] = SensorRead(reg + i);
+    }
+  } else {
+    SensorWrite(reg, data[0]);
+    for (uint16_t i = 1; i + 1 < size; i += 2) {
+      SensorWrite(data[i], data[i + 1]);
+    }
+  }
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c,
+                                   uint16_t DevAddress,
+                                   uint16_t MemAddress,
+                                   uint16_t MemAddSize,
+                                   uint8_t *pData,
+                                   uint16_t Size,
+                                   uint32_t Timeout) {
+  (void)DevAddress;
+  (void)MemAddSize;
+  return SimI2C(hi2c, true, MemAddress, pData, Size, Timeout);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c,
+                                    uint16_t DevAddress,
+                                    uint16_t MemAddress,
+                                    uint16_t MemAddSize,
+                                    uint8_t *pData,
+                                    uint16_t Size,
+                                    uint32_t Timeout) {
+  (void)DevAddress;
+  (void)MemAddSize;
+  return SimI2C(hi2c, false, MemAddress, pData, Size, Timeout);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read_IT(I2C_HandleTypeDef *hi2c,
+                                      uint16_t DevAddress,
+                                      uint16_t MemAddress,
+                                      uint16_t MemAddSize,
+                                      uint8_t *pData,
+                                      uint16_t Size) {
+  (void)hi2c;
+  (void)DevAddress;
+  (void)MemAddress;
+  (void)MemAddSize;
+  (void)pData;
+  (void)Size;
+  return HAL_ERROR; // scheduler never runs here
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write_IT(I2C_HandleTypeDef *hi2c,
+                                       uint16_t DevAddress,
+                                       uint16_t MemAddress,
+                                       uint16_t MemAddSize,
+                                       uint8_t *pData,
+                                       uint16_t Size) {
+  (void)hi2c;
+  (void)DevAddress;
+  (void)MemAddress;
+  (void)MemAddSize;
+  (void)pData;
+  (void)Size;
+  return HAL_ERROR;
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef *hi2c,
+                                       uint16_t DevAddress,
+                                       uint16_t MemAddress,
+                                       uint16_t MemAddSize,
+                                       uint8_t *pData,
+                                       uint16_t Size) {
+  HAL_StatusTypeDef status =
+      SimI2C(hi2c, true, MemAddress, pData, Size, HAL_MAX_DELAY);
+
+  (void)DevAddress;
+  (void)MemAddSize;
+  if (status == HAL_OK) {
+    hi2c->State = HAL_I2C_STATE_BUSY_RX;
+    pendingDma = hi2c;
+  }
+  return status;
+}
+
+HAL_I2C_StateTypeDef HAL_I2C_GetState(I2C_HandleTypeDef *hi2c) {
+  return hi2c->State;
+}
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c) {
+  hi2c->State = HAL_I2C_STATE_READY;
+  hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+  if (line.sdaHeldPulses != 0) {
+    hi2c->Instance->SR2 |= I2C_SR2_BUSY; // start of a transfer seen
+  }
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c) {
+  hi2c->State = HAL_I2C_STATE_RESET;
+  return HAL_OK;
+}
+
+/* SPI: chip select frames a transaction, the first byte is the register
+   address with the read bit, 8 clocks per byte */
+
+static bool SpiLineValid(SPI_HandleTypeDef *hspi) {
+  bool threeWire = hspi->Init.Direction == SPI_DIRECTION_1LINE;
+  bool sensorThreeWire =
+      sensor.regs[BMP280_REG_CONFIG] & BMP280_VAL_CTRL_SPI3W_EN;
+
+  // sensor answers on SDO in 4-wire mode and on SDI in 3-wire mode
+  return threeWire == sensorThreeWire && !SensorSilent();
+}
+
+static uint8_t SpiByte(SPI_HandleTypeDef *hspi, uint8_t tx) {
+  uint8_t rx = 0xFF; // undriven line
+  bool valid = SpiLineValid(hspi);
+
+  if (!sensor.selected) {
+    ++sensor.violations; // clocked without chip select
+    return rx;
+  }
+  if (sensor.frameBytes == 0) {
+    sensor.reading = tx & BMP280_SPI_READ;
+    sensor.address = tx | BMP280_SPI_READ; // address MSB is implied
+  } else if (sensor.reading) {
+    uint8_t value = SensorRead(sensor.address++);
+    rx = valid ? value : rx;
+  } else if (sensor.frameBytes & 1U) {
+    if (!SensorSilent()) {
+      SensorWrite(sensor.address, tx);
+    }
+  } else {
+    if (tx & BMP280_SPI_READ) {
+      ++sensor.violations; // read bit inside a write burst
+    }
+    sensor.address = tx | BMP280_SPI_READ;
+  }
+  ++sensor.frameBytes;
+  return rx;
+}
+
+static uint32_t SpiClock_hz(SPI_HandleTypeDef *hspi) {
+  return SIM_PCLK_HZ / (2U << ((hspi->Init.BaudRatePrescaler >> 3) & 7U));
+}
+
+/** Levels of the recovered lines, SDA held low by the sensor */
+static bool LineSda(void) { return line.sda && line.sdaHeldPulses == 0; }
+
+/**
+ * Bus recovery drives PB6 (SCL) and PB7 (SDA): count SCL pulses with SDA
+ * released, the sensor clocks out one bit of the stuck byte on each, and
+ * STOP conditions
+ */
+static void LineWrite(uint16_t pins, bool level) {
+  bool sclBefore = line.scl;
+  bool sdaBefore = LineSda();
+
+  if (pins & GPIO_PIN_6) {
+    line.scl = level;
+  }
+  if (pins & GPIO_PIN_7) {
+    line.sda = level;
+  }
+  if (!sclBefore && line.scl && line.sda) {
+    ++line.sclPulses;
+    if (line.sdaHeldPulses != 0) {
+      --line.sdaHeldPulses;
+    }
+  }
+  if (sclBefore && line.scl && !sdaBefore && LineSda()) {
+    ++line.stops;
+  }
+}
+
+static void SimPeripheralReset(void) {
+  ++line.resets;
+  simI2CRegs.SR2 &= ~I2C_SR2_BUSY;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx,
+                       uint16_t GPIO_Pin,
+                       GPIO_PinState PinState) {
+  if (GPIOx == GPIOB) {
+    LineWrite(GPIO_Pin, PinState == GPIO_PIN_SET);
+    return;
+  }
+  if (GPIOx != &simCsPort) {
+    return;
+  }
+  if (PinState == GPIO_PIN_RESET && !sensor.selected) {
+    ++busTransactions;
+    sensor.frameBytes = 0;
+  }
+  sensor.selected = PinState == GPIO_PIN_RESET;
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+  if (GPIOx == GPIOB && GPIO_Pin == GPIO_PIN_7 && !LineSda()) {
+    return GPIO_PIN_RESET;
+  }
+  return GPIO_PIN_SET;
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init) {
+  (void)GPIOx;
+  (void)GPIO_Init;
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi,
+                                   uint8_t *pData,
+                                   uint16_t Size,
+                                   uint32_t Timeout) {
+  (void)Timeout;
+  for (uint16_t i = 0; i < Size; i++) {
+    (void)SpiByte(hspi, pData[i]);
+  }
+  BusAdvance(8U * Size, SpiClock_hz(hspi));
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi,
+                                  uint8_t *pData,
+                                  uint16_t Size,
+                                  uint32_t Timeout) {
+  (void)Timeout;
+  for (uint16_t i = 0; i < Size; i++) {
+    pData[i] = SpiByte(hspi, 0xFF);
+  }
+  BusAdvance(8U * Size, SpiClock_hz(hspi));
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef *hspi,
+                                              uint8_t *pTxData,
+                                              uint8_t *pRxData,
+                                              uint16_t Size) {
+  if (hspi->Init.Direction == SPI_DIRECTION_1LINE) {
+    return HAL_ERROR; // full duplex only, as in HAL
+  }
+  for (uint16_t i = 0; i < Size; i++) {
+    pRxData[i] = SpiByte(hspi, pTxData[i]);
+  }
+  BusAdvance(8U * Size, SpiClock_hz(hspi));
+  pendingDma = hspi;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef *hspi) {
+  (void)hspi;
+  pendingDma = NULL;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void) { return HAL_ERROR; }
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void) { return HAL_OK; }
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit,
+                                    uint32_t *PageError) {
+  (void)pEraseInit;
+  (void)PageError;
+  return HAL_ERROR;
+}
+
+HAL_StatusTypeDef
+HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data) {
+  (void)TypeProgram;
+  (void)Address;
+  (void)Data;
+  return HAL_ERROR;
+}
+
+/**
+ * Interrupt of DMA transfer, delivered when the driver polls
+ */
+static void SimDmaInterrupt(struct BMP280_Device *dev) {
+  void *handle = pendingDma;
+
+  pendingDma = NULL;
+  if (handle != NULL && handle == dev->bus && !BMP280_IsSPI(dev)) {
+    BMP280_I2C(dev)->State = HAL_I2C_STATE_READY;
+    BMP280_I2C_MemRxCpltCallback(dev->bus);
+  } else if (handle != NULL) {
+    BMP280_SPI_TxRxCpltCallback(handle);
+  }
+}
+
+/** Transport under test */
+struct SimTransport {
+  const char *name;
+  bool spi;
+  uint32_t direction; // SPI_DIRECTION_*
+  uint32_t prescaler; // SPI_BAUDRATEPRESCALER_*
+};
+
+/** Bus time and transactions of the measured operations */
+struct SimReport {
+  double init_us, forced_us, readout_us, dma_us;
+  uint32_t initTransactions, forcedTransactions, readoutTransactions;
+  uint64_t initWall_us;
+};
+
+static bool SimInit(struct BMP280_Device *dev,
+                    const struct SimTransport *transport,
+                    uint8_t mode,
+                    I2C_HandleTypeDef *hi2c,
+                    SPI_HandleTypeDef *hspi) {
+  memset(hi2c, 0, sizeof(*hi2c));
+  hi2c->Instance = &simI2CRegs;
+  hi2c->Init.ClockSpeed = 400000;
+  hi2c->State = HAL_I2C_STATE_READY;
+  memset(hspi, 0, sizeof(*hspi));
+  hspi->Instance = &simSpiRegs;
+  hspi->Init.Direction = transport->direction;
+  hspi->Init.BaudRatePrescaler = transport->prescaler;
+  hspi->State = HAL_SPI_STATE_READY;
+
+  if (transport->spi) {
+    return BMP280_Init_SPI(dev,
+                           BMP280_VAL_CTRL_MEAS_OSRS_T_16,
+                           BMP280_VAL_CTRL_MEAS_OSRS_P_16,
+                           mode,
+                           BMP280_VAL_CTRL_CONFIG_T_SB_0_5,
+                           BMP280_VAL_CTRL_CONFIG_FILTER_0,
+                           hspi,
+                           &simCsPort,
+                           GPIO_PIN_4);
+  }
+  return BMP280_Init_I2C(dev,
+                         BMP280_VAL_CTRL_MEAS_OSRS_T_16,
+                         BMP280_VAL_CTRL_MEAS_OSRS_P_16,
+                         mode,
+                         BMP280_VAL_CTRL_CONFIG_T_SB_0_5,
+                         BMP280_VAL_CTRL_CONFIG_FILTER_0,
+                         hi2c,
+                         BMP280_DEVICE_ADDRESS_GND);
+}
+
+static void CheckResult(const char *name,
+                        const char *what,
+                        int32_t temperature,
+                        uint32_t pressure,
+                        bool valid) {
+  CHECK(valid && temperature == SIM_TEMPERATURE &&
+            pressure == SIM_PRESSURE_Q24_8,
+        "%s %s: valid %d T %ld P %lu", name, what, valid, (long)temperature,
+        (unsigned long)pressure);
+}
+
+static struct SimReport SimRun(const struct SimTransport *transport) {
+  struct BMP280_Device dev, other;
+  I2C_HandleTypeDef hi2c;
+  SPI_HandleTypeDef hspi;
+  struct BMP280_ResultInt result;
+  struct BMP280_Result floatResult;
+  struct SimReport report = {0};
+  uint64_t start_us;
+  double bus_us;
+  uint32_t transactions;
+  uint8_t id;
+  bool started;
+
+  // forced mode: init, then one sample
+  SensorPowerOn();
+  busTime_us = 0;
+  busTransactions = 0;
+  start_us = now_us;
+  CHECK(SimInit(&dev, transport, BMP280_VAL_CTRL_MEAS_MODE_FORCED, &hi2c,
+                &hspi),
+        "%s: init failed", transport->name);
+  report.initWall_us = now_us - start_us;
+  report.init_us = busTime_us;
+  report.initTransactions = busTransactions;
+  CHECK(dev.ctrlMeas == sensor.regs[BMP280_REG_CTRL_MEAS] &&
+            dev.config == sensor.regs[BMP280_REG_CONFIG],
+        "%s: sensor configuration %02x %02x, expected %02x %02x",
+        transport->name, sensor.regs[BMP280_REG_CTRL_MEAS],
+        sensor.regs[BMP280_REG_CONFIG], dev.ctrlMeas, dev.config);
+  if (transport->direction == SPI_DIRECTION_1LINE) {
+    CHECK(sensor.regs[BMP280_REG_CONFIG] & BMP280_VAL_CTRL_SPI3W_EN,
+          "%s: 3-wire mode not enabled", transport->name);
+  }
+
+  bus_us = busTime_us;
+  transactions = busTransactions;
+  result = BMP280_MeasureForcedInt_I2C(&dev);
+  report.forced_us = busTime_us - bus_us;
+  report.forcedTransactions = busTransactions - transactions;
+  CheckResult(transport->name, "forced", result.Temperature,
+              result.Pressure, result.flags & BMP280_RESULT_VALID);
+
+  // normal mode: blocking and DMA readout of running conversions
+  SensorPowerOn();
+  CHECK(SimInit(&dev, transport, BMP280_VAL_CTRL_MEAS_MODE_NORMAL, &hi2c,
+                &hspi),
+        "%s: normal mode init failed", transport->name);
+  now_us += 100000;
+  transactions = busTransactions;
+  CHECK(BMP280_Wake_I2C(&dev) && busTransactions == transactions &&
+            (sensor.regs[BMP280_REG_CTRL_MEAS] & 3) ==
+                BMP280_VAL_CTRL_MEAS_MODE_NORMAL,
+        "%s: wake left normal mode, CTRL_MEAS %02x", transport->name,
+        sensor.regs[BMP280_REG_CTRL_MEAS]);
+
+  bus_us = busTime_us;
+  transactions = busTransactions;
+  result = BMP280_MeasureInt_I2C(&dev);
+  report.readout_us = busTime_us - bus_us;
+  report.readoutTransactions = busTransactions - transactions;
+  CheckResult(transport->name, "readout", result.Temperature,
+              result.Pressure, result.flags & BMP280_RESULT_VALID);
+
+  bus_us = busTime_us;
+  started = BMP280_MeasureStart_DMA(&dev);
+  report.dma_us = busTime_us - bus_us;
+  if (transport->direction == SPI_DIRECTION_1LINE) {
+    CHECK(!started, "%s: DMA readout started in 3-wire mode",
+          transport->name);
+    report.dma_us = 0;
+  } else {
+    CHECK(started, "%s: DMA readout not started", transport->name);
+    // completions are matched by bus: a second one has to wait
+    other = dev;
+    other.asyncState = BMP280_ASYNC_IDLE;
+    CHECK(!BMP280_MeasureStart_DMA(&other) &&
+              other.asyncState == BMP280_ASYNC_IDLE,
+          "%s: second DMA readout started on a busy bus", transport->name);
+    // so has a blocking transfer of another sensor on the same bus
+    transactions = busTransactions;
+    CHECK(other.transport->read(&other, BMP280_REG_ID, &id, 1) ==
+                  BMP280_BUSY &&
+              busTransactions == transactions,
+          "%s: register read ran during a DMA readout", transport->name);
+    SimDmaInterrupt(&dev);
+    CHECK(BMP280_MeasurePoll_DMA(&dev) == BMP280_ASYNC_DONE,
+          "%s: DMA readout not done", transport->name);
+    floatResult = BMP280_MeasureComplete_DMA(&dev);
+    CHECK(floatResult.Temperature > 25.07f &&
+              floatResult.Temperature < 25.09f &&
+              floatResult.Pressure > 100653.2f &&
+              floatResult.Pressure < 100653.3f,
+          "%s: DMA readout T %.2f P %.2f", transport->name,
+          (double)floatResult.Temperature, (double)floatResult.Pressure);
+    CHECK(!sensor.selected, "%s: chip select left low", transport->name);
+  }
+  (void)BMP280_MeasurePoll_DMA(&dev); // 3-wire start failed into ERROR
+  (void)BMP280_MeasureComplete_DMA(&dev);
+
+  CHECK(sensor.violations == 0, "%s: %lu protocol violations",
+        transport->name, (unsigned long)sensor.violations);
+  return report;
+}
+
+/**
+ * Bus recovery against a sensor stuck mid-byte: the transfer has to fail at
+ * its deadline, SCL is pulsed until SDA is released, a STOP is sent, the
+ * peripheral is reset and the repeated transfer returns the sample. A BUSY
+ * flag stuck on an idle bus is recovered before any transfer waits for it;
+ * a line held for good ends in a bus error after bounded time.
+ */
+static void SimStuckBus(void) {
+  static const struct SimTransport i2c = {"I2C stuck bus", false, 0, 0};
+  struct BMP280_Device dev;
+  I2C_HandleTypeDef hi2c;
+  SPI_HandleTypeDef hspi;
+  struct BMP280_ResultInt result;
+  uint64_t start_us;
+  uint32_t deadline_us;
+
+  SensorPowerOn();
+  CHECK(SimInit(&dev, &i2c, BMP280_VAL_CTRL_MEAS_MODE_NORMAL, &hi2c, &hspi),
+        "%s: init failed", i2c.name);
+  now_us += 100000;
+
+  // SDA held for 5 more clocks of the byte the sensor was sending
+  dev.stats = (struct BMP280_Stats){0};
+  line = (struct SimLine){.scl = true, .sda = true};
+  line.hangNext = true;
+  line.hangPulses = 5;
+  start_us = now_us;
+  result = BMP280_MeasureInt_I2C(&dev);
+  deadline_us = BMP280_TransferTimeout_ms(&dev, line.hangSize) * 1000U;
+  CHECK(line.hangTimeout * 1000U == deadline_us,
+        "SDA held: transfer deadline %lu ms, expected %lu us",
+        (unsigned long)line.hangTimeout, (unsigned long)deadline_us);
+  CHECK(now_us - start_us <= deadline_us + 2000U,
+        "SDA held: readout took %lu us, deadline %lu us",
+        (unsigned long)(now_us - start_us), (unsigned long)deadline_us);
+  CHECK(dev.stats.timeouts == 1 && dev.stats.busRecoveries == 1 &&
+            dev.stats.retries == 1,
+        "SDA held: %lu timeouts, %lu recoveries, %lu retries",
+        (unsigned long)dev.stats.timeouts,
+        (unsigned long)dev.stats.busRecoveries,
+        (unsigned long)dev.stats.retries);
+  CHECK(line.sclPulses == 5 && line.stops == 1 && line.resets == 1,
+        "SDA held: %lu SCL pulses, %lu STOPs, %lu peripheral resets",
+        (unsigned long)line.sclPulses, (unsigned long)line.stops,
+        (unsigned long)line.resets);
+  CHECK(!(simI2CRegs.SR2 & I2C_SR2_BUSY) && line.busyWaits == 0,
+        "SDA held: BUSY %d, %lu transfers on a busy bus",
+        !!(simI2CRegs.SR2 & I2C_SR2_BUSY), (unsigned long)line.busyWaits);
+  CheckResult(i2c.name, "retry after SDA held", result.Temperature,
+              result.Pressure, result.flags & BMP280_RESULT_VALID);
+
+  // BUSY flag stuck with both lines high, no transfer may wait for it
+  dev.stats = (struct BMP280_Stats){0};
+  line = (struct SimLine){.scl = true, .sda = true};
+  simI2CRegs.SR2 |= I2C_SR2_BUSY;
+  start_us = now_us;
+  result = BMP280_MeasureInt_I2C(&dev);
+  CHECK(now_us - start_us < 1000U && line.busyWaits == 0,
+        "BUSY stuck: readout took %lu us, %lu transfers on a busy bus",
+        (unsigned long)(now_us - start_us), (unsigned long)line.busyWaits);
+  CHECK(dev.stats.busRecoveries == 1 && dev.stats.timeouts == 0 &&
+            line.sclPulses == 0 && line.stops == 1 && line.resets == 1,
+        "BUSY stuck: %lu recoveries, %lu timeouts, %lu SCL pulses, %lu "
+        "STOPs, %lu resets",
+        (unsigned long)dev.stats.busRecoveries,
+        (unsigned long)dev.stats.timeouts, (unsigned long)line.sclPulses,
+        (unsigned long)line.stops, (unsigned long)line.resets);
+  CheckResult(i2c.name, "after BUSY stuck", result.Temperature,
+              result.Pressure, result.flags & BMP280_RESULT_VALID);
+
+  // SDA shorted low: every attempt recovers, then the readout gives up
+  dev.stats = (struct BMP280_Stats){0};
+  line = (struct SimLine){.scl = true, .sda = true};
+  line.hangNext = true;
+  line.hangPulses = UINT32_MAX;
+  start_us = now_us;
+  result = BMP280_MeasureInt_I2C(&dev);
+  CHECK(result.flags == BMP280_RESULT_BUS_ERROR,
+        "SDA shorted: result flags 0x%x", result.flags);
+  CHECK(dev.stats.busRecoveries == BMP280_I2C_RETRIES + 1 &&
+            dev.stats.transactions == 1 &&
+            line.sclPulses ==
+                (BMP280_I2C_RETRIES + 1) * BMP280_I2C_RECOVERY_PULSES &&
+            line.busyWaits == 0,
+        "SDA shorted: %lu recoveries, %lu transactions, %lu SCL pulses",
+        (unsigned long)dev.stats.busRecoveries,
+        (unsigned long)dev.stats.transactions,
+        (unsigned long)line.sclPulses);
+  CHECK(now_us - start_us <= deadline_us + 2000U,
+        "SDA shorted: gave up after %lu us", (unsigned long)(now_us - start_us));
+
+  line = (struct SimLine){.scl = true, .sda = true};
+  simI2CRegs.SR2 = 0;
+}
+
+int main(void) {
+  static const struct SimTransport transports[] = {
+      {"I2C 400 kHz", false, 0, 0},
+      {"SPI 4-wire 9 MHz", true, SPI_DIRECTION_2LINES,
+       SPI_BAUDRATEPRESCALER_8},
+      {"SPI 3-wire 9 MHz", true, SPI_DIRECTION_1LINE,
+       SPI_BAUDRATEPRESCALER_8},
+      {"SPI 4-wire 4.5 MHz", true, SPI_DIRECTION_2LINES,
+       SPI_BAUDRATEPRESCALER_16},
+  };
+  const size_t count = sizeof(transports) / sizeof(transports[0]);
+
+  printf("bus time in us (transactions), init includes polls during reset; "
+         "init ms is wall time\n");
+  printf("%-20s %16s %16s %16s %10s %8s\n", "transport", "init",
+         "forced sample", "readout", "DMA burst", "init ms");
+  for (size_t i = 0; i < count; i++) {
+    struct SimReport report = SimRun(&transports[i]);
+
+    printf("%-20s %9.1f (%4lu) %9.1f (%4lu) %9.1f (%4lu) %10.1f %8.1f\n",
+           transports[i].name, report.init_us,
+           (unsigned long)report.initTransactions, report.forced_us,
+           (unsigned long)report.forcedTransactions, report.readout_us,
+           (unsigned long)report.readoutTransactions, report.dma_us,
+           report.initWall_us / 1000.0);
+  }
+  SimStuckBus();
+
+  if (failures != 0) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
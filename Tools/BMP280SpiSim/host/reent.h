@@ -0,0 +1,10 @@
+/**
+ * @file reent.h
+ * @brief newlib reentrancy structure referenced by FreeRTOS task headers
+ */
+
+#pragma once
+
+struct _reent {
+  int _errno;
+};
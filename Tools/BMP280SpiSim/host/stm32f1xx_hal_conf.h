@@ -0,0 +1,19 @@
+/**
+ * @file stm32f1xx_hal_conf.h
+ * @brief Host build configuration: firmware HAL configuration plus SPI
+ *
+ * The firmware project keeps the HAL SPI module disabled until an SPI
+ * sensor is wired, so its sources are not in the tree. This wrapper enables
+ * the SPI part of the driver against the declarations in
+ * stm32f1xx_hal_spi.h of this directory.
+ */
+
+#ifndef BMP280_SPI_SIM_HAL_CONF_H
+#define BMP280_SPI_SIM_HAL_CONF_H
+
+#include "../../../Core/Inc/stm32f1xx_hal_conf.h"
+
+#define HAL_SPI_MODULE_ENABLED
+#include "stm32f1xx_hal_spi.h"
+
+#endif
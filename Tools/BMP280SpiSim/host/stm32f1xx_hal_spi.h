@@ -0,0 +1,63 @@
+/**
+ * @file stm32f1xx_hal_spi.h
+ * @brief Subset of STM32F1 HAL SPI declarations used by BMP280_STM32.c
+ *
+ * Names and signatures follow the HAL, the functions are implemented by
+ * the simulated bus in bmp280_spi_sim.c.
+ */
+
+#pragma once
+
+typedef struct {
+  uint32_t Mode;
+  uint32_t Direction;
+  uint32_t DataSize;
+  uint32_t CLKPolarity;
+  uint32_t CLKPhase;
+  uint32_t NSS;
+  uint32_t BaudRatePrescaler;
+  uint32_t FirstBit;
+  uint32_t TIMode;
+  uint32_t CRCCalculation;
+  uint32_t CRCPolynomial;
+} SPI_InitTypeDef;
+
+typedef enum {
+  HAL_SPI_STATE_RESET = 0x00U,
+  HAL_SPI_STATE_READY = 0x01U,
+  HAL_SPI_STATE_BUSY = 0x02U,
+  HAL_SPI_STATE_BUSY_TX_RX = 0x05U,
+  HAL_SPI_STATE_ERROR = 0x06U,
+} HAL_SPI_StateTypeDef;
+
+typedef struct __SPI_HandleTypeDef {
+  SPI_TypeDef *Instance;
+  SPI_InitTypeDef Init;
+  DMA_HandleTypeDef *hdmatx;
+  DMA_HandleTypeDef *hdmarx;
+  HAL_LockTypeDef Lock;
+  __IO HAL_SPI_StateTypeDef State;
+  __IO uint32_t ErrorCode;
+} SPI_HandleTypeDef;
+
+#define SPI_DIRECTION_2LINES 0x00000000U
+#define SPI_DIRECTION_1LINE SPI_CR1_BIDIMODE
+
+#define SPI_BAUDRATEPRESCALER_2 0x00000000U
+#define SPI_BAUDRATEPRESCALER_4 (SPI_CR1_BR_0)
+#define SPI_BAUDRATEPRESCALER_8 (SPI_CR1_BR_1)
+#define SPI_BAUDRATEPRESCALER_16 (SPI_CR1_BR_1 | SPI_CR1_BR_0)
+
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi,
+                                   uint8_t *pData,
+                                   uint16_t Size,
+                                   uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi,
+                                  uint8_t *pData,
+                                  uint16_t Size,
+                                  uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef *hspi,
+                                              uint8_t *pTxData,
+                                              uint8_t *pRxData,
+                                              uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef *hspi);